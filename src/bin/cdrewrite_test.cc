@@ -0,0 +1,218 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Checks that the rules CDRewriteRule builds directly rewrite every string
+// like those of the general construction.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "fst/arc.h"
+#include "fst/compose.h"
+#include "fst/connect.h"
+#include "fst/determinize.h"
+#include "fst/equivalent.h"
+#include "fst/project.h"
+#include "fst/rmepsilon.h"
+#include "fst/vector-fst.h"
+#include "gtest/gtest.h"
+#include "thrax/algo/cdrewrite.h"
+
+namespace fst {
+namespace {
+
+using Weight = StdArc::Weight;
+
+// The alphabet of the rules, as byte labels.
+constexpr char kSigma[] = "abcd";
+
+// One rewrite of a symbol of phi.
+struct Rewrite {
+  char input;
+  std::string output;
+  float weight;
+};
+
+// Returns the closure of the symbols.
+StdVectorFst Sigma(const std::string &symbols) {
+  StdVectorFst fst;
+  const auto start = fst.AddState();
+  fst.SetStart(start);
+  fst.SetFinal(start, Weight::One());
+  for (const auto symbol : symbols) {
+    fst.AddArc(start, StdArc(symbol, symbol, Weight::One(), start));
+  }
+  return fst;
+}
+
+// Returns the acceptor of the symbols, each as a string of its own, or of the
+// empty string (i.e., an unrestricted context) if there are none.
+StdVectorFst Symbols(const std::string &symbols) {
+  StdVectorFst fst;
+  const auto start = fst.AddState();
+  fst.SetStart(start);
+  if (symbols.empty()) {
+    fst.SetFinal(start, Weight::One());
+    return fst;
+  }
+  const auto final = fst.AddState();
+  fst.SetFinal(final, Weight::One());
+  for (const auto symbol : symbols) {
+    fst.AddArc(start, StdArc(symbol, symbol, Weight::One(), final));
+  }
+  return fst;
+}
+
+// Returns phi X psi for the rewrites.
+StdVectorFst Tau(const std::vector<Rewrite> &rewrites) {
+  StdVectorFst fst;
+  const auto start = fst.AddState();
+  fst.SetStart(start);
+  for (const auto &rewrite : rewrites) {
+    auto state = fst.AddState();
+    fst.AddArc(start, StdArc(rewrite.input,
+                             rewrite.output.empty() ? 0 : rewrite.output[0],
+                             Weight::One(), state));
+    for (size_t i = 1; i < rewrite.output.size(); ++i) {
+      const auto next = fst.AddState();
+      fst.AddArc(state, StdArc(0, rewrite.output[i], Weight::One(), next));
+      state = next;
+    }
+    fst.SetFinal(state, Weight(rewrite.weight));
+  }
+  return fst;
+}
+
+StdVectorFst String(const std::string &text) {
+  StdVectorFst fst;
+  auto state = fst.AddState();
+  fst.SetStart(state);
+  for (const auto symbol : text) {
+    const auto next = fst.AddState();
+    fst.AddArc(state, StdArc(symbol, symbol, Weight::One(), next));
+    state = next;
+  }
+  fst.SetFinal(state, Weight::One());
+  return fst;
+}
+
+// Returns all strings over the symbols of up to the given length.
+std::vector<std::string> Strings(const std::string &symbols, size_t length) {
+  std::vector<std::string> strings = {""};
+  for (size_t i = 0; i < strings.size(); ++i) {
+    if (strings[i].size() == length) continue;
+    for (const auto symbol : symbols) strings.push_back(strings[i] + symbol);
+  }
+  return strings;
+}
+
+StdVectorFst CompileRule(const std::vector<Rewrite> &rewrites,
+                         const std::string &left, const std::string &right,
+                         CDRewriteDirection dir, CDRewriteMode mode,
+                         bool direct) {
+  std::string phi;
+  for (const auto &rewrite : rewrites) phi += rewrite.input;
+  internal::CDRewriteRule<StdArc> rule(Symbols(phi), Tau(rewrites),
+                                       Symbols(left), Symbols(right),
+                                       /*phiXpsi=*/true);
+  rule.SetDirectConstruction(direct);
+  StdVectorFst fst;
+  rule.Compile(Sigma(kSigma), &fst, dir, mode);
+  return fst;
+}
+
+// Returns the (weighted) outputs of the rule for the input, determinized.
+StdVectorFst Outputs(const StdVectorFst &rule, const std::string &input) {
+  StdVectorFst composed;
+  Compose(String(input), rule, &composed);
+  Project(&composed, ProjectType::OUTPUT);
+  RmEpsilon(&composed);
+  StdVectorFst outputs;
+  Determinize(composed, &outputs);
+  Connect(&outputs);
+  return outputs;
+}
+
+// Checks that both constructions give the same outputs for all short strings,
+// in every direction and mode and with every combination of contexts.
+void ExpectSameRewrites(const std::vector<Rewrite> &rewrites) {
+  for (const auto dir : {LEFT_TO_RIGHT, RIGHT_TO_LEFT, SIMULTANEOUS}) {
+    for (const auto mode : {OBLIGATORY, OPTIONAL}) {
+      for (const std::string left : {"", "c"}) {
+        for (const std::string right : {"", "d"}) {
+          SCOPED_TRACE(testing::Message()
+                       << "dir=" << dir << " mode=" << mode << " left='"
+                       << left << "' right='" << right << "'");
+          const auto direct =
+              CompileRule(rewrites, left, right, dir, mode, true);
+          const auto general =
+              CompileRule(rewrites, left, right, dir, mode, false);
+          ASSERT_FALSE(direct.Properties(kError, false));
+          ASSERT_FALSE(general.Properties(kError, false));
+          for (const auto &input : Strings(kSigma, 4)) {
+            SCOPED_TRACE(input);
+            const auto direct_outputs = Outputs(direct, input);
+            const auto general_outputs = Outputs(general, input);
+            if (direct_outputs.Start() == kNoStateId ||
+                general_outputs.Start() == kNoStateId) {
+              EXPECT_EQ(direct_outputs.Start(), general_outputs.Start());
+            } else {
+              EXPECT_TRUE(Equivalent(direct_outputs, general_outputs));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(CDRewriteDirectTest, SingleSymbol) {
+  ExpectSameRewrites({{'a', "b", 0}});
+}
+
+TEST(CDRewriteDirectTest, SeveralSymbols) {
+  ExpectSameRewrites({{'a', "b", 0}, {'b', "a", 0}});
+}
+
+TEST(CDRewriteDirectTest, LongerOutput) {
+  ExpectSameRewrites({{'a', "bb", 0}});
+}
+
+TEST(CDRewriteDirectTest, WeightedTau) {
+  ExpectSameRewrites({{'a', "b", 1.5}, {'a', "c", 0.5}, {'b', "a", 2}});
+}
+
+TEST(CDRewriteDirectTest, OutputOutsideSigma) {
+  ExpectSameRewrites({{'a', "X", 0}});
+}
+
+TEST(CDRewriteDirectTest, OutputPartlyOutsideSigma) {
+  ExpectSameRewrites({{'a', "bX", 0}, {'b', "a", 0}});
+}
+
+TEST(CDRewriteDirectTest, Deletion) {
+  ExpectSameRewrites({{'a', "", 0}});
+}
+
+TEST(CDRewriteDirectTest, OutputInContext) {
+  ExpectSameRewrites({{'a', "c", 0}, {'b', "d", 1}});
+}
+
+TEST(CDRewriteDirectTest, PhiInContext) {
+  ExpectSameRewrites({{'c', "a", 0}, {'d', "b", 0}});
+}
+
+}  // namespace
+}  // namespace fst
@@ -0,0 +1,528 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Long-lived compile server. Keeps a set of grammars (and everything they
+// import) compiled: the source tree is watched for changes and, whenever a
+// grammar file or one of the data files it reads (string files, symbol tables,
+// FSTs and FARs) changes, only the grammars whose dependency cone contains the
+// changed file are recompiled, in import order. FARs are replaced atomically so
+// that a concurrently running rewrite tester never sees a partial archive.
+//
+// Rebuilds reuse the work of earlier ones: unchanged grammars are not parsed
+// again, and the results of the function calls evaluated so far are cached
+// (see evaluation-cache.h), so that only the rules depending on a change are
+// recomputed.
+//
+// Usage:
+//
+//   thraxcompile-server --input_grammars=a.grm,b.grm [--indir=...]
+//
+// As with thraxmakedep, each FAR is written next to its grammar, since that is
+// where importing grammars look for it.
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif  // __linux__
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/compat/utils.h>
+#include <fst/arc.h>
+#include <thrax/collection-node.h>
+#include <thrax/compilation-context.h>
+#include <thrax/fst-node.h>
+#include <thrax/function-node.h>
+#include <thrax/grammar-node.h>
+#include <thrax/grm-compiler.h>
+#include <thrax/identifier-node.h>
+#include <thrax/import-node.h>
+#include <thrax/return-node.h>
+#include <thrax/rule-node.h>
+#include <thrax/statement-node.h>
+#include <thrax/string-node.h>
+#include <thrax/walker.h>
+#include <thrax/function.h>
+
+DEFINE_string(input_grammars, "",
+              "Comma-separated list of grammar files (relative to --indir) "
+              "to keep compiled");
+DEFINE_string(arc_type, "standard", "Arc type for compiled FSTs");
+DEFINE_int32(poll_interval_ms, 500,
+             "Interval between file modification checks when file system "
+             "notifications are unavailable");
+DEFINE_int32(settle_ms, 100,
+             "Quiet period after a change notification before rebuilding, so "
+             "that editors writing several files at once trigger one rebuild");
+DEFINE_int64(rebuild_cache_mb, 1024,
+             "Memory budget (in MB) for the results kept between rebuilds; 0 "
+             "recomputes every rule of a grammar that is rebuilt");
+DEFINE_bool(build_once, false,
+            "Build every out-of-date grammar once and exit instead of "
+            "watching for changes");
+
+DECLARE_string(indir);
+DECLARE_string(outdir);
+
+namespace thrax {
+namespace {
+
+// Functions whose first argument names a file that is read at compile time.
+bool ReadsFileArgument(const std::string& function_name) {
+  return function_name == "StringFile" || function_name == "SymbolTable" ||
+         function_name == "LoadFst" || function_name == "LoadFstFromFar";
+}
+
+// Collects the imports and the data files a grammar reads. Data files are only
+// found when they are given as string literals, which is how they are written
+// in practice; thraxmakedep makes the same assumption.
+class AstDependencyCollector : public AstWalker {
+ public:
+  AstDependencyCollector() {}
+
+  ~AstDependencyCollector() final {}
+
+  void Visit(CollectionNode* node) final {
+    for (int i = 0; i < node->Size(); ++i) (*node)[i]->Accept(this);
+  }
+
+  void Visit(FstNode* node) final {
+    if (node->GetType() == FstNode::FUNCTION_FSTNODE) {
+      const auto* name =
+          fst::down_cast<IdentifierNode*>(node->GetArgument(0));
+      auto* args = fst::down_cast<CollectionNode*>(node->GetArgument(1));
+      if (!name->HasNamespaces() && ReadsFileArgument(name->Get()) &&
+          args->Size() > 0) {
+        file_argument_ = true;
+        (*args)[0]->Accept(this);
+        file_argument_ = false;
+        for (int i = 1; i < args->Size(); ++i) (*args)[i]->Accept(this);
+        return;
+      }
+    }
+    for (int i = 0; i < node->NumArguments(); ++i)
+      node->GetArgument(i)->Accept(this);
+  }
+
+  void Visit(FunctionNode* node) final { node->GetBody()->Accept(this); }
+
+  void Visit(GrammarNode* node) final {
+    node->GetImports()->Accept(this);
+    node->GetFunctions()->Accept(this);
+    node->GetStatements()->Accept(this);
+  }
+
+  void Visit(IdentifierNode* node) final { file_argument_ = false; }
+
+  void Visit(ImportNode* node) final {
+    imports_.push_back(node->GetPath()->Get());
+  }
+
+  void Visit(RepetitionFstNode* node) final {
+    Visit(fst::implicit_cast<FstNode*>(node));
+  }
+
+  void Visit(ReturnNode* node) final { node->Get()->Accept(this); }
+
+  void Visit(RuleNode* node) final { node->Get()->Accept(this); }
+
+  void Visit(StatementNode* node) final { node->Get()->Accept(this); }
+
+  void Visit(StringFstNode* node) final {
+    file_argument_ = false;
+    Visit(fst::implicit_cast<FstNode*>(node));
+  }
+
+  void Visit(StringNode* node) final {
+    if (file_argument_) data_files_.insert(node->Get());
+    file_argument_ = false;
+  }
+
+  const std::vector<std::string>& imports() const { return imports_; }
+
+  const std::set<std::string>& data_files() const { return data_files_; }
+
+ private:
+  bool file_argument_ = false;
+  std::vector<std::string> imports_;
+  std::set<std::string> data_files_;
+
+  AstDependencyCollector(const AstDependencyCollector&) = delete;
+  AstDependencyCollector& operator=(const AstDependencyCollector&) = delete;
+};
+
+// One grammar in the build graph. Paths are relative to --indir, exactly as
+// they appear in import statements.
+struct Grammar {
+  std::string path;
+  std::vector<std::string> imports;
+  // Data files read by the grammar, and the stamps they had when the grammar
+  // was last built successfully. The grammar source itself is included.
+  std::map<std::string, FileStamp> inputs;
+  bool scanned = false;
+  bool built = false;
+};
+
+std::string FarPath(const std::string& grammar_path) {
+  return grammar_path.substr(0, grammar_path.length() - 3) + "far";
+}
+
+template <typename Arc>
+class CompileServer {
+ public:
+  explicit CompileServer(const std::vector<std::string>& roots)
+      : roots_(roots),
+        persistent_(FST_FLAGS_rebuild_cache_mb * 1024 * 1024) {}
+
+  // Brings every grammar up to date. Returns false if any grammar failed to
+  // compile; the ones that do not depend on the failure are still built.
+  bool Update();
+
+  // Returns true if any input changed since the last call to Update() began
+  // building.
+  bool Changed() const;
+
+  // Returns the directories containing any file we depend on.
+  std::set<std::string> WatchedDirectories() const;
+
+ private:
+  // Re-reads the imports and data files of the grammar if its source changed.
+  bool Scan(Grammar* grammar);
+
+  // Adds the grammar and its transitive imports to order_, imports first.
+  bool Visit(const std::string& path, std::set<std::string>* visiting,
+             std::set<std::string>* visited);
+
+  // Returns true if any recorded input changed since the last build.
+  bool Stale(const Grammar& grammar) const;
+
+  bool Build(Grammar* grammar);
+
+  const std::vector<std::string> roots_;
+  // The parsed grammars and cached results shared by the builds.
+  PersistentState persistent_;
+  std::map<std::string, Grammar> grammars_;
+  std::vector<std::string> order_;
+  // The stamps of all inputs as the last round of builds began.
+  std::map<std::string, FileStamp> observed_;
+
+  CompileServer(const CompileServer&) = delete;
+  CompileServer& operator=(const CompileServer&) = delete;
+};
+
+template <typename Arc>
+bool CompileServer<Arc>::Scan(Grammar* grammar) {
+  const auto source = JoinPath(FST_FLAGS_indir, grammar->path);
+  const auto stamp = StatFile(source);
+  if (grammar->scanned) {
+    const auto it = grammar->inputs.find(grammar->path);
+    if (it != grammar->inputs.end() && it->second == stamp) return true;
+  }
+  if (!stamp.exists || !Readable(source)) {
+    LOG(ERROR) << "Unable to read grammar: " << source;
+    return false;
+  }
+  // The build that follows reuses the parse.
+  const auto parser =
+      persistent_.GetOrCreate<ParsedGrammarCache<Arc>>()->Get(source);
+  if (!parser || !parser->GetAst()) {
+    LOG(ERROR) << "Unable to parse grammar: " << source;
+    return false;
+  }
+  AstDependencyCollector collector;
+  parser->GetAst()->Accept(&collector);
+  grammar->imports = collector.imports();
+  // Anything not yet built keeps the default (missing) stamp, so that Stale()
+  // reports it as changed.
+  std::map<std::string, FileStamp> inputs;
+  inputs[grammar->path] =
+      grammar->built ? grammar->inputs[grammar->path] : FileStamp();
+  for (const auto& file : collector.data_files()) {
+    const auto it = grammar->inputs.find(file);
+    inputs[file] = it == grammar->inputs.end() ? FileStamp() : it->second;
+  }
+  grammar->inputs.swap(inputs);
+  grammar->scanned = true;
+  return true;
+}
+
+template <typename Arc>
+bool CompileServer<Arc>::Visit(const std::string& path,
+                               std::set<std::string>* visiting,
+                               std::set<std::string>* visited) {
+  if (visited->count(path)) return true;
+  if (!visiting->insert(path).second) {
+    LOG(ERROR) << "Import cycle involving " << path;
+    return false;
+  }
+  auto& grammar = grammars_[path];
+  grammar.path = path;
+  if (!Scan(&grammar)) return false;
+  for (const auto& import : grammar.imports) {
+    if (!Visit(import, visiting, visited)) return false;
+  }
+  visiting->erase(path);
+  visited->insert(path);
+  order_.push_back(path);
+  return true;
+}
+
+template <typename Arc>
+bool CompileServer<Arc>::Stale(const Grammar& grammar) const {
+  if (!grammar.built) return true;
+  if (!Readable(JoinPath(FST_FLAGS_outdir, FarPath(grammar.path))))
+    return true;
+  for (const auto& input : grammar.inputs) {
+    if (StatFile(JoinPath(FST_FLAGS_indir, input.first)) != input.second)
+      return true;
+  }
+  return false;
+}
+
+template <typename Arc>
+bool CompileServer<Arc>::Build(Grammar* grammar) {
+  // Takes the stamps before compiling, so that an edit made while we compile
+  // triggers another build rather than being lost.
+  std::map<std::string, FileStamp> stamps;
+  for (const auto& input : grammar->inputs)
+    stamps[input.first] = StatFile(JoinPath(FST_FLAGS_indir, input.first));
+  const auto start = std::chrono::steady_clock::now();
+  std::cout << "Compiling " << grammar->path << std::endl;
+  auto compiler = persistent_.GetOrCreate<ParsedGrammarCache<Arc>>()->Get(
+      JoinPath(FST_FLAGS_indir, grammar->path));
+  bool success = false;
+  if (compiler) {
+    CompilationContext context(&persistent_);
+    compiler->SetContext(&context);
+    success = compiler->EvaluateAst() &&
+              compiler->GetGrmManager()->ExportFar(FarPath(grammar->path));
+    compiler->SetContext(nullptr);
+    context.Report();
+  }
+  if (!success) {
+    std::cout << "Failed to compile " << grammar->path << std::endl;
+    grammar->built = false;
+    return false;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Wrote " << FarPath(grammar->path) << " in " << elapsed.count()
+            << "s" << std::endl;
+  grammar->inputs.swap(stamps);
+  grammar->built = true;
+  return true;
+}
+
+template <typename Arc>
+bool CompileServer<Arc>::Update() {
+  // No compilation is running between rounds.
+  persistent_.GetOrCreate<ParsedGrammarCache<Arc>>()->MaybeStartGeneration();
+  order_.clear();
+  std::set<std::string> visiting;
+  std::set<std::string> visited;
+  bool success = true;
+  for (const auto& root : roots_) {
+    visiting.clear();
+    if (!Visit(root, &visiting, &visited)) success = false;
+  }
+  observed_.clear();
+  for (const auto& path : order_) {
+    for (const auto& input : grammars_[path].inputs) {
+      const auto file = JoinPath(FST_FLAGS_indir, input.first);
+      observed_[file] = StatFile(file);
+    }
+  }
+  // A grammar is rebuilt if one of its own inputs changed or if one of its
+  // imports was rebuilt (or failed) in this round; order_ lists imports before
+  // the grammars importing them.
+  std::set<std::string> rebuilt;
+  std::set<std::string> failed;
+  for (const auto& path : order_) {
+    auto& grammar = grammars_[path];
+    bool blocked = false;
+    bool dirty = Stale(grammar);
+    for (const auto& import : grammar.imports) {
+      if (failed.count(import)) blocked = true;
+      if (rebuilt.count(import)) dirty = true;
+    }
+    if (blocked) {
+      std::cout << "Skipping " << path << " since an import failed"
+                << std::endl;
+      failed.insert(path);
+      grammar.built = false;
+      success = false;
+      continue;
+    }
+    if (!dirty) continue;
+    if (Build(&grammar)) {
+      rebuilt.insert(path);
+    } else {
+      failed.insert(path);
+      success = false;
+    }
+  }
+  return success;
+}
+
+template <typename Arc>
+bool CompileServer<Arc>::Changed() const {
+  for (const auto& file : observed_) {
+    if (StatFile(file.first) != file.second) return true;
+  }
+  return false;
+}
+
+template <typename Arc>
+std::set<std::string> CompileServer<Arc>::WatchedDirectories() const {
+  std::set<std::string> dirs;
+  for (const auto& grammar : grammars_) {
+    for (const auto& input : grammar.second.inputs) {
+      const auto dir =
+          StripBasename(JoinPath(FST_FLAGS_indir, input.first));
+      dirs.insert(dir.empty() ? "." : dir);
+    }
+  }
+  return dirs;
+}
+
+#ifdef __linux__
+
+// Watches directories for changes. A single inotify instance lives as long as
+// the watcher, so that changes made while a build runs are queued rather than
+// lost.
+class DirectoryWatcher {
+ public:
+  DirectoryWatcher() : fd_(inotify_init1(IN_CLOEXEC)) {}
+
+  ~DirectoryWatcher() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  // Adds the directories not watched yet. Returns false if notifications are
+  // unavailable.
+  bool Watch(const std::set<std::string>& dirs) {
+    if (fd_ < 0) return false;
+    constexpr uint32_t kMask =
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB;
+    for (const auto& dir : dirs) {
+      if (watched_.count(dir)) continue;
+      if (inotify_add_watch(fd_, dir.c_str(), kMask) >= 0) {
+        watched_.insert(dir);
+      } else {
+        LOG(WARNING) << "Unable to watch directory: " << dir;
+      }
+    }
+    return !watched_.empty();
+  }
+
+  // Blocks until something changed in the watched directories since the last
+  // call, then waits for things to settle.
+  void Wait() {
+    char buffer[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    while (poll(&pfd, 1, -1) <= 0) {
+    }
+    // Drains events until the tree has been quiet for --settle_ms.
+    do {
+      if (read(fd_, buffer, sizeof(buffer)) < 0) break;
+    } while (poll(&pfd, 1, FST_FLAGS_settle_ms) > 0);
+  }
+
+ private:
+  const int fd_;
+  std::set<std::string> watched_;
+
+  DirectoryWatcher(const DirectoryWatcher&) = delete;
+  DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+};
+
+#endif  // __linux__
+
+template <typename Arc>
+int Serve(const std::vector<std::string>& roots) {
+  CompileServer<Arc> server(roots);
+  bool success = server.Update();
+  if (FST_FLAGS_build_once) return success ? 0 : 1;
+#ifdef __linux__
+  DirectoryWatcher watcher;
+#endif  // __linux__
+  while (true) {
+    bool notified = false;
+#ifdef __linux__
+    // Directories watched from now on do not report the changes made during
+    // the last round of builds, so we check for those before blocking.
+    if (watcher.Watch(server.WatchedDirectories())) {
+      notified = true;
+      if (!server.Changed()) {
+        std::cout << "Waiting for changes..." << std::endl;
+        watcher.Wait();
+      }
+    }
+#endif  // __linux__
+    if (!notified) {
+      std::cout << "Waiting for changes..." << std::endl;
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(FST_FLAGS_poll_interval_ms));
+    }
+    server.Update();
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace thrax
+
+int main(int argc, char **argv) {
+  std::set_new_handler(FailedNewHandler);
+  SET_FLAGS(argv[0], &argc, &argv, true);
+
+  std::vector<std::string> roots;
+  for (const auto& grammar :
+       ::fst::StringSplit(FST_FLAGS_input_grammars, ',')) {
+    if (!grammar.empty()) roots.emplace_back(grammar);
+  }
+  if (roots.empty()) LOG(FATAL) << "No grammars given in --input_grammars";
+  for (const auto& root : roots) {
+    if (::thrax::Suffix(root) != "grm")
+      LOG(FATAL) << "Grammar files should have extension .grm: " << root;
+  }
+  if (FST_FLAGS_outdir != FST_FLAGS_indir) {
+    LOG(WARNING) << "--outdir differs from --indir; grammars importing other "
+                 << "grammars will not find the FARs written here";
+  }
+
+  thrax::function::RegisterFunctions();
+  if (FST_FLAGS_arc_type == "standard") {
+    return ::thrax::Serve<::fst::StdArc>(roots);
+  } else if (FST_FLAGS_arc_type == "log") {
+    return ::thrax::Serve<::fst::LogArc>(roots);
+  } else if (FST_FLAGS_arc_type == "log64") {
+    return ::thrax::Serve<::fst::Log64Arc>(roots);
+  } else {
+    LOG(FATAL) << "Unsupported arc type: " << FST_FLAGS_arc_type;
+  }
+  return 1;
+}
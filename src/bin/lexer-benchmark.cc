@@ -0,0 +1,91 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Times the lexer on a grammar file, or on a generated grammar, printing the
+// number of tokens and bytes scanned and the time it took. It only uses the
+// interface the lexer has always had, so it can also be built against earlier
+// versions of the lexer for comparison.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/compat/utils.h>
+#include <thrax/lexer.h>
+
+using ::thrax::Lexer;
+using ::thrax::ReadFileToStringOrDie;
+
+DEFINE_string(grammar, "", "Path to the grammar to scan");
+DEFINE_int64(num_rules, 200000,
+             "Without --grammar, the number of rules in the generated grammar");
+DEFINE_int32(repeat, 3, "Number of runs; the fastest is reported");
+
+namespace {
+
+// Returns a grammar with the usual mix of tokens: identifiers, keywords,
+// quoted strings with and without escapes, numbers, weights and connectors.
+std::string GenerateGrammar(int64_t num_rules) {
+  std::string grammar = "import 'byte.grm' as b;\n\n";
+  for (int64_t i = 0; i < num_rules; ++i) {
+    const std::string n = std::to_string(i);
+    grammar += "# Rule " + n + ".\n";
+    grammar += "rule_" + n + " = Optimize[(\"word" + n + "\" | \"x\\[y" + n +
+               "\\]\" | b.kDigit+) @ CDRewrite['a' : 'b', \"\", \"\", " +
+               "b.kBytes*]] <cost=" + std::to_string(i % 10) + ".5>;\n";
+    grammar += "export out_" + n + " = rule_" + n + "{1," +
+               std::to_string(i % 5 + 1) + "} - \"" + n + "\";\n";
+  }
+  return grammar;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::set_new_handler(FailedNewHandler);
+  SET_FLAGS(argv[0], &argc, &argv, true);
+
+  std::string grammar;
+  if (FST_FLAGS_grammar.empty()) {
+    grammar = GenerateGrammar(FST_FLAGS_num_rules);
+  } else {
+    ReadFileToStringOrDie(FST_FLAGS_grammar, &grammar);
+    // The parser needs a final newline, so GrmCompilerSpec adds one.
+    grammar += "\n";
+  }
+  double best = -1;
+  int64_t num_tokens = 0;
+  int64_t token_bytes = 0;
+  for (int i = 0; i < FST_FLAGS_repeat; ++i) {
+    num_tokens = 0;
+    token_bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    Lexer lexer;
+    lexer.ScanString(grammar);
+    while (lexer.YYLex() != Lexer::EOS) {
+      ++num_tokens;
+      token_bytes += lexer.YYString().size();
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    if (best < 0 || seconds < best) best = seconds;
+  }
+  std::cout << grammar.size() << " bytes, " << num_tokens << " tokens ("
+            << token_bytes << " bytes) in " << best << "s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compares the Optimize strategies for FSTs with weighted cycles, printing the
+// size of each result and the time it took.
+//
+// With --far (e.g., a FAR compiled from the grammars in src/grammars), each
+// exported FST is unioned with itself, which undoes its determinization, and
+// then re-optimized. Otherwise the input is the closure of a generated weighted
+// lexicon transducer.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/compat/utils.h>
+#include <fst/extensions/far/far.h>
+#include <fst/arc.h>
+#include <fst/fst.h>
+#include <fst/union.h>
+#include <fst/vector-fst.h>
+#include <thrax/algo/optimize.h>
+
+using ::fst::FarReader;
+using ::fst::OptimizeStrategy;
+using ::fst::StdArc;
+using ::fst::StdVectorFst;
+
+DEFINE_string(far, "", "Path to a FAR whose FSTs are re-optimized");
+DEFINE_int64(num_entries, 100000,
+             "Without --far, the number of entries in the generated lexicon");
+DEFINE_int32(seed, 1, "Without --far, the seed of the generated lexicon");
+DEFINE_int32(repeat, 3, "Number of runs per strategy; the fastest is reported");
+
+namespace {
+
+// Returns the closure of a transducer from random lower-case words to random
+// words, each with a random weight, as a rewrite rule over a lexicon would be.
+StdVectorFst GenerateLexicon(int64_t num_entries, int seed) {
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> length(1, 8);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::uniform_int_distribution<int> weight(0, 9);
+  StdVectorFst fst;
+  const auto start = fst.AddState();
+  fst.SetStart(start);
+  fst.SetFinal(start, StdArc::Weight::One());
+  for (int64_t i = 0; i < num_entries; ++i) {
+    const int input_length = length(random);
+    const int output_length = length(random);
+    auto state = start;
+    for (int j = 0; j < std::max(input_length, output_length); ++j) {
+      const auto next = fst.AddState();
+      const int ilabel = j < input_length ? letter(random) : 0;
+      const int olabel = j < output_length ? letter(random) : 0;
+      const float w = j == 0 ? weight(random) : 0;
+      fst.AddArc(state, StdArc(ilabel, olabel, w, next));
+      state = next;
+    }
+    fst.AddArc(state, StdArc(0, 0, StdArc::Weight::One(), start));
+  }
+  return fst;
+}
+
+int64_t NumArcs(const StdVectorFst& fst) {
+  int64_t num_arcs = 0;
+  for (StdArc::StateId s = 0; s < fst.NumStates(); ++s)
+    num_arcs += fst.NumArcs(s);
+  return num_arcs;
+}
+
+void Benchmark(const std::string& name, const StdVectorFst& fst) {
+  std::cout << name << ": " << fst.NumStates() << " states, " << NumArcs(fst)
+            << " arcs" << std::endl;
+  static const std::pair<const char*, OptimizeStrategy> kStrategies[] = {
+      {"encode", ::fst::OPTIMIZE_ENCODE_WEIGHTS},
+      {"push", ::fst::OPTIMIZE_PUSH_WEIGHTS},
+  };
+  for (const auto& [strategy_name, strategy] : kStrategies) {
+    double best = -1;
+    StdVectorFst output;
+    for (int i = 0; i < FST_FLAGS_repeat; ++i) {
+      output = fst;
+      const auto start = std::chrono::steady_clock::now();
+      ::fst::Optimize(&output, false, -1, strategy);
+      const double seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+      if (best < 0 || seconds < best) best = seconds;
+    }
+    std::cout << "  " << strategy_name << ": " << output.NumStates()
+              << " states, " << NumArcs(output) << " arcs in " << best << "s"
+              << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::set_new_handler(FailedNewHandler);
+  SET_FLAGS(argv[0], &argc, &argv, true);
+
+  if (FST_FLAGS_far.empty()) {
+    Benchmark("lexicon",
+              GenerateLexicon(FST_FLAGS_num_entries, FST_FLAGS_seed));
+    return 0;
+  }
+  std::unique_ptr<FarReader<StdArc>> reader(
+      FarReader<StdArc>::Open(FST_FLAGS_far));
+  if (!reader) {
+    LOG(ERROR) << "Unable to open FAR: " << FST_FLAGS_far;
+    return 1;
+  }
+  for (; !reader->Done(); reader->Next()) {
+    StdVectorFst fst(*reader->GetFst());
+    ::fst::Union(&fst, StdVectorFst(fst));
+    Benchmark(reader->GetKey(), fst);
+  }
+  return 0;
+}
@@ -0,0 +1,151 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compares the prefix trees with which StringFile[] and string unions are
+// compiled, on a generated lexicon, printing the size of each result and the
+// time it took to add the entries and write the FST.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/compat/utils.h>
+#include <fst/arc.h>
+#include <fst/vector-fst.h>
+#include <thrax/algo/flat_prefix_tree.h>
+#include <thrax/algo/prefix_tree.h>
+#include <thrax/algo/sorted_prefix_tree.h>
+
+using ::fst::AcceptorPrefixTree;
+using ::fst::FlatAcceptorPrefixTree;
+using ::fst::FlatTransducerPrefixTree;
+using ::fst::SortedAcceptorPrefixTree;
+using ::fst::SortedTransducerPrefixTree;
+using ::fst::StdArc;
+using ::fst::StdVectorFst;
+using ::fst::TransducerPrefixTree;
+
+DEFINE_int64(num_entries, 2000000, "Number of entries in the lexicon");
+DEFINE_bool(transducer, false,
+            "Map each word to an analysis, rather than accepting the words");
+DEFINE_bool(sorted, true, "Add the entries in sorted order");
+DEFINE_int32(seed, 1, "Seed of the generated lexicon");
+DEFINE_int32(repeat, 1, "Number of runs per tree; the fastest is reported");
+
+namespace {
+
+using Label = StdArc::Label;
+
+struct Entry {
+  std::vector<Label> ilabels;
+  std::vector<Label> olabels;
+  StdArc::Weight weight;
+};
+
+// Returns random lower-case words, each with a weight and, for transducers, an
+// analysis made of a prefix of the word and one of a few tags. The entries
+// are sorted by their input and output labels if requested.
+std::vector<Entry> GenerateLexicon(int64_t num_entries, bool transducer,
+                                   bool sorted, int seed) {
+  static const std::vector<std::string> kTags = {"+N+Sg", "+N+Pl", "+V+Inf",
+                                                 "+V+Past", "+Adj"};
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> length(3, 12);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::uniform_int_distribution<int> weight(0, 9);
+  std::uniform_int_distribution<size_t> tag(0, kTags.size() - 1);
+  std::vector<Entry> entries(num_entries);
+  for (auto& entry : entries) {
+    const int word_length = length(random);
+    for (int i = 0; i < word_length; ++i)
+      entry.ilabels.push_back(letter(random));
+    if (transducer) {
+      entry.olabels.assign(entry.ilabels.begin(),
+                           entry.ilabels.end() - word_length / 3);
+      for (const char c : kTags[tag(random)]) entry.olabels.push_back(c);
+    } else {
+      entry.olabels = entry.ilabels;
+    }
+    entry.weight = weight(random);
+  }
+  if (sorted) {
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) {
+                if (a.ilabels != b.ilabels) return a.ilabels < b.ilabels;
+                return a.olabels < b.olabels;
+              });
+  }
+  return entries;
+}
+
+int64_t NumArcs(const StdVectorFst& fst) {
+  int64_t num_arcs = 0;
+  for (StdArc::StateId s = 0; s < fst.NumStates(); ++s)
+    num_arcs += fst.NumArcs(s);
+  return num_arcs;
+}
+
+template <class PTree>
+void Benchmark(const std::string& name, const std::vector<Entry>& entries) {
+  double best = -1;
+  StdVectorFst fst;
+  for (int i = 0; i < FST_FLAGS_repeat; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    {
+      PTree tree;
+      for (const auto& entry : entries) {
+        tree.Add(entry.ilabels.begin(), entry.ilabels.end(),
+                 entry.olabels.begin(), entry.olabels.end(), entry.weight);
+      }
+      fst.DeleteStates();
+      tree.ToFst(&fst);
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    if (best < 0 || seconds < best) best = seconds;
+  }
+  std::cout << name << ": " << fst.NumStates() << " states, " << NumArcs(fst)
+            << " arcs in " << best << "s" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::set_new_handler(FailedNewHandler);
+  SET_FLAGS(argv[0], &argc, &argv, true);
+
+  const auto entries =
+      GenerateLexicon(FST_FLAGS_num_entries, FST_FLAGS_transducer,
+                      FST_FLAGS_sorted, FST_FLAGS_seed);
+  std::cout << entries.size() << (FST_FLAGS_sorted ? " sorted" : " unsorted")
+            << (FST_FLAGS_transducer ? " transducer" : " acceptor")
+            << " entries" << std::endl;
+  if (FST_FLAGS_transducer) {
+    Benchmark<TransducerPrefixTree<StdArc>>("PrefixTree", entries);
+    Benchmark<FlatTransducerPrefixTree<StdArc>>("FlatPrefixTree", entries);
+    Benchmark<SortedTransducerPrefixTree<StdArc>>("SortedPrefixTree", entries);
+  } else {
+    Benchmark<AcceptorPrefixTree<StdArc>>("PrefixTree", entries);
+    Benchmark<FlatAcceptorPrefixTree<StdArc>>("FlatPrefixTree", entries);
+    Benchmark<SortedAcceptorPrefixTree<StdArc>>("SortedPrefixTree", entries);
+  }
+  return 0;
+}
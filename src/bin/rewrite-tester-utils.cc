@@ -117,19 +117,19 @@ void RewriteTesterUtils::Initialize() {
       LOG(FATAL) << "grm.GetFst() must be non nullptr for rule: "
                  << triple.main_rule;
     }
-    StdVectorFst vfst(*fst);
     // If the input transducers in the FAR have symbol tables then we need to
     // add the appropriate symbol table(s) to the input strings, according to
-    // the parse mode.
-    if (vfst.InputSymbols()) {
+    // the parse mode. They are read off the FST as it is, since rules applied
+    // lazily are not to be expanded.
+    if (fst->InputSymbols()) {
       if (!byte_symtab_ &&
-          vfst.InputSymbols()->Name() ==
+          fst->InputSymbols()->Name() ==
               ::thrax::function::kByteSymbolTableName) {
-        byte_symtab_ = fst::WrapUnique(vfst.InputSymbols()->Copy());
+        byte_symtab_ = fst::WrapUnique(fst->InputSymbols()->Copy());
       } else if (!utf8_symtab_ &&
-                 vfst.InputSymbols()->Name() ==
+                 fst->InputSymbols()->Name() ==
                      ::thrax::function::kUtf8SymbolTableName) {
-        utf8_symtab_ = fst::WrapUnique(vfst.InputSymbols()->Copy());
+        utf8_symtab_ = fst::WrapUnique(fst->InputSymbols()->Copy());
       }
     }
     if (!triple.pdt_parens_rule.empty()) {
@@ -19,6 +19,7 @@
 #ifndef NLP_GRM_LANGUAGE_ABSTRACT_GRM_MANAGER_H_
 #define NLP_GRM_LANGUAGE_ABSTRACT_GRM_MANAGER_H_
 
+#include <cstdlib>
 #include <map>
 #include <memory>
 #include <string>
@@ -36,11 +37,16 @@
 #include <fst/fstlib.h>
 #include <fst/string.h>
 #include <fst/vector-fst.h>
+#include <thrax/algo/composecascade.h>
 #include <thrax/make-parens-pair-vector.h>
 #include <unordered_map>
 
 namespace thrax {
 
+// In an archive, a rule held as a delayed composition (see ComposeCascadeFst)
+// is stored as its components, the i-th under the key "*Cascade:<rule>:<i>".
+static const char kCascadeComponentPrefix[] = "*Cascade:";
+
 template <typename Arc>
 class AbstractGrmManager {
  public:
@@ -118,16 +124,21 @@ class AbstractGrmManager {
   bool SetFst(const std::string& name, const Transducer& input);
 
   // This function will write the created FSTs into an FST archive with the
-  // provided filename.
-  virtual void ExportFar(const std::string& filename) const = 0;
+  // provided filename. Returns true on success and false otherwise.
+  virtual bool ExportFar(const std::string& filename) const = 0;
 
-  // Sorts input labels of all FSTs in the archive.
+  // Sorts input labels of all FSTs in the archive. Delayed FSTs are left as
+  // they are, since sorting would expand them.
   void SortRuleInputLabels();
 
   // Alternative to LoadArchive, allowing you to provide the FSTs and keys
   // directly.
   void LoadFstMap(FstMap named_fsts);
 
+  // Turns the components read from an archive back into the delayed
+  // compositions they were taken from.
+  static void AssembleCascades(FstMap* fsts);
+
  protected:
   AbstractGrmManager();
 
@@ -136,6 +147,10 @@ class AbstractGrmManager {
   template <typename FarReader>
   bool LoadArchive(FarReader *reader);
 
+  // Returns the FSTs to write to an archive, by key: those held, with each
+  // delayed composition replaced by its components.
+  std::map<std::string, const Transducer*> GetArchiveFsts() const;
+
   // The list of FSTs held by this manager.
   FstMap fsts_;
 
@@ -160,6 +175,7 @@ bool AbstractGrmManager<Arc>::LoadArchive(FarReader *reader) {
     fsts_[name] = std::make_unique<MutableTransducer>(*reader->GetFst());
   }
   SortRuleInputLabels();
+  AssembleCascades(&fsts_);
   return true;
 }
 
@@ -170,12 +186,74 @@ void AbstractGrmManager<Arc>::LoadFstMap(FstMap named_fsts) {
   }
   fsts_ = std::move(named_fsts);
   SortRuleInputLabels();
+  AssembleCascades(&fsts_);
+}
+
+template <typename Arc>
+std::map<std::string, const typename AbstractGrmManager<Arc>::Transducer*>
+AbstractGrmManager<Arc>::GetArchiveFsts() const {
+  std::map<std::string, const Transducer*> archive_fsts;
+  for (const auto& pair : fsts_) {
+    const auto* cascade =
+        dynamic_cast<const ::fst::ComposeCascadeFst<Arc>*>(pair.second.get());
+    if (!cascade) {
+      archive_fsts[pair.first] = pair.second.get();
+      continue;
+    }
+    const auto& components = cascade->GetComponents();
+    for (size_t i = 0; i < components.size(); ++i) {
+      archive_fsts[::fst::StrCat(kCascadeComponentPrefix, pair.first, ":",
+                                 i)] = components[i].get();
+    }
+  }
+  return archive_fsts;
+}
+
+template <typename Arc>
+void AbstractGrmManager<Arc>::AssembleCascades(FstMap* fsts) {
+  static const size_t kPrefixSize = sizeof(kCascadeComponentPrefix) - 1;
+  // The components of each rule, by index.
+  std::map<std::string, std::map<int, std::shared_ptr<const Transducer>>>
+      cascades;
+  for (auto it = fsts->begin(); it != fsts->end();) {
+    const auto& key = it->first;
+    const auto colon = key.rfind(':');
+    if (key.compare(0, kPrefixSize, kCascadeComponentPrefix) != 0 ||
+        colon < kPrefixSize) {
+      ++it;
+      continue;
+    }
+    const int index = std::atoi(key.c_str() + colon + 1);
+    cascades[key.substr(kPrefixSize, colon - kPrefixSize)][index] =
+        std::move(it->second);
+    it = fsts->erase(it);
+  }
+  static const ::fst::ILabelCompare<Arc> icomp;
+  for (auto& pair : cascades) {
+    typename ::fst::ComposeCascadeFst<Arc>::Components components;
+    for (auto& component : pair.second) {
+      if (component.second->Properties(::fst::kILabelSorted, false) !=
+          ::fst::kILabelSorted) {
+        auto sorted = std::make_shared<MutableTransducer>(*component.second);
+        ::fst::ArcSort(sorted.get(), icomp);
+        component.second = std::move(sorted);
+      }
+      components.push_back(std::move(component.second));
+    }
+    if (components.size() == 1) {
+      (*fsts)[pair.first] = fst::WrapUnique(components.front()->Copy());
+    } else {
+      (*fsts)[pair.first] = std::make_unique<::fst::ComposeCascadeFst<Arc>>(
+          std::move(components));
+    }
+  }
 }
 
 template <typename Arc>
 void AbstractGrmManager<Arc>::SortRuleInputLabels() {
   for (auto &pair : fsts_) {
     const auto& fst = *pair.second;
+    if (!fst.Properties(::fst::kExpanded, false)) continue;
     // Arc-sorts if the FST is not known to be input-sorted.
     if (fst.Properties(::fst::kILabelSorted, false) !=
         ::fst::kILabelSorted) {
@@ -22,7 +22,15 @@
 // Mohri, M., and Sproat, R. 1996. An efficient compiler for weighted rewrite
 // rules. In Proc. ACL, pages 231-238.
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -32,6 +40,7 @@
 #include <fst/closure.h>
 #include <fst/compose.h>
 #include <fst/concat.h>
+#include <fst/connect.h>
 #include <fst/determinize.h>
 #include <fst/fst.h>
 #include <fst/minimize.h>
@@ -42,6 +51,7 @@
 #include <fst/vector-fst.h>
 #include <thrax/algo/checkprops.h>
 #include <thrax/algo/cross.h>
+#include <thrax/algo/fingerprint.h>
 #include <thrax/algo/optimize.h>
 
 namespace fst {
@@ -50,8 +60,106 @@ enum CDRewriteDirection { LEFT_TO_RIGHT, RIGHT_TO_LEFT, SIMULTANEOUS };
 
 enum CDRewriteMode { OBLIGATORY, OPTIONAL };
 
+// Holds the machines that CDRewriteRule::Compile builds from sigma and the
+// contexts (the filters, the replace transducer and the boundary inserter and
+// deleter), keyed by everything they are built from: an input FST (a context or
+// the rewrite; empty for the boundary machines), sigma and a few further
+// parameters such as the kind of machine and the markers. Rules compiled with
+// the same cache which share a sigma, a context or a rewrite thus only build
+// these once.
+//
+// Entries are found by a fingerprint of the inputs, but each entry keeps copies
+// of its inputs, and a hit is only taken once they have been compared in full,
+// so a fingerprint collision cannot substitute one machine for another.
+//
+// This class is thread-safe: the cached FSTs are copied in and out in full, so
+// that rules compiled concurrently never share them.
+template <class Arc>
+class CDRewriteCache {
+ public:
+  CDRewriteCache() {}
+
+  // Copies the FST cached for the inputs into *fst, returning false if there is
+  // none.
+  bool Find(const Fst<Arc> &input, const Fst<Arc> &sigma,
+            const std::vector<int64_t> &params, VectorFst<Arc> *fst) const {
+    const auto key = Key(input, sigma, params);
+    std::shared_ptr<const Entry> entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = entries_.find(key);
+      if (it == entries_.end()) return false;
+      entry = it->second;
+    }
+    if (entry->params != params || !FstIdentical(entry->input, input) ||
+        !FstIdentical(entry->sigma, sigma)) {
+      return false;
+    }
+    *fst = VectorFst<Arc>(static_cast<const Fst<Arc> &>(entry->fst));
+    return true;
+  }
+
+  // Caches the FST built from the inputs, unless it is in error. On a
+  // fingerprint collision, the entry already there is kept.
+  void Insert(const Fst<Arc> &input, const Fst<Arc> &sigma,
+              const std::vector<int64_t> &params, const VectorFst<Arc> &fst) {
+    if (fst.Properties(kError, false)) return;
+    auto entry = std::make_shared<Entry>(input, sigma, params, fst);
+    const auto key = Key(input, sigma, params);
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.emplace(key, std::move(entry));
+  }
+
+ private:
+  struct Entry {
+    Entry(const Fst<Arc> &input, const Fst<Arc> &sigma,
+          const std::vector<int64_t> &params, const VectorFst<Arc> &fst)
+        : input(input),
+          sigma(sigma),
+          params(params),
+          fst(static_cast<const Fst<Arc> &>(fst)) {}
+
+    const VectorFst<Arc> input;
+    const VectorFst<Arc> sigma;
+    const std::vector<int64_t> params;
+    const VectorFst<Arc> fst;
+  };
+
+  static uint64_t Key(const Fst<Arc> &input, const Fst<Arc> &sigma,
+                      const std::vector<int64_t> &params) {
+    auto key = FingerprintCombine(FstFingerprint(input), FstFingerprint(sigma));
+    for (const auto param : params) key = FingerprintCombine(key, param);
+    return key;
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_map<uint64_t, std::shared_ptr<const Entry>> entries_;
+
+  CDRewriteCache(const CDRewriteCache &) = delete;
+  CDRewriteCache &operator=(const CDRewriteCache &) = delete;
+};
+
 namespace internal {
 
+// Calls task(i) for each i in [0, n). If num_threads is greater than one, the
+// calls are spread over that many threads, each taking the next index once it
+// is done with the last; otherwise they are made in order on this thread.
+template <class Task>
+void ParallelFor(size_t n, int num_threads, const Task &task) {
+  if (num_threads <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; ++i) task(i);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < std::min<size_t>(num_threads, n); ++i) {
+    threads.emplace_back([&] {
+      for (auto j = next++; j < n; j = next++) task(j);
+    });
+  }
+  for (auto &thread : threads) thread.join();
+}
+
 // This class is used to represent context-dependent rewrite rules. A given rule
 // can be compile into a weighted transducer using different parameters
 // (direction, mode, alphabet) by calling Compile. See comments before
@@ -82,6 +190,8 @@ class CDRewriteRule {
         lambda_(lambda.Copy()),
         rho_(rho.Copy()),
         phiXpsi_(phiXpsi),
+        cache_(nullptr),
+        direct_(true),
         initial_boundary_marker_(initial_boundary_marker),
         final_boundary_marker_(final_boundary_marker) {}
 
@@ -93,13 +203,54 @@ class CDRewriteRule {
   //
   // The error bit on the output FST is set if any argument does not satisfy the
   // preconditions.
+  //
+  // If a cache is provided, the machines built along the way are looked up
+  // in it, and added to it. If num_threads is greater than one, the filters
+  // and the replace transducer are built, and then composed, on up to that
+  // many threads.
   void Compile(const Fst<Arc> &sigma, MutableFst<Arc> *fst,
                CDRewriteDirection dir = LEFT_TO_RIGHT,
-               CDRewriteMode mode = OBLIGATORY);
+               CDRewriteMode mode = OBLIGATORY,
+               CDRewriteCache<Arc> *cache = nullptr, int num_threads = 1);
+
+  // Builds the machines whose composition, in order, is the transducer that
+  // Compile builds, but does not compose them. If the rule is built directly
+  // (see CompileSingleSymbolRule), or an argument does not satisfy the
+  // preconditions, there is just one machine: the transducer, or an FST with
+  // the error bit set.
+  void CompileComponents(const Fst<Arc> &sigma,
+                         std::vector<VectorFst<Arc>> *components,
+                         CDRewriteDirection dir = LEFT_TO_RIGHT,
+                         CDRewriteMode mode = OBLIGATORY,
+                         CDRewriteCache<Arc> *cache = nullptr,
+                         int num_threads = 1);
+
+  // Whether restricted rules may be built directly (see
+  // CompileSingleSymbolRule), which gives the same transducer as the general
+  // construction; true by default.
+  void SetDirectConstruction(bool direct) { direct_ = direct; }
 
  private:
   enum MarkerType { MARK = 1, CHECK = 2, CHECK_COMPLEMENT = 3};
 
+  // Distinguishes the kinds of machines in the cache.
+  enum CacheTag : int64_t {
+    FILTER = 1,
+    REPLACE = 2,
+    BOUNDARY_INSERTER = 3,
+    BOUNDARY_DELETER = 4
+  };
+
+  // Returns the parameters, besides the input FST and sigma, which a boundary
+  // machine of the given kind is built from.
+  std::vector<int64_t> BoundaryCacheParams(
+      CacheTag tag, bool add_initial_boundary_marker,
+      bool add_final_boundary_marker) const {
+    return {tag,
+            add_initial_boundary_marker ? initial_boundary_marker_ : kNoLabel,
+            add_final_boundary_marker ? final_boundary_marker_ : kNoLabel};
+  }
+
   void MakeMarker(VectorFst<StdArc> *fst, const VectorFst<StdArc> &sigma,
                   MarkerType type,
                   const std::vector<std::pair<Label, Label>> &markers);
@@ -116,15 +267,43 @@ class CDRewriteRule {
   void PrependMarkers(MutableFst<Arc> *fst,
                       const std::vector<std::pair<Label, Label>> &markers);
 
+  // Builds the filter through BuildFilter, unless it is cached.
   void MakeFilter(const Fst<Arc> &beta, const Fst<Arc> &sigma,
-                  MutableFst<Arc> *filter, MarkerType type,
+                  VectorFst<Arc> *filter, MarkerType type,
                   const std::vector<std::pair<Label, Label>> &markers,
                   bool reverse);
 
+  void BuildFilter(const Fst<Arc> &beta, const Fst<Arc> &sigma,
+                   MutableFst<Arc> *filter, MarkerType type,
+                   const std::vector<std::pair<Label, Label>> &markers,
+                   bool reverse);
+
+  // Builds the replace transducer through MakeReplace, unless it is cached.
+  void MakeCachedReplace(VectorFst<Arc> *fst, const Fst<Arc> &sigma);
+
   void MakeReplace(MutableFst<Arc> *fst, const Fst<Arc> &sigma);
 
+  // If every string the acceptor accepts is a single (non-epsilon) symbol,
+  // adds these to *labels and returns true.
+  static bool GetSingleSymbols(const Fst<Arc> &fst, std::set<Label> *labels);
+
+  // Directly builds the rule transducer, given phi X psi as tau, when sigma is
+  // the closure of a set of single symbols, phi is a set of single symbols,
+  // and each context is either unrestricted (accepts the empty string) or a
+  // set of single symbols. Returns false if the rule is not of this form.
+  bool CompileSingleSymbolRule(const Fst<Arc> &sigma, const Fst<Arc> &tau,
+                               MutableFst<Arc> *fst);
+
   static Label MaxLabel(const Fst<Arc> &fst);
 
+  // Composes the machines in order into *fst, pairing up neighbours and
+  // composing the pairs until one machine is left, so that each composition
+  // is between machines built from a similar number of others. The
+  // compositions of a round are independent and run on up to num_threads
+  // threads. The machines are consumed.
+  static void ComposeBalanced(std::vector<VectorFst<Arc>> *machines,
+                              MutableFst<Arc> *fst, int num_threads);
+
   // Constructs transducer that either inserts or deletes boundary markers.
   void HandleBoundaryMarkers(const Fst<Arc> &sigma, VectorFst<Arc> *final_fst,
                              bool del, bool add_initial_boundary_marker,
@@ -150,6 +329,8 @@ class CDRewriteRule {
   const bool phiXpsi_;
   CDRewriteDirection dir_;
   CDRewriteMode mode_;
+  CDRewriteCache<Arc> *cache_;
+  bool direct_;
 
   // The following labels are used to represent the symbols: <_1, <_2 and > in
   // Mohri and Sproat. For instance, for left-to-right obligatory rules, <_1 is
@@ -324,6 +505,26 @@ void CDRewriteRule<Arc>::PrependMarkers(
   }
 }
 
+// Looks the filter up in the cache, if any, before building it.
+template <class Arc>
+void CDRewriteRule<Arc>::MakeFilter(
+    const Fst<Arc> &beta, const Fst<Arc> &sigma, VectorFst<Arc> *filter,
+    MarkerType type, const std::vector<std::pair<Label, Label>> &markers,
+    bool reverse) {
+  if (!cache_) {
+    BuildFilter(beta, sigma, filter, type, markers, reverse);
+    return;
+  }
+  std::vector<int64_t> params = {FILTER, type, reverse};
+  for (const auto &marker : markers) {
+    params.push_back(marker.first);
+    params.push_back(marker.second);
+  }
+  if (cache_->Find(beta, sigma, params, filter)) return;
+  BuildFilter(beta, sigma, filter, type, markers, reverse);
+  cache_->Insert(beta, sigma, params, *filter);
+}
+
 //
 // Creates the marker transducer of the specified type for the markers defined
 // in the markers argument for the regular expression sigma^* beta. When
@@ -336,7 +537,7 @@ void CDRewriteRule<Arc>::PrependMarkers(
 // unweighted acceptors. Ideally this would be in the boolean, but we simulate
 // it with the tropical.
 template <class Arc>
-void CDRewriteRule<Arc>::MakeFilter(
+void CDRewriteRule<Arc>::BuildFilter(
     const Fst<Arc> &beta, const Fst<Arc> &sigma, MutableFst<Arc> *filter,
     MarkerType type, const std::vector<std::pair<Label, Label>> &markers,
     bool reverse) {
@@ -372,6 +573,22 @@ void CDRewriteRule<Arc>::MakeFilter(
   ArcMap(ufilter, filter, rmweight);
 }
 
+// The replace transducer also depends on the direction and mode, and on the
+// marker labels, which are derived from sigma.
+template <class Arc>
+void CDRewriteRule<Arc>::MakeCachedReplace(VectorFst<Arc> *fst,
+                                           const Fst<Arc> &sigma) {
+  if (!cache_) {
+    MakeReplace(fst, sigma);
+    return;
+  }
+  const std::vector<int64_t> params = {REPLACE, dir_, mode_};
+  const VectorFst<Arc> input(*fst);
+  if (cache_->Find(input, sigma, params, fst)) return;
+  MakeReplace(fst, sigma);
+  cache_->Insert(input, sigma, params, *fst);
+}
+
 // Turns the FST representing phi X psi into a "replace" transducer.
 template <class Arc>
 void CDRewriteRule<Arc>::MakeReplace(MutableFst<Arc> *fst,
@@ -474,6 +691,186 @@ typename Arc::Label CDRewriteRule<Arc>::MaxLabel(const Fst<Arc> &fst) {
   return max;
 }
 
+template <class Arc>
+void CDRewriteRule<Arc>::ComposeBalanced(std::vector<VectorFst<Arc>> *machines,
+                                         MutableFst<Arc> *fst,
+                                         int num_threads) {
+  static const ILabelCompare<Arc> icomp;
+  while (machines->size() > 1) {
+    std::vector<VectorFst<Arc>> composed((machines->size() + 1) / 2);
+    ParallelFor(machines->size() / 2, num_threads, [&](size_t i) {
+      auto &left = (*machines)[2 * i];
+      auto &right = (*machines)[2 * i + 1];
+      if (!right.Properties(kILabelSorted, false)) ArcSort(&right, icomp);
+      Compose(left, right, &composed[i]);
+      left = VectorFst<Arc>();
+      right = VectorFst<Arc>();
+    });
+    if (machines->size() % 2) composed.back() = machines->back();
+    machines->swap(composed);
+  }
+  *fst = machines->front();
+}
+
+template <class Arc>
+bool CDRewriteRule<Arc>::GetSingleSymbols(const Fst<Arc> &fst,
+                                          std::set<Label> *labels) {
+  const auto start = fst.Start();
+  if (start == kNoStateId || fst.Final(start) != Weight::Zero()) return false;
+  for (ArcIterator<Fst<Arc>> aiter(fst, start); !aiter.Done(); aiter.Next()) {
+    const auto &arc = aiter.Value();
+    if (arc.ilabel == 0 || arc.ilabel != arc.olabel) return false;
+    if (fst.Final(arc.nextstate) == Weight::Zero()) return false;
+    if (fst.NumArcs(arc.nextstate) != 0) return false;
+    labels->insert(arc.ilabel);
+  }
+  return true;
+}
+
+// Since each occurrence of phi is a single symbol, occurrences cannot overlap.
+// Where both contexts are unrestricted, the rule thus rewrites each symbol
+// independently, and the result is the closure of the rewrites of phi and the
+// identity on the rest of sigma (or all of it, if optional). Restricted
+// contexts are tracked by the states, which record whether the last symbol was
+// in the left context, and what the next one must be: in the right context,
+// after a rewrite, or not in it, after an occurrence of phi which obligatory
+// rules leave unchanged. This requires the contexts to read the same on both
+// sides of the rewrite, for which they must not contain the symbols of phi or
+// its rewrites, and no rewrite may delete phi. The rewrites must also stay
+// within sigma; given all that, the direction does not matter.
+template <class Arc>
+bool CDRewriteRule<Arc>::CompileSingleSymbolRule(const Fst<Arc> &sigma,
+                                                 const Fst<Arc> &tau,
+                                                 MutableFst<Arc> *fst) {
+  const auto sigma_start = sigma.Start();
+  if (sigma_start == kNoStateId) return false;
+  if (sigma.Final(sigma_start) == Weight::Zero()) return false;
+  std::set<Label> sigma_labels;
+  for (ArcIterator<Fst<Arc>> aiter(sigma, sigma_start); !aiter.Done();
+       aiter.Next()) {
+    const auto &arc = aiter.Value();
+    if (arc.ilabel == 0 || arc.nextstate != sigma_start) return false;
+    sigma_labels.insert(arc.ilabel);
+  }
+  std::set<Label> phi_labels;
+  if (!GetSingleSymbols(*phi_, &phi_labels)) return false;
+  const bool any_left = lambda_->Start() != kNoStateId &&
+                        lambda_->Final(lambda_->Start()) != Weight::Zero();
+  const bool any_right = rho_->Start() != kNoStateId &&
+                         rho_->Final(rho_->Start()) != Weight::Zero();
+  std::set<Label> left_labels;
+  std::set<Label> right_labels;
+  if (!any_left && !GetSingleSymbols(*lambda_, &left_labels)) return false;
+  if (!any_right && !GetSingleSymbols(*rho_, &right_labels)) return false;
+  // Restricts tau to the phi symbols in sigma.
+  VectorFst<Arc> rewrite;
+  {
+    VectorFst<Arc> domain;
+    const auto start = domain.AddState();
+    const auto final = domain.AddState();
+    domain.SetStart(start);
+    domain.SetFinal(final, Weight::One());
+    for (const auto label : phi_labels) {
+      if (sigma_labels.count(label)) {
+        domain.AddArc(start, Arc(label, label, Weight::One(), final));
+      }
+    }
+    VectorFst<Arc> sorted_tau(tau);
+    ArcSort(&sorted_tau, ILabelCompare<Arc>());
+    Compose(domain, sorted_tau, &rewrite);
+    Connect(&rewrite);
+  }
+  if (rewrite.Properties(kError, false)) return false;
+  // The general construction passes the output of the rewrite through filters
+  // over sigma, which reject symbols outside of it.
+  for (StateIterator<VectorFst<Arc>> siter(rewrite); !siter.Done();
+       siter.Next()) {
+    for (ArcIterator<VectorFst<Arc>> aiter(rewrite, siter.Value());
+         !aiter.Done(); aiter.Next()) {
+      const auto olabel = aiter.Value().olabel;
+      if (olabel != 0 && !sigma_labels.count(olabel)) return false;
+    }
+  }
+  if (!any_left || !any_right) {
+    for (const auto label : phi_labels) {
+      if (left_labels.count(label) || right_labels.count(label)) return false;
+    }
+    for (StateIterator<VectorFst<Arc>> siter(rewrite); !siter.Done();
+         siter.Next()) {
+      for (ArcIterator<VectorFst<Arc>> aiter(rewrite, siter.Value());
+           !aiter.Done(); aiter.Next()) {
+        const auto olabel = aiter.Value().olabel;
+        if (left_labels.count(olabel) || right_labels.count(olabel)) {
+          return false;
+        }
+      }
+    }
+    VectorFst<Arc> output(rewrite);
+    Project(&output, ProjectType::OUTPUT);
+    RmEpsilon(&output);
+    if (output.Start() != kNoStateId &&
+        output.Final(output.Start()) != Weight::Zero()) {
+      return false;
+    }
+  }
+  // What the next symbol must be.
+  enum Need { NONE = 0, RIGHT = 1, NOT_RIGHT = 2 };
+  const auto state = [](bool left, Need need) { return 3 * left + need; };
+  fst->DeleteStates();
+  fst->AddStates(6);
+  fst->SetStart(state(any_left, NONE));
+  for (const bool left : {false, true}) {
+    for (const auto need : {NONE, RIGHT, NOT_RIGHT}) {
+      const auto s = state(left, need);
+      if (need != RIGHT) fst->SetFinal(s, Weight::One());
+      for (const auto label : sigma_labels) {
+        const bool right = any_right || right_labels.count(label);
+        if ((need == RIGHT && !right) || (need == NOT_RIGHT && right)) {
+          continue;
+        }
+        const bool next_left = any_left || left_labels.count(label);
+        if (left && phi_labels.count(label) && mode_ == OBLIGATORY) {
+          // Leaving phi unchanged in the left context requires the right
+          // context not to follow.
+          if (any_right) continue;
+          fst->AddArc(s, Arc(label, label, Weight::One(),
+                             state(next_left, NOT_RIGHT)));
+        } else {
+          fst->AddArc(s, Arc(label, label, Weight::One(),
+                             state(next_left, NONE)));
+        }
+      }
+    }
+  }
+  if (rewrite.Start() != kNoStateId) {
+    const auto offset = fst->NumStates();
+    fst->AddStates(rewrite.NumStates());
+    const auto rewritten = state(any_left, any_right ? NONE : RIGHT);
+    for (StateIterator<VectorFst<Arc>> siter(rewrite); !siter.Done();
+         siter.Next()) {
+      const auto s = siter.Value();
+      for (ArcIterator<VectorFst<Arc>> aiter(rewrite, s); !aiter.Done();
+           aiter.Next()) {
+        auto arc = aiter.Value();
+        arc.nextstate += offset;
+        fst->AddArc(s + offset, arc);
+      }
+      const auto weight = rewrite.Final(s);
+      if (weight != Weight::Zero()) {
+        fst->AddArc(s + offset, Arc(0, 0, weight, rewritten));
+      }
+    }
+    for (const auto need : {NONE, NOT_RIGHT}) {
+      fst->AddArc(state(true, need),
+                  Arc(0, 0, Weight::One(), rewrite.Start() + offset));
+    }
+  }
+  Connect(fst);
+  Optimize(fst);
+  ArcSort(fst, ILabelCompare<Arc>());
+  return true;
+}
+
 // Builds the transducer representing the context-dependent rewrite rule. sigma
 // is an FST specifying (the closure of) the alphabet for the resulting
 // transducer. dir can be LEFT_TO_RIGHT, RIGHT_TO_LEFT or SIMULTANEOUS. mode can
@@ -484,9 +881,32 @@ typename Arc::Label CDRewriteRule<Arc>::MaxLabel(const Fst<Arc> &fst) {
 // preconditions.
 template <class Arc>
 void CDRewriteRule<Arc>::Compile(const Fst<Arc> &sigma, MutableFst<Arc> *fst,
-                                 CDRewriteDirection dir, CDRewriteMode mode) {
+                                 CDRewriteDirection dir, CDRewriteMode mode,
+                                 CDRewriteCache<Arc> *cache,
+                                 int num_threads) {
+  std::vector<VectorFst<Arc>> components;
+  CompileComponents(sigma, &components, dir, mode, cache, num_threads);
+  if (components.size() == 1) {
+    *fst = components.front();
+    return;
+  }
+  ComposeBalanced(&components, fst, num_threads);
+  Optimize(fst);
+  ArcSort(fst, ILabelCompare<Arc>());
+}
+
+template <class Arc>
+void CDRewriteRule<Arc>::CompileComponents(
+    const Fst<Arc> &sigma, std::vector<VectorFst<Arc>> *components,
+    CDRewriteDirection dir, CDRewriteMode mode, CDRewriteCache<Arc> *cache,
+    int num_threads) {
   dir_ = dir;
   mode_ = mode;
+  cache_ = cache;
+  // Holds the error, or the rule built directly, until it is known that the
+  // rule is made of several machines.
+  components->resize(1);
+  auto *fst = &components->front();
   if (!CheckUnweightedAcceptor(*phi_, "CDRewriteRule::Compile", "phi")) {
     fst->SetProperties(kError, kError);
     return;
@@ -509,6 +929,15 @@ void CDRewriteRule<Arc>::Compile(const Fst<Arc> &sigma, MutableFst<Arc> *fst,
     fst->SetProperties(kError, kError);
     return;
   }
+  // The machines below are built concurrently from phi and the contexts, which
+  // is only safe for expanded FSTs.
+  if (num_threads > 1) {
+    for (auto *input : {&phi_, &lambda_, &rho_}) {
+      if (!(*input)->Properties(kExpanded, false)) {
+        *input = std::make_unique<VectorFst<Arc>>(**input);
+      }
+    }
+  }
   static const ILabelCompare<Arc> icomp;
   static const IdentityArcMapper<Arc> imapper;
   VectorFst<Arc> mutable_sigma(sigma);
@@ -541,49 +970,59 @@ void CDRewriteRule<Arc>::Compile(const Fst<Arc> &sigma, MutableFst<Arc> *fst,
   } else {
     Cross(*phi_, *psi_, &replace);
   }
-  MakeReplace(&replace, mutable_sigma);
+  if (direct_ && !add_initial_boundary_marker && !add_final_boundary_marker &&
+      CompileSingleSymbolRule(sigma, replace, fst)) {
+    return;
+  }
+  // The machines composed into the rule, in order, and how to build each.
+  std::vector<std::function<void(VectorFst<Arc> *)>> builders;
+  const auto add_replace = [&] {
+    builders.push_back([&](VectorFst<Arc> *machine) {
+      *machine = replace;
+      MakeCachedReplace(machine, mutable_sigma);
+    });
+  };
   switch (dir_) {
     case LEFT_TO_RIGHT: {
       // Builds r filter.
-      VectorFst<Arc> r;
-      MakeFilter(*rho_, mutable_sigma, &r, MARK, {{0, rbrace_}}, true);
+      builders.push_back([&](VectorFst<Arc> *r) {
+        MakeFilter(*rho_, mutable_sigma, r, MARK, {{0, rbrace_}}, true);
+      });
       switch (mode_) {
         case OBLIGATORY: {
-          VectorFst<Arc> phi_rbrace;  // Appends > after phi_, matches all >.
-          ArcMap(*phi_, &phi_rbrace, imapper);
-          IgnoreMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
-          AppendMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
           // Builds f filter.
-          VectorFst<Arc> f;
-          MakeFilter(phi_rbrace, sigma_rbrace, &f, MARK,
-                     {{0, lbrace1_}, {0, lbrace2_}}, true);
+          builders.push_back([&](VectorFst<Arc> *f) {
+            VectorFst<Arc> phi_rbrace;  // Appends > after phi_, matches all >.
+            ArcMap(*phi_, &phi_rbrace, imapper);
+            IgnoreMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
+            AppendMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
+            MakeFilter(phi_rbrace, sigma_rbrace, f, MARK,
+                       {{0, lbrace1_}, {0, lbrace2_}}, true);
+          });
+          add_replace();
           // Builds l1 filter.
-          VectorFst<Arc> l1;
-          MakeFilter(*lambda_, mutable_sigma, &l1, CHECK, {{lbrace1_, 0}},
-                     false);
-          IgnoreMarkers(&l1, {{lbrace2_, lbrace2_}});
-          ArcSort(&l1, ILabelCompare<Arc>());
+          builders.push_back([&](VectorFst<Arc> *l1) {
+            MakeFilter(*lambda_, mutable_sigma, l1, CHECK, {{lbrace1_, 0}},
+                       false);
+            IgnoreMarkers(l1, {{lbrace2_, lbrace2_}});
+            ArcSort(l1, ILabelCompare<Arc>());
+          });
           // Builds l2 filter.
-          VectorFst<Arc> l2;
-          MakeFilter(*lambda_, mutable_sigma, &l2, CHECK_COMPLEMENT,
-                     {{lbrace2_, 0}}, false);
-          // Builds (((r o f) o replace) o l1) o l2.
-          VectorFst<Arc> c;
-          Compose(r, f, &c);
-          Compose(c, replace, fst);
-          Compose(*fst, l1, &c);
-          Compose(c, l2, fst);
+          builders.push_back([&](VectorFst<Arc> *l2) {
+            MakeFilter(*lambda_, mutable_sigma, l2, CHECK_COMPLEMENT,
+                       {{lbrace2_, 0}}, false);
+          });
+          // Composes r, f, replace, l1 and l2.
           break;
         }
         case OPTIONAL: {
+          add_replace();
           // Builds l filter.
-          VectorFst<Arc> l;
-          MakeFilter(*lambda_, mutable_sigma, &l, CHECK, {{lbrace1_, 0}},
-                     false);
-          // Builds (r o replace) o l.
-          VectorFst<Arc> c;
-          Compose(r, replace, &c);
-          Compose(c, l, fst);
+          builders.push_back([&](VectorFst<Arc> *l) {
+            MakeFilter(*lambda_, mutable_sigma, l, CHECK, {{lbrace1_, 0}},
+                       false);
+          });
+          // Composes r, replace and l.
           break;
         }
       }
@@ -591,44 +1030,44 @@ void CDRewriteRule<Arc>::Compile(const Fst<Arc> &sigma, MutableFst<Arc> *fst,
     }
     case RIGHT_TO_LEFT: {
       // Builds l filter.
-      VectorFst<Arc> l;
-      MakeFilter(*lambda_, mutable_sigma, &l, MARK, {{0, rbrace_}}, false);
+      builders.push_back([&](VectorFst<Arc> *l) {
+        MakeFilter(*lambda_, mutable_sigma, l, MARK, {{0, rbrace_}}, false);
+      });
       switch (mode_) {
         case OBLIGATORY: {
-          VectorFst<Arc> rbrace_phi;  // Prepends > before phi, matches all >
-          ArcMap(*phi_, &rbrace_phi, imapper);
-          IgnoreMarkers(&rbrace_phi, {{rbrace_, rbrace_}});
-          PrependMarkers(&rbrace_phi, {{rbrace_, rbrace_}});
           // Builds f filter.
-          VectorFst<Arc> f;
-          MakeFilter(rbrace_phi, sigma_rbrace, &f, MARK,
-                     {{0, lbrace1_}, {0, lbrace2_}}, false);
+          builders.push_back([&](VectorFst<Arc> *f) {
+            VectorFst<Arc> rbrace_phi;  // Prepends > before phi, matches all >
+            ArcMap(*phi_, &rbrace_phi, imapper);
+            IgnoreMarkers(&rbrace_phi, {{rbrace_, rbrace_}});
+            PrependMarkers(&rbrace_phi, {{rbrace_, rbrace_}});
+            MakeFilter(rbrace_phi, sigma_rbrace, f, MARK,
+                       {{0, lbrace1_}, {0, lbrace2_}}, false);
+          });
+          add_replace();
           // Builds r1 filter.
-          VectorFst<Arc> r1;
-          MakeFilter(*rho_, mutable_sigma, &r1, CHECK, {{lbrace1_, 0}}, true);
-          IgnoreMarkers(&r1, {{lbrace2_, lbrace2_}});
-          ArcSort(&r1, icomp);
+          builders.push_back([&](VectorFst<Arc> *r1) {
+            MakeFilter(*rho_, mutable_sigma, r1, CHECK, {{lbrace1_, 0}},
+                       true);
+            IgnoreMarkers(r1, {{lbrace2_, lbrace2_}});
+            ArcSort(r1, icomp);
+          });
           // Builds r2 filter.
-          VectorFst<Arc> r2;
-          MakeFilter(*rho_, mutable_sigma, &r2, CHECK_COMPLEMENT,
-                     {{lbrace2_, 0}},
-                     true);
-          // Builds (((l o f) o replace) o r1) o r2.
-          VectorFst<Arc> c;
-          Compose(l, f, &c);
-          Compose(c, replace, fst);
-          Compose(*fst, r1, &c);
-          Compose(c, r2, fst);
+          builders.push_back([&](VectorFst<Arc> *r2) {
+            MakeFilter(*rho_, mutable_sigma, r2, CHECK_COMPLEMENT,
+                       {{lbrace2_, 0}}, true);
+          });
+          // Composes l, f, replace, r1 and r2.
           break;
         }
         case OPTIONAL: {
+          add_replace();
           // Builds r filter.
-          VectorFst<Arc> r;
-          MakeFilter(*rho_, mutable_sigma, &r, CHECK, {{lbrace1_, 0}}, true);
-          // Builds (l o replace) o r.
-          VectorFst<Arc> c;
-          Compose(l, replace, &c);
-          Compose(c, r, fst);
+          builders.push_back([&](VectorFst<Arc> *r) {
+            MakeFilter(*rho_, mutable_sigma, r, CHECK, {{lbrace1_, 0}},
+                       true);
+          });
+          // Composes l, replace and r.
           break;
         }
       }
@@ -636,74 +1075,73 @@ void CDRewriteRule<Arc>::Compile(const Fst<Arc> &sigma, MutableFst<Arc> *fst,
     }
     case SIMULTANEOUS: {
       // Builds r filter.
-      VectorFst<Arc> r;
-      MakeFilter(*rho_, mutable_sigma, &r, MARK, {{0, rbrace_}}, true);
+      builders.push_back([&](VectorFst<Arc> *r) {
+        MakeFilter(*rho_, mutable_sigma, r, MARK, {{0, rbrace_}}, true);
+      });
       switch (mode_) {
         case OBLIGATORY: {
-          VectorFst<Arc> phi_rbrace;  // Appends > after phi, matches all >.
-          ArcMap(*phi_, &phi_rbrace, imapper);
-          IgnoreMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
-          AppendMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
           // Builds f filter.
-          VectorFst<Arc> f;
-          MakeFilter(phi_rbrace, sigma_rbrace, &f, MARK,
-                     {{0, lbrace1_}, {0, lbrace2_}}, true);
+          builders.push_back([&](VectorFst<Arc> *f) {
+            VectorFst<Arc> phi_rbrace;  // Appends > after phi, matches all >.
+            ArcMap(*phi_, &phi_rbrace, imapper);
+            IgnoreMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
+            AppendMarkers(&phi_rbrace, {{rbrace_, rbrace_}});
+            MakeFilter(phi_rbrace, sigma_rbrace, f, MARK,
+                       {{0, lbrace1_}, {0, lbrace2_}}, true);
+          });
           // Builds l1 filter.
-          VectorFst<Arc> l1;
-          MakeFilter(*lambda_, mutable_sigma, &l1, CHECK,
-                     {{lbrace1_, lbrace1_}}, false);
-          IgnoreMarkers(&l1, {{lbrace2_, lbrace2_}, {rbrace_, rbrace_}});
-          ArcSort(&l1, icomp);
+          builders.push_back([&](VectorFst<Arc> *l1) {
+            MakeFilter(*lambda_, mutable_sigma, l1, CHECK,
+                       {{lbrace1_, lbrace1_}}, false);
+            IgnoreMarkers(l1, {{lbrace2_, lbrace2_}, {rbrace_, rbrace_}});
+            ArcSort(l1, icomp);
+          });
           // Builds l2 filter.
-          VectorFst<Arc> l2;
-          MakeFilter(*lambda_, mutable_sigma, &l2, CHECK_COMPLEMENT,
-                     {{lbrace2_, lbrace2_}}, false);
-          IgnoreMarkers(&l2, {{lbrace1_, lbrace1_}, {rbrace_, rbrace_}});
-          ArcSort(&l2, icomp);
-          // Builds (((r o f) o l1) o l2) o replace.
-          VectorFst<Arc> c;
-          Compose(r, f, &c);
-          Compose(c, l1, fst);
-          Compose(*fst, l2, &c);
-          Compose(c, replace, fst);
+          builders.push_back([&](VectorFst<Arc> *l2) {
+            MakeFilter(*lambda_, mutable_sigma, l2, CHECK_COMPLEMENT,
+                       {{lbrace2_, lbrace2_}}, false);
+            IgnoreMarkers(l2, {{lbrace1_, lbrace1_}, {rbrace_, rbrace_}});
+            ArcSort(l2, icomp);
+          });
+          add_replace();
+          // Composes r, f, l1, l2 and replace.
           break;
         }
         case OPTIONAL: {
           // Builds l filter.
-          VectorFst<Arc> l;
-          MakeFilter(*lambda_, mutable_sigma, &l, CHECK, {{0, lbrace1_}},
-                     false);
-          IgnoreMarkers(&l, {{rbrace_, rbrace_}});
-          static const ILabelCompare<Arc> icomp;
-          ArcSort(&l, icomp);
-          // Builds (r o l) o replace.
-          VectorFst<Arc> c;
-          Compose(r, l, &c);
-          Compose(c, replace, fst);
+          builders.push_back([&](VectorFst<Arc> *l) {
+            MakeFilter(*lambda_, mutable_sigma, l, CHECK, {{0, lbrace1_}},
+                       false);
+            IgnoreMarkers(l, {{rbrace_, rbrace_}});
+            ArcSort(l, icomp);
+          });
+          add_replace();
+          // Composes r, l and replace.
           break;
         }
       }
       break;
     }
   }
-  // If we need to handle boundary markers we do an extra composition of the
-  // boundary inserter and boundary deleter.
+  // The machines are independent of one another, so they can be built
+  // concurrently.
+  std::vector<VectorFst<Arc>> machines(builders.size());
+  ParallelFor(builders.size(), num_threads,
+              [&](size_t i) { builders[i](&machines[i]); });
+  // If we need to handle boundary markers, the boundary inserter comes before
+  // the machines and the boundary deleter after them.
+  components->clear();
   if (add_initial_boundary_marker || add_final_boundary_marker) {
-    VectorFst<Arc> inserter;
-    BoundaryInserter(sigma, &inserter,
-                     add_initial_boundary_marker, add_final_boundary_marker);
-    VectorFst<Arc> deleter;
-    BoundaryDeleter(sigma, &deleter,
-                    add_initial_boundary_marker, add_final_boundary_marker);
-    VectorFst<Arc> tmp;
-    ArcSort(fst, icomp);
-    Compose(inserter, *fst, &tmp);
-    static const OLabelCompare<Arc> ocomp;
-    ArcSort(&tmp, ocomp);
-    Compose(tmp, deleter, fst);
+    components->emplace_back();
+    BoundaryInserter(sigma, &components->back(), add_initial_boundary_marker,
+                     add_final_boundary_marker);
+  }
+  for (auto &machine : machines) components->push_back(machine);
+  if (add_initial_boundary_marker || add_final_boundary_marker) {
+    components->emplace_back();
+    BoundaryDeleter(sigma, &components->back(), add_initial_boundary_marker,
+                    add_final_boundary_marker);
   }
-  Optimize(fst);
-  ArcSort(fst, icomp);
 }
 
 template <class Arc>
@@ -797,11 +1235,18 @@ void CDRewriteRule<Arc>::BoundaryInserter(const Fst<Arc> &sigma,
                                           VectorFst<Arc> *final_fst,
                                           bool add_initial_boundary_marker,
                                           bool add_final_boundary_marker) {
+  std::vector<int64_t> params;
+  if (cache_) {
+    params = BoundaryCacheParams(BOUNDARY_INSERTER, add_initial_boundary_marker,
+                                 add_final_boundary_marker);
+    if (cache_->Find(VectorFst<Arc>(), sigma, params, final_fst)) return;
+  }
   HandleBoundaryMarkers(sigma, final_fst, false,
                         add_initial_boundary_marker,
                         add_final_boundary_marker);
   Optimize(final_fst);
   ArcSort(final_fst, OLabelCompare<Arc>());
+  if (cache_) cache_->Insert(VectorFst<Arc>(), sigma, params, *final_fst);
 }
 
 template <class Arc>
@@ -809,11 +1254,18 @@ void CDRewriteRule<Arc>::BoundaryDeleter(const Fst<Arc> &sigma,
                                          VectorFst<Arc> *final_fst,
                                          bool add_initial_boundary_marker,
                                          bool add_final_boundary_marker) {
+  std::vector<int64_t> params;
+  if (cache_) {
+    params = BoundaryCacheParams(BOUNDARY_DELETER, add_initial_boundary_marker,
+                                 add_final_boundary_marker);
+    if (cache_->Find(VectorFst<Arc>(), sigma, params, final_fst)) return;
+  }
   HandleBoundaryMarkers(sigma, final_fst, true,
                         add_initial_boundary_marker,
                         add_final_boundary_marker);
   Optimize(final_fst);
   ArcSort(final_fst, ILabelCompare<Arc>());
+  if (cache_) cache_->Insert(VectorFst<Arc>(), sigma, params, *final_fst);
 }
 
 template <class Arc>
@@ -848,7 +1300,9 @@ bool CDRewriteRule<Arc>::HasArcWithLabel(const Fst<Arc> &fst, Label label) {
 // acceptor representing a bifix code.
 //
 // The error bit on the output FST is set if any argument does not satisfy the
-// preconditions.
+// preconditions. If a cache is provided, the intermediate machines are shared
+// with the other rules compiled with it. If num_threads is greater than one,
+// the intermediate machines are built and composed on that many threads.
 template <class Arc>
 void CDRewriteCompile(const Fst<Arc> &phi, const Fst<Arc> &psi,
                       const Fst<Arc> &lambda, const Fst<Arc> &rho,
@@ -857,11 +1311,13 @@ void CDRewriteCompile(const Fst<Arc> &phi, const Fst<Arc> &psi,
                       CDRewriteMode mode = OBLIGATORY,
                       bool phiXpsi = true,
                       typename Arc::Label initial_boundary_marker = kNoLabel,
-                      typename Arc::Label final_boundary_marker = kNoLabel) {
+                      typename Arc::Label final_boundary_marker = kNoLabel,
+                      CDRewriteCache<Arc> *cache = nullptr,
+                      int num_threads = 1) {
   internal::CDRewriteRule<Arc> cdrule(phi, psi, lambda, rho, phiXpsi,
                                       initial_boundary_marker,
                                       final_boundary_marker);
-  cdrule.Compile(sigma, fst, dir, mode);
+  cdrule.Compile(sigma, fst, dir, mode, cache, num_threads);
 }
 
 // Builds a transducer object representing the context-dependent rewrite rule:
@@ -883,9 +1339,12 @@ void CDRewriteCompile(const Fst<Arc> &phi, const Fst<Arc> &psi,
                       CDRewriteDirection dir = LEFT_TO_RIGHT,
                       CDRewriteMode mode = OBLIGATORY,
                       typename Arc::Label initial_boundary_marker = kNoLabel,
-                      typename Arc::Label final_boundary_marker = kNoLabel) {
+                      typename Arc::Label final_boundary_marker = kNoLabel,
+                      CDRewriteCache<Arc> *cache = nullptr,
+                      int num_threads = 1) {
   CDRewriteCompile(phi, psi, lambda, rho, sigma, fst, dir, mode, false,
-                   initial_boundary_marker, final_boundary_marker);
+                   initial_boundary_marker, final_boundary_marker, cache,
+                   num_threads);
 }
 
 // Builds a transducer object representing the context-dependent rewrite rule:
@@ -908,13 +1367,111 @@ void CDRewriteCompile(const Fst<Arc> &tau, const Fst<Arc> &lambda,
                       CDRewriteDirection dir = LEFT_TO_RIGHT,
                       CDRewriteMode mode = OBLIGATORY,
                       typename Arc::Label initial_boundary_marker = kNoLabel,
-                      typename Arc::Label final_boundary_marker = kNoLabel) {
+                      typename Arc::Label final_boundary_marker = kNoLabel,
+                      CDRewriteCache<Arc> *cache = nullptr,
+                      int num_threads = 1) {
   VectorFst<Arc> phi(tau);
   Project(&phi, ProjectType::INPUT);
   ArcMap(&phi, RmWeightMapper<Arc>());
   Optimize(&phi);
   CDRewriteCompile(phi, tau, lambda, rho, sigma, fst, dir, mode, true,
-                   initial_boundary_marker, final_boundary_marker);
+                   initial_boundary_marker, final_boundary_marker, cache,
+                   num_threads);
+}
+
+// Builds the machines whose composition, in order, is the transducer built by
+// CDRewriteCompile from the same arguments, without composing them. Composing
+// an input with each of them in turn, or with their lazy composition, applies
+// the rule without ever building the rule transducer, whose size can be the
+// product of theirs. If the rule is built directly, or an argument does not
+// satisfy the preconditions, there is just one machine: the rule transducer,
+// or an FST with the error bit set.
+template <class Arc>
+void CDRewriteCompileComponents(
+    const Fst<Arc> &tau, const Fst<Arc> &lambda, const Fst<Arc> &rho,
+    const Fst<Arc> &sigma, std::vector<VectorFst<Arc>> *components,
+    CDRewriteDirection dir = LEFT_TO_RIGHT, CDRewriteMode mode = OBLIGATORY,
+    typename Arc::Label initial_boundary_marker = kNoLabel,
+    typename Arc::Label final_boundary_marker = kNoLabel,
+    CDRewriteCache<Arc> *cache = nullptr, int num_threads = 1) {
+  VectorFst<Arc> phi(tau);
+  Project(&phi, ProjectType::INPUT);
+  ArcMap(&phi, RmWeightMapper<Arc>());
+  Optimize(&phi);
+  internal::CDRewriteRule<Arc> cdrule(phi, tau, lambda, rho, true,
+                                      initial_boundary_marker,
+                                      final_boundary_marker);
+  cdrule.CompileComponents(sigma, components, dir, mode, cache, num_threads);
+}
+
+// One rule of a cascade: tau / lambda __ rho, where tau represents the
+// cross-product of phi X psi.
+template <class Arc>
+struct CDRewriteCascadeRule {
+  const Fst<Arc> *tau;
+  const Fst<Arc> *lambda;
+  const Fst<Arc> *rho;
+};
+
+// Builds the transducer applying the rules in order, i.e., the composition of
+// the rules compiled as above, with the same sigma, direction, mode and
+// boundary markers. The composition is optimized after each rule, with
+// max_states as the determinization budget (see Optimize); false is returned
+// if this was exceeded. If num_threads is greater than one, the rules are
+// compiled on that many threads before being composed; otherwise each is
+// composed as soon as it is compiled. With no rules, the result is the identity
+// on sigma.
+//
+// The error bit on the output FST is set if any rule does not satisfy the
+// preconditions.
+template <class Arc>
+bool CDRewriteCascadeCompile(
+    const std::vector<CDRewriteCascadeRule<Arc>> &rules, const Fst<Arc> &sigma,
+    MutableFst<Arc> *fst, CDRewriteDirection dir = LEFT_TO_RIGHT,
+    CDRewriteMode mode = OBLIGATORY,
+    typename Arc::Label initial_boundary_marker = kNoLabel,
+    typename Arc::Label final_boundary_marker = kNoLabel,
+    CDRewriteCache<Arc> *cache = nullptr, int num_threads = 1,
+    int64 max_states = -1) {
+  std::vector<VectorFst<Arc>> compiled(rules.size());
+  // The threads go to the rules if there are several, else to the one rule.
+  const int rule_threads = rules.size() > 1 ? 1 : num_threads;
+  // Each rule works on its own copies of the FSTs, since computing the
+  // properties of an FST shared between threads is not thread-safe.
+  const auto compile = [&](size_t i) {
+    const VectorFst<Arc> tau(*rules[i].tau);
+    const VectorFst<Arc> lambda(*rules[i].lambda);
+    const VectorFst<Arc> rho(*rules[i].rho);
+    const VectorFst<Arc> rule_sigma(sigma);
+    CDRewriteCompile(tau, lambda, rho, rule_sigma, &compiled[i], dir, mode,
+                     initial_boundary_marker, final_boundary_marker, cache,
+                     rule_threads);
+  };
+  if (num_threads > 1) {
+    internal::ParallelFor(rules.size(), num_threads, compile);
+  }
+  bool within_budget = true;
+  VectorFst<Arc> cascade(sigma);
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (num_threads <= 1) compile(i);
+    if (compiled[i].Properties(kError, false)) {
+      fst->DeleteStates();
+      fst->SetProperties(kError, kError);
+      return within_budget;
+    }
+    if (i == 0) {
+      cascade = compiled[i];
+    } else {
+      VectorFst<Arc> composed;
+      Compose(cascade, compiled[i], &composed);
+      if (!Optimize(&composed, false, max_states)) within_budget = false;
+      cascade = composed;
+    }
+    compiled[i] = VectorFst<Arc>();
+  }
+  ArcSort(&cascade, ILabelCompare<Arc>());
+  *fst = cascade;
+  return within_budget;
 }
 
 }  // namespace fst
@@ -0,0 +1,81 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef FST_UTIL_OPERATORS_COMPOSECASCADE_H_
+#define FST_UTIL_OPERATORS_COMPOSECASCADE_H_
+
+// Delayed composition of a sequence of transducers, which keeps the transducers
+// themselves, so that they can be stored separately and the composition
+// rebuilt where it is used.
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <fst/cache.h>
+#include <fst/compose.h>
+#include <fst/fst.h>
+
+namespace fst {
+
+// Computes the composition of the components, in order, on demand: the states
+// (and arcs) of the composition are only built, and cached, as they are
+// visited. Composing a short string with it thus visits only a small part of a
+// composition which may be far too large to build in full.
+//
+// There must be at least two components, and every component but the first
+// must be sorted on input labels. The composition takes its input symbols from
+// the first component and its output symbols from the last.
+template <class Arc>
+class ComposeCascadeFst : public ComposeFst<Arc> {
+ public:
+  using Components = std::vector<std::shared_ptr<const Fst<Arc>>>;
+
+  explicit ComposeCascadeFst(Components components,
+                             const CacheOptions &opts = CacheOptions())
+      : ComposeFst<Arc>(*ComposePrefix(components, opts), *components.back(),
+                        opts),
+        components_(std::move(components)) {}
+
+  // See Fst<>::Copy() for doc.
+  ComposeCascadeFst(const ComposeCascadeFst &fst, bool safe = false)
+      : ComposeFst<Arc>(fst, safe), components_(fst.components_) {}
+
+  // Gets a copy of this ComposeCascadeFst. See Fst<>::Copy() for further doc.
+  ComposeCascadeFst *Copy(bool safe = false) const override {
+    return new ComposeCascadeFst(*this, safe);
+  }
+
+  const Components &GetComponents() const { return components_; }
+
+ private:
+  // The delayed composition of all components but the last.
+  static std::unique_ptr<const Fst<Arc>> ComposePrefix(
+      const Components &components, const CacheOptions &opts) {
+    std::unique_ptr<const Fst<Arc>> prefix(components.front()->Copy());
+    for (size_t i = 1; i + 1 < components.size(); ++i) {
+      prefix = std::make_unique<ComposeFst<Arc>>(*prefix, *components[i],
+                                                 opts);
+    }
+    return prefix;
+  }
+
+  // The components share their implementation with the copies held by the
+  // composition, so keeping them costs no memory.
+  Components components_;
+};
+
+}  // namespace fst
+
+#endif  // FST_UTIL_OPERATORS_COMPOSECASCADE_H_
@@ -0,0 +1,150 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef FST_UTIL_OPERATORS_FINGERPRINT_H_
+#define FST_UTIL_OPERATORS_FINGERPRINT_H_
+
+// 64-bit fingerprints of byte strings and FSTs, used as cache keys, and the
+// comparisons which confirm that values with equal fingerprints are equal.
+//
+// These are not cryptographic hashes, and they are not stable across releases;
+// they should only be used to recognize values seen earlier in the same
+// process, or cached by the same build of the library.
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <fst/fst.h>
+#include <fst/symbol-table.h>
+
+namespace fst {
+
+// Scrambles the bits of a 64-bit value (the MurmurHash3 finalizer).
+inline uint64_t FingerprintMix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+// Folds a value into a running fingerprint. The result depends on the order in
+// which values are folded in.
+inline uint64_t FingerprintCombine(uint64_t seed, uint64_t value) {
+  return FingerprintMix(seed ^
+                        (value + 0x9e3779b97f4a7c15ULL + (seed << 6) +
+                         (seed >> 2)));
+}
+
+inline uint64_t FingerprintBytes(std::string_view bytes, uint64_t seed = 0) {
+  uint64_t fingerprint = FingerprintMix(seed ^ bytes.size());
+  const char *data = bytes.data();
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    fingerprint = FingerprintCombine(fingerprint, word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data + i, bytes.size() - i);
+  return FingerprintCombine(fingerprint, tail);
+}
+
+inline uint64_t FingerprintSymbolTable(const SymbolTable &symbols) {
+  return FingerprintBytes(symbols.LabeledCheckSum(), 0x53594d42ULL);
+}
+
+// Fingerprints the structure of the FST: its states, arcs, weights and symbol
+// tables, in state order. Two FSTs get the same fingerprint if they are
+// identical, not merely equivalent. Fingerprints taken with different seeds
+// are independent, so together they make a longer one. This visits every
+// state, so on a delayed FST it forces a full expansion.
+template <class Arc>
+uint64_t FstFingerprint(const Fst<Arc> &fst, uint64_t seed = 0) {
+  uint64_t fingerprint = FingerprintBytes(Arc::Type(), seed);
+  fingerprint = FingerprintCombine(fingerprint, fst.Start());
+  for (StateIterator<Fst<Arc>> siter(fst); !siter.Done(); siter.Next()) {
+    const auto state = siter.Value();
+    fingerprint = FingerprintCombine(fingerprint, fst.Final(state).Hash());
+    fingerprint = FingerprintCombine(fingerprint, fst.NumArcs(state));
+    for (ArcIterator<Fst<Arc>> aiter(fst, state); !aiter.Done();
+         aiter.Next()) {
+      const auto &arc = aiter.Value();
+      fingerprint = FingerprintCombine(fingerprint, arc.ilabel);
+      fingerprint = FingerprintCombine(fingerprint, arc.olabel);
+      fingerprint = FingerprintCombine(fingerprint, arc.weight.Hash());
+      fingerprint = FingerprintCombine(fingerprint, arc.nextstate);
+    }
+  }
+  if (fst.InputSymbols()) {
+    fingerprint = FingerprintCombine(
+        fingerprint, FingerprintSymbolTable(*fst.InputSymbols()));
+  }
+  if (fst.OutputSymbols()) {
+    fingerprint = FingerprintCombine(
+        fingerprint, FingerprintSymbolTable(*fst.OutputSymbols()));
+  }
+  return fingerprint;
+}
+
+// Returns true if the symbol tables (either of which may be null) have the same
+// name and the same symbols with the same labels.
+inline bool SymbolTablesIdentical(const SymbolTable *symbols1,
+                                  const SymbolTable *symbols2) {
+  if (symbols1 == symbols2) return true;
+  if (!symbols1 || !symbols2) return false;
+  if (symbols1->Name() != symbols2->Name() ||
+      symbols1->NumSymbols() != symbols2->NumSymbols()) {
+    return false;
+  }
+  for (const auto &item : *symbols1) {
+    if (symbols2->Find(item.Label()) != item.Symbol()) return false;
+  }
+  return true;
+}
+
+// Returns true if the FSTs are identical: the same states, arcs, weights and
+// symbol tables, in the same order. Identical FSTs have equal fingerprints.
+template <class Arc>
+bool FstIdentical(const Fst<Arc> &fst1, const Fst<Arc> &fst2) {
+  if (fst1.Start() != fst2.Start()) return false;
+  StateIterator<Fst<Arc>> siter1(fst1);
+  StateIterator<Fst<Arc>> siter2(fst2);
+  for (; !siter1.Done() && !siter2.Done(); siter1.Next(), siter2.Next()) {
+    const auto state = siter1.Value();
+    if (siter2.Value() != state || fst1.Final(state) != fst2.Final(state) ||
+        fst1.NumArcs(state) != fst2.NumArcs(state)) {
+      return false;
+    }
+    ArcIterator<Fst<Arc>> aiter1(fst1, state);
+    ArcIterator<Fst<Arc>> aiter2(fst2, state);
+    for (; !aiter1.Done(); aiter1.Next(), aiter2.Next()) {
+      const auto &arc1 = aiter1.Value();
+      const auto &arc2 = aiter2.Value();
+      if (arc1.ilabel != arc2.ilabel || arc1.olabel != arc2.olabel ||
+          arc1.weight != arc2.weight || arc1.nextstate != arc2.nextstate) {
+        return false;
+      }
+    }
+  }
+  return siter1.Done() && siter2.Done() &&
+         SymbolTablesIdentical(fst1.InputSymbols(), fst2.InputSymbols()) &&
+         SymbolTablesIdentical(fst1.OutputSymbols(), fst2.OutputSymbols());
+}
+
+}  // namespace fst
+
+#endif  // FST_UTIL_OPERATORS_FINGERPRINT_H_
@@ -0,0 +1,243 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef FST_UTIL_STRING_FLAT_PREFIX_TREE_H_
+#define FST_UTIL_STRING_FLAT_PREFIX_TREE_H_
+
+// A PrefixTree that keeps its nodes in flat arrays rather than as linked
+// objects. Each node is just an index (which is also its state in the FST),
+// with its final weight and output node in parallel vectors, and all the edges
+// of the tree are kept in a single open-addressing hash table keyed by
+// (parent, label). This avoids an allocation per node and per edge and most of
+// the pointer chasing of the std::map-based tree, at the cost of sorting the
+// children of each node when writing the FST. The FST written is identical to
+// that of the PrefixTree with the same policy.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <fst/arc.h>
+#include <fst/vector-fst.h>
+#include <thrax/algo/prefix_tree.h>
+
+namespace fst {
+namespace internal {
+
+// This class is neither thread-safe nor thread-hostile.
+template <class Arc, class Policy>
+class FlatPrefixTree {
+ public:
+  using Label = typename Arc::Label;
+  using StateId = typename Arc::StateId;
+  using Weight = typename Arc::Weight;
+
+  FlatPrefixTree() : num_edges_(0), shift_(64) {}
+
+  StateId NumStates() const { return weights_.size(); }
+
+  // Add an entry to the prefix tree, consisting of two label sequences and a
+  // weight. Each label sequence must be provided as a pair of iterators.
+  template <class Iterator1, class Iterator2, class T>
+  void Add(Iterator1 it1, Iterator1 end1, Iterator2 it2, Iterator2 end2,
+           T &&weight) {
+    if (weights_.empty()) AddNode(/*output=*/false);
+    StateId inode = 0;
+    for (Label ilabel : fst::make_range(it1, end1)) {
+      if (!ilabel) continue;  // Skips over epsilons.
+      inode = FindOrAddChild(inode, ilabel, /*output=*/false);
+    }
+    StateId onode = inode;
+    if constexpr (!Policy::IsAcceptor()) {
+      if (outputs_[inode] == kNoStateId) {
+        const auto state = AddNode(/*output=*/true);
+        outputs_[inode] = state;
+      }
+      onode = outputs_[inode];
+      for (Label olabel : fst::make_range(it2, end2)) {
+        if (!olabel) continue;  // Skips over epsilons.
+        onode = FindOrAddChild(onode, olabel, /*output=*/true);
+      }
+    }
+    weights_[onode] = Plus(weights_[onode], std::forward<T>(weight));
+  }
+
+  // With semiring One as a default.
+  template <class Iterator1, class Iterator2>
+  void Add(Iterator1 it1, Iterator1 end1, Iterator2 it2, Iterator2 end2) {
+    Add(it1, end1, it2, end2, Weight::One());
+  }
+
+  template <class Container1, class Container2, class T>
+  void Add(const Container1 &cont1, const Container2 &cont2, T &&weight) {
+    Add(cont1.begin(), cont1.end(), cont2.begin(), cont2.end(),
+        std::forward<T>(weight));
+  }
+
+  // With semiring One as a default.
+  template <class Container1, class Container2>
+  void Add(const Container1 &cont1, const Container2 &cont2) {
+    Add(cont1.begin(), cont1.end(), cont2.begin(), cont2.end(), Weight::One());
+  }
+
+  // Removes all elements from this prefix tree.
+  void Clear() {
+    weights_.clear();
+    outputs_.clear();
+    is_output_.clear();
+    edges_.clear();
+    num_edges_ = 0;
+    shift_ = 64;
+  }
+
+  // Write the current prefix tree transducer to a mutable FST.
+  void ToFst(MutableFst<Arc> *fst) const {
+    fst->DeleteStates();
+    const StateId num_states = NumStates();
+    if (num_states == 0) return;
+    // Gathers the children of each node, sorted by label, as the ones of the
+    // std::map-based tree would be.
+    std::vector<size_t> offsets(num_states + 1, 0);
+    for (const auto &edge : edges_) {
+      if (edge.child != kNoStateId) ++offsets[Parent(edge.key) + 1];
+    }
+    for (StateId s = 0; s < num_states; ++s) offsets[s + 1] += offsets[s];
+    std::vector<std::pair<Label, StateId>> children(num_edges_);
+    {
+      std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+      for (const auto &edge : edges_) {
+        if (edge.child == kNoStateId) continue;
+        children[next[Parent(edge.key)]++] = {ChildLabel(edge.key),
+                                              edge.child};
+      }
+    }
+    fst->AddStates(num_states);
+    fst->SetStart(0);
+    for (StateId s = 0; s < num_states; ++s) {
+      const auto begin = children.begin() + offsets[s];
+      const auto end = children.begin() + offsets[s + 1];
+      std::sort(begin, end);
+      const bool bridge =
+          !Policy::IsAcceptor() && !is_output_[s] && outputs_[s] != kNoStateId;
+      fst->ReserveArcs(s, (bridge ? 1 : 0) + (end - begin));
+      if (bridge) fst->AddArc(s, Arc(0, 0, outputs_[s]));
+      for (auto it = begin; it != end; ++it) {
+        const auto label = it->first;
+        if (Policy::IsAcceptor()) {
+          fst->AddArc(s, Arc(label, label, it->second));
+        } else if (is_output_[s]) {
+          fst->AddArc(s, Arc(0, label, it->second));
+        } else {
+          fst->AddArc(s, Arc(label, 0, it->second));
+        }
+      }
+      fst->SetFinal(s, weights_[s]);
+    }
+  }
+
+ private:
+  // An edge of the tree; the child is kNoStateId for an empty slot.
+  struct Edge {
+    uint64_t key;
+    StateId child;
+  };
+
+  static uint64_t Key(StateId parent, Label label) {
+    return (static_cast<uint64_t>(parent) << 32) |
+           static_cast<uint32_t>(label);
+  }
+
+  static StateId Parent(uint64_t key) { return key >> 32; }
+
+  static Label ChildLabel(uint64_t key) {
+    return static_cast<Label>(static_cast<uint32_t>(key));
+  }
+
+  // Fibonacci hashing: the top bits of the product.
+  size_t Index(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ULL) >> shift_;
+  }
+
+  StateId AddNode(bool output) {
+    const StateId state = weights_.size();
+    weights_.push_back(Weight::Zero());
+    outputs_.push_back(kNoStateId);
+    is_output_.push_back(output);
+    return state;
+  }
+
+  StateId FindOrAddChild(StateId parent, Label label, bool output) {
+    // Keeps the load at most 1/2.
+    if (2 * (num_edges_ + 1) > edges_.size()) Rehash();
+    const uint64_t key = Key(parent, label);
+    const size_t mask = edges_.size() - 1;
+    for (size_t i = Index(key);; i = (i + 1) & mask) {
+      auto &edge = edges_[i];
+      if (edge.child == kNoStateId) {
+        const auto child = AddNode(output);
+        edges_[i] = {key, child};
+        ++num_edges_;
+        return child;
+      }
+      if (edge.key == key) return edge.child;
+    }
+  }
+
+  void Rehash() {
+    std::vector<Edge> edges(std::max<size_t>(16, 2 * edges_.size()),
+                            Edge{0, kNoStateId});
+    edges.swap(edges_);
+    shift_ = 64;
+    for (size_t size = edges_.size(); size > 1; size >>= 1) --shift_;
+    const size_t mask = edges_.size() - 1;
+    for (const auto &edge : edges) {
+      if (edge.child == kNoStateId) continue;
+      size_t i = Index(edge.key);
+      while (edges_[i].child != kNoStateId) i = (i + 1) & mask;
+      edges_[i] = edge;
+    }
+  }
+
+  // Indexed by node (and state).
+  std::vector<Weight> weights_;
+  std::vector<StateId> outputs_;  // The output node of an input node.
+  std::vector<bool> is_output_;
+  // The edges, in a table with a power-of-two size.
+  std::vector<Edge> edges_;
+  size_t num_edges_;
+  int shift_;
+
+  FlatPrefixTree(const FlatPrefixTree &) = delete;
+  FlatPrefixTree &operator=(const FlatPrefixTree &) = delete;
+};
+
+}  // namespace internal
+
+template <class Arc>
+using FlatTransducerPrefixTree =
+    internal::FlatPrefixTree<Arc, internal::PrefixTreeTransducerPolicy<Arc>>;
+
+// As with an `AcceptorPrefixTree`, `Add` only looks at the first of the two
+// strings passed.
+template <class Arc>
+using FlatAcceptorPrefixTree =
+    internal::FlatPrefixTree<Arc, internal::PrefixTreeAcceptorPolicy<Arc>>;
+
+}  // namespace fst
+
+#endif  // FST_UTIL_STRING_FLAT_PREFIX_TREE_H_
@@ -24,23 +24,85 @@
 // construction of integrated speech recognition transducers. In Proc. ICASSP,
 // pages 761-764.
 
+#include <algorithm>
+#include <queue>
+#include <type_traits>
+#include <unordered_map>
+
 #include <fst/arcsort.h>
 #include <fst/determinize.h>
 #include <fst/encode.h>
+#include <fst/float-weight.h>
 #include <fst/minimize.h>
 #include <fst/mutable-fst.h>
+#include <fst/push.h>
 #include <fst/rmepsilon.h>
 #include <fst/state-map.h>
+#include <fst/vector-fst.h>
 
 // These functions are generic optimization methods for mutable FSTs, inspired
 // by those originally included in Thrax.
 
 namespace fst {
+
+// How an FST which may have weighted cycles is made deterministic.
+//
+//   OPTIMIZE_ENCODE_WEIGHTS: determinizes it as an unweighted acceptor, with
+//     each label pair and weight encoded as a single label. This always
+//     terminates, but the encoded alphabet may be very large, and arcs which
+//     differ only in their weights are never merged.
+//   OPTIMIZE_PUSH_WEIGHTS: pushes the weights towards the initial state and
+//     determinizes it as a weighted acceptor, with only the label pairs
+//     encoded. Pushing makes the weights of equivalent suffixes identical, so
+//     this usually gives a smaller result, and much faster; but weighted
+//     determinization need not terminate on cyclic FSTs, so it is abandoned
+//     past a state budget (see kPushStateFactor), and the FST is then
+//     optimized as with OPTIMIZE_ENCODE_WEIGHTS. Applies only to the tropical
+//     semiring, and only if no weight is negative, since shortest distances
+//     (and so pushing) are not defined with negative cycles; other FSTs use
+//     OPTIMIZE_ENCODE_WEIGHTS.
+//   OPTIMIZE_AUTO: OPTIMIZE_PUSH_WEIGHTS for tropical FSTs which are not known
+//     to be free of weighted cycles, and OPTIMIZE_ENCODE_WEIGHTS otherwise.
+//
+// OPTIMIZE_ENCODE_WEIGHTS is the default; src/bin/optimize-benchmark.cc
+// compares the strategies.
+//
+// FSTs known to be acyclic or to have no weighted cycles are optimized the
+// same way under every strategy.
+enum OptimizeStrategy {
+  OPTIMIZE_AUTO,
+  OPTIMIZE_ENCODE_WEIGHTS,
+  OPTIMIZE_PUSH_WEIGHTS
+};
+
 namespace internal {
 
 constexpr uint64 kDoNotEncodeWeights = (kAcyclic | kUnweighted |
                                         kUnweightedCycles);
 
+// Unless a state budget is given, determinizing a pushed FST is abandoned once
+// the result has this many times as many states as the input.
+constexpr int64 kPushStateFactor = 4;
+
+template <class Weight>
+struct IsTropicalWeight : std::false_type {};
+
+template <class T>
+struct IsTropicalWeight<TropicalWeightTpl<T>> : std::true_type {};
+
+// Returns true if no arc or final weight of the (tropical) FST is negative.
+template <class Arc>
+bool HasNonNegativeWeights(const Fst<Arc> &fst) {
+  for (StateIterator<Fst<Arc>> siter(fst); !siter.Done(); siter.Next()) {
+    const auto s = siter.Value();
+    if (fst.Final(s).Value() < 0) return false;
+    for (ArcIterator<Fst<Arc>> aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      if (aiter.Value().weight.Value() < 0) return false;
+    }
+  }
+  return true;
+}
+
 // Helpers.
 
 // Calls RmEpsilon if the FST is not (known to be) epsilon-free.
@@ -51,10 +113,83 @@ void MaybeRmEpsilon(MutableFst<Arc> *fst, bool compute_props = false) {
   }
 }
 
+// Determinizes the FST in place, unless the result would have more than
+// max_states states (when non-negative); then the FST is left unchanged and
+// false is returned. The determinized FST is expanded one state at a time, so
+// that we give up as soon as the budget is exceeded. (The state threshold of
+// DeterminizeOptions cannot be used for this, as it prunes the result instead.)
+template <class Arc>
+bool DeterminizeWithinBudget(MutableFst<Arc> *fst, int64 max_states) {
+  using StateId = typename Arc::StateId;
+  if (max_states < 0) {
+    Determinize(*fst, fst);
+    return true;
+  }
+  VectorFst<Arc> ofst;
+  {
+    const DeterminizeFst<Arc> dfst(*fst);
+    std::unordered_map<StateId, StateId> states;
+    std::queue<StateId> queue;
+    // Maps a state of the delayed FST to one of the output, or to kNoStateId
+    // once the budget is exhausted.
+    const auto find_state = [&](StateId s) -> StateId {
+      const auto it = states.find(s);
+      if (it != states.end()) return it->second;
+      if (ofst.NumStates() >= max_states) return kNoStateId;
+      const auto state = ofst.AddState();
+      states.emplace(s, state);
+      queue.push(s);
+      return state;
+    };
+    const auto start = dfst.Start();
+    if (start != kNoStateId) {
+      const auto ostart = find_state(start);
+      if (ostart == kNoStateId) return false;
+      ofst.SetStart(ostart);
+    }
+    while (!queue.empty()) {
+      const auto s = queue.front();
+      queue.pop();
+      const auto state = states[s];
+      ofst.SetFinal(state, dfst.Final(s));
+      for (ArcIterator<DeterminizeFst<Arc>> aiter(dfst, s); !aiter.Done();
+           aiter.Next()) {
+        auto arc = aiter.Value();
+        arc.nextstate = find_state(arc.nextstate);
+        if (arc.nextstate == kNoStateId) return false;
+        ofst.AddArc(state, arc);
+      }
+    }
+    ofst.SetInputSymbols(dfst.InputSymbols());
+    ofst.SetOutputSymbols(dfst.OutputSymbols());
+    constexpr uint64 kMask = kTrinaryProperties | kError;
+    ofst.SetProperties(dfst.Properties(kMask, false), kMask);
+  }
+  *fst = ofst;
+  return true;
+}
+
+// A cheaper stand-in for determinization and minimization: with the labels and
+// weights encoded, merges the equivalent states of the (possibly
+// non-deterministic) FST.
+template <class Arc>
+void MinimizeEncoded(MutableFst<Arc> *fst) {
+  EncodeMapper<Arc> encoder(kEncodeLabels | kEncodeWeights);
+  Encode(fst, &encoder);
+  Minimize<Arc>(fst, nullptr, kShortestDelta, /*allow_nondet=*/true);
+  Decode(fst, encoder);
+}
+
+// Returns false if determinization would have exceeded the budget, in which
+// case the FST is only minimized as a non-deterministic acceptor.
 template <class Arc>
-void DeterminizeAndMinimize(MutableFst<Arc> *fst) {
-  Determinize(*fst, fst);
+bool DeterminizeAndMinimize(MutableFst<Arc> *fst, int64 max_states = -1) {
+  if (!DeterminizeWithinBudget(fst, max_states)) {
+    MinimizeEncoded(fst);
+    return false;
+  }
   Minimize(fst);
+  return true;
 }
 
 // Optimizes the FST according to the encoder flags:
@@ -63,79 +198,130 @@ void DeterminizeAndMinimize(MutableFst<Arc> *fst) {
 //   kEncodeWeights: optimize as an unweighted transducer
 //   kEncodeLabels | kEncodeWeights: optimize as an unweighted acceptor
 template <class Arc>
-void OptimizeAs(MutableFst<Arc> *fst, uint8 flags) {
+bool OptimizeAs(MutableFst<Arc> *fst, uint8 flags, int64 max_states = -1) {
   EncodeMapper<Arc> encoder(flags);
   Encode(fst, &encoder);
-  DeterminizeAndMinimize(fst);
+  const bool determinized = DeterminizeAndMinimize(fst, max_states);
   Decode(fst, encoder);
+  return determinized;
+}
+
+// Optimizes an FST which may have weighted cycles, according to the strategy.
+// The label flags are kEncodeLabels for a transducer and 0 for an acceptor.
+template <class Arc>
+bool OptimizeWeightedCycles(MutableFst<Arc> *fst, uint8 label_flags,
+                            OptimizeStrategy strategy, int64 max_states) {
+  if constexpr (IsTropicalWeight<typename Arc::Weight>::value) {
+    if (strategy != OPTIMIZE_ENCODE_WEIGHTS && HasNonNegativeWeights(*fst)) {
+      Push(fst, REWEIGHT_TO_INITIAL);
+      // Reweighting may add a new initial state with an epsilon arc.
+      MaybeRmEpsilon(fst);
+      const int64 budget =
+          max_states >= 0
+              ? max_states
+              : kPushStateFactor * std::max<int64>(fst->NumStates(), 1);
+      EncodeMapper<Arc> encoder(label_flags);
+      if (label_flags) Encode(fst, &encoder);
+      // On failure the FST is left unchanged, i.e., pushed, which also helps
+      // the encoding below: equivalent arcs now carry identical weights.
+      const bool determinized = DeterminizeWithinBudget(fst, budget);
+      if (determinized) Minimize(fst);
+      if (label_flags) Decode(fst, encoder);
+      if (determinized) return true;
+      VLOG(1) << "Optimize: determinization of the pushed FST exceeded "
+              << budget << " states; encoding weights instead";
+    }
+  }
+  const bool determinized =
+      OptimizeAs(fst, label_flags | kEncodeWeights, max_states);
+  // Combines any remaining muti-arcs.
+  StateMap(fst, ArcSumMapper<Arc>(*fst));
+  return determinized;
 }
 
 // Generic FST optimization function to be used when the FST is known to be an
 // acceptor.
 template <class Arc>
-void OptimizeAcceptor(MutableFst<Arc> *fst, bool compute_props = false) {
+bool OptimizeAcceptor(MutableFst<Arc> *fst, bool compute_props = false,
+                      int64 max_states = -1,
+                      OptimizeStrategy strategy = OPTIMIZE_ENCODE_WEIGHTS) {
+  bool determinized = true;
   // If the FST is not (known to be) epsilon-free, perform epsilon-removal.
   MaybeRmEpsilon(fst, compute_props);
   if (fst->Properties(kIDeterministic, compute_props) != kIDeterministic) {
     if constexpr ((Arc::Weight::Properties() & kIdempotent) == kIdempotent) {
-      // If the FST is not known to have no weighted cycles, it is encoded
-      // before determinization and minimization.
+      // If the FST is not known to have no weighted cycles, it is pushed or
+      // encoded before determinization and minimization.
       if (!fst->Properties(kDoNotEncodeWeights, compute_props)) {
-        OptimizeAs(fst, kEncodeWeights);
-        // Combines any remaining muti-arcs.
-        StateMap(fst, ArcSumMapper<Arc>(*fst));
+        determinized = OptimizeWeightedCycles(fst, 0, strategy, max_states);
       } else {
-        DeterminizeAndMinimize(fst);
+        determinized = DeterminizeAndMinimize(fst, max_states);
       }
     } else if (fst->Properties(kAcyclic, compute_props) == kAcyclic) {
       // "Any acyclic weighted automaton over a zero-sum-free semiring has
       // the twins property and is determinizable" (Mohri 2006).
-      DeterminizeAndMinimize(fst);
+      determinized = DeterminizeAndMinimize(fst, max_states);
     }
   } else {
     Minimize(fst);
   }
+  return determinized;
 }
 
 // Generic FST optimization function to be used when the FST may be a
 // transducer.
 template <class Arc>
-void OptimizeTransducer(MutableFst<Arc> *fst, bool compute_props = false) {
+bool OptimizeTransducer(MutableFst<Arc> *fst, bool compute_props = false,
+                        int64 max_states = -1,
+                        OptimizeStrategy strategy = OPTIMIZE_ENCODE_WEIGHTS) {
+  bool determinized = true;
   // If the FST is not (known to be) epsilon-free, perform epsilon-removal.
   MaybeRmEpsilon(fst, compute_props);
   if (fst->Properties(kIDeterministic, compute_props) != kIDeterministic) {
     if constexpr ((Arc::Weight::Properties() & kIdempotent) == kIdempotent) {
-      // If the FST is not known to have no weighted cycles, it is encoded
-      // before determinization and minimization.
+      // If the FST is not known to have no weighted cycles, it is pushed or
+      // encoded before determinization and minimization.
       if (!fst->Properties(kDoNotEncodeWeights, compute_props)) {
-        OptimizeAs(fst, kEncodeLabels | kEncodeWeights);
-        // Combines any remaining muti-arcs.
-        StateMap(fst, ArcSumMapper<Arc>(*fst));
+        determinized =
+            OptimizeWeightedCycles(fst, kEncodeLabels, strategy, max_states);
       } else {
-        OptimizeAs(fst, kEncodeLabels);
+        determinized = OptimizeAs(fst, kEncodeLabels, max_states);
       }
     } else if (fst->Properties(kAcyclic, compute_props) == kAcyclic) {
       // "Any acyclic weighted automaton over a zero-sum-free semiring has
       // the twins property and is determinizable" (Mohri 2006).
-      OptimizeAs(fst, kEncodeLabels);
+      determinized = OptimizeAs(fst, kEncodeLabels, max_states);
     }
   } else {
     Minimize(fst);
   }
+  return determinized;
 }
 
 }  // namespace internal
 
 // Generic FST optimization function; use the more-specialized forms below if
 // the FST is known to be an acceptor or a transducer.
+//
+// If max_states is non-negative, determinization is abandoned once it has
+// produced that many states, and the FST is instead minimized without being
+// determinized, which is much cheaper but may leave it larger. Returns false
+// if that happened.
+//
+// The strategy chooses how FSTs which may have weighted cycles are made
+// deterministic; see OptimizeStrategy above.
 template <class Arc>
-void Optimize(MutableFst<Arc> *fst, bool compute_props = false) {
+bool Optimize(MutableFst<Arc> *fst, bool compute_props = false,
+              int64 max_states = -1,
+              OptimizeStrategy strategy = OPTIMIZE_ENCODE_WEIGHTS) {
   if (fst->Properties(kAcceptor, compute_props) != kAcceptor) {
     // The FST is (may be) a transducer.
-    internal::OptimizeTransducer(fst, compute_props);
+    return internal::OptimizeTransducer(fst, compute_props, max_states,
+                                        strategy);
   } else {
     // The FST is (known to be) an acceptor.
-    internal::OptimizeAcceptor(fst, compute_props);
+    return internal::OptimizeAcceptor(fst, compute_props, max_states,
+                                      strategy);
   }
 }
 
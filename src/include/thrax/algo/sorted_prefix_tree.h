@@ -0,0 +1,357 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef FST_UTIL_STRING_SORTED_PREFIX_TREE_H_
+#define FST_UTIL_STRING_SORTED_PREFIX_TREE_H_
+
+// A drop-in replacement for PrefixTree that, as long as the entries arrive in
+// sorted order, builds the minimal acyclic FST directly, as in:
+//
+// Daciuk, J., Mihov, S., Watson, B. W., and Watson, R. E. 2000. Incremental
+// construction of minimal acyclic finite-state automata. Computational
+// Linguistics 26(1): 3-16.
+//
+// Each entry is spelled as the path the prefix tree would build for it: its
+// input labels, then (for transducers) an epsilon bridge and its output labels,
+// ending in a state with the entry's weight. Once an entry has been added, the
+// states of the previous entry's path beyond the prefix the two share can no
+// longer change; they are "frozen" by merging each, bottom-up, with an
+// equivalent state already built, if any, which a hash register finds. Only
+// the current path is kept outside the FST, so memory is bounded by the size
+// of the minimal result, rather than by that of the prefix tree.
+//
+// If an entry arrives out of order, the entries so far are moved to a
+// FlatPrefixTree (by enumerating the paths of the FST built so far), which
+// takes the rest.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <fst/arc.h>
+#include <fst/vector-fst.h>
+#include <thrax/algo/fingerprint.h>
+#include <thrax/algo/flat_prefix_tree.h>
+#include <thrax/algo/prefix_tree.h>
+
+namespace fst {
+namespace internal {
+
+// This class is neither thread-safe nor thread-hostile.
+template <class Arc, class Policy>
+class SortedPrefixTree {
+ public:
+  using Label = typename Arc::Label;
+  using StateId = typename Arc::StateId;
+  using Weight = typename Arc::Weight;
+
+  SortedPrefixTree() : num_registered_(0), shift_(64) { Clear(); }
+
+  // Adds an entry, consisting of two label sequences (each provided as a pair
+  // of iterators) and a weight.
+  template <class Iterator1, class Iterator2, class T>
+  void Add(Iterator1 it1, Iterator1 end1, Iterator2 it2, Iterator2 end2,
+           T &&weight) {
+    if (fallback_) {
+      fallback_->Add(it1, end1, it2, end2, std::forward<T>(weight));
+      return;
+    }
+    word_.clear();
+    for (Label ilabel : fst::make_range(it1, end1)) {
+      if (!ilabel) continue;  // Skips over epsilons.
+      word_.emplace_back(ilabel, Policy::IsAcceptor() ? ilabel : 0);
+    }
+    if constexpr (!Policy::IsAcceptor()) {
+      word_.emplace_back(0, 0);
+      for (Label olabel : fst::make_range(it2, end2)) {
+        if (!olabel) continue;  // Skips over epsilons.
+        word_.emplace_back(0, olabel);
+      }
+    }
+    size_t prefix = 0;
+    while (prefix < word_.size() && prefix < prev_.size() &&
+           word_[prefix] == prev_[prefix]) {
+      ++prefix;
+    }
+    if (has_entries_) {
+      if (prefix == word_.size() && prefix == prev_.size()) {
+        // A repeated entry, whose weights are summed, as in the prefix tree.
+        pending_.back().final = Plus(pending_.back().final, weight);
+        return;
+      }
+      if (prefix == word_.size() ||
+          (prefix < prev_.size() && word_[prefix] < prev_[prefix])) {
+        StartFallback();
+        AddToFallback(word_, std::forward<T>(weight));
+        return;
+      }
+    }
+    has_entries_ = true;
+    while (pending_.size() > prefix + 1) {
+      const auto state = Freeze(pending_.back());
+      pending_.pop_back();
+      pending_.back().arcs.back().nextstate = state;
+    }
+    for (size_t i = prefix; i < word_.size(); ++i) {
+      pending_.back().arcs.emplace_back(word_[i].first, word_[i].second,
+                                        Weight::One(), kNoStateId);
+      pending_.emplace_back();
+    }
+    pending_.back().final = Plus(pending_.back().final, weight);
+    prev_.swap(word_);
+  }
+
+  // With semiring One as a default.
+  template <class Iterator1, class Iterator2>
+  void Add(Iterator1 it1, Iterator1 end1, Iterator2 it2, Iterator2 end2) {
+    Add(it1, end1, it2, end2, Weight::One());
+  }
+
+  template <class Container1, class Container2, class T>
+  void Add(const Container1 &cont1, const Container2 &cont2, T &&weight) {
+    Add(cont1.begin(), cont1.end(), cont2.begin(), cont2.end(),
+        std::forward<T>(weight));
+  }
+
+  // With semiring One as a default.
+  template <class Container1, class Container2>
+  void Add(const Container1 &cont1, const Container2 &cont2) {
+    Add(cont1.begin(), cont1.end(), cont2.begin(), cont2.end(), Weight::One());
+  }
+
+  // Returns false once an entry has arrived out of order.
+  bool Sorted() const { return !fallback_; }
+
+  // Removes all elements from this prefix tree.
+  void Clear() {
+    fallback_.reset();
+    fst_.DeleteStates();
+    ClearRegister();
+    pending_.assign(1, PendingState());
+    prev_.clear();
+    has_entries_ = false;
+  }
+
+  // Writes the current FST to a mutable FST.
+  void ToFst(MutableFst<Arc> *fst) const {
+    if (fallback_) {
+      fallback_->ToFst(fst);
+      return;
+    }
+    fst->DeleteStates();
+    if (!has_entries_) return;
+    *fst = fst_;
+    // Freezes the current path into the copy. Its states cannot be equivalent
+    // to one another, as they all have different heights, so we need only
+    // look for equivalents among the states frozen already.
+    StateId next = kNoStateId;
+    for (auto d = pending_.size(); d-- > 0;) {
+      PendingState state = pending_[d];
+      if (next != kNoStateId) state.arcs.back().nextstate = next;
+      next = Find(state, Hash(state));
+      if (next == kNoStateId) next = AddState(state, fst);
+    }
+    fst->SetStart(next);
+  }
+
+ private:
+  // A state on the path of the last entry, which is not yet in the FST. All
+  // but the last have their last arc leading to the next one.
+  struct PendingState {
+    std::vector<Arc> arcs;
+    Weight final = Weight::Zero();
+  };
+
+  // A frozen state and its hash; the state is kNoStateId for an empty slot.
+  struct RegisterSlot {
+    uint64_t hash;
+    StateId state;
+  };
+
+  static uint64_t Hash(const PendingState &state) {
+    uint64_t hash = state.final.Hash();
+    for (const auto &arc : state.arcs) {
+      hash = FingerprintCombine(hash, arc.ilabel);
+      hash = FingerprintCombine(hash, arc.olabel);
+      hash = FingerprintCombine(hash, arc.nextstate);
+    }
+    return hash;
+  }
+
+  // Returns an equivalent state of the FST, given the hash of the state, or
+  // kNoStateId if there is none.
+  StateId Find(const PendingState &state, uint64_t hash) const {
+    if (register_.empty()) return kNoStateId;
+    const size_t mask = register_.size() - 1;
+    for (size_t slot = Index(hash); register_[slot].state != kNoStateId;
+         slot = (slot + 1) & mask) {
+      if (register_[slot].hash != hash) continue;
+      const auto s = register_[slot].state;
+      if (fst_.Final(s) != state.final) continue;
+      if (fst_.NumArcs(s) != state.arcs.size()) continue;
+      bool equal = true;
+      size_t i = 0;
+      for (ArcIterator<VectorFst<Arc>> aiter(fst_, s); !aiter.Done();
+           aiter.Next(), ++i) {
+        const auto &arc = aiter.Value();
+        const auto &other = state.arcs[i];
+        if (arc.ilabel != other.ilabel || arc.olabel != other.olabel ||
+            arc.nextstate != other.nextstate) {
+          equal = false;
+          break;
+        }
+      }
+      if (equal) return s;
+    }
+    return kNoStateId;
+  }
+
+  static StateId AddState(const PendingState &state, MutableFst<Arc> *fst) {
+    const auto s = fst->AddState();
+    fst->SetFinal(s, state.final);
+    fst->ReserveArcs(s, state.arcs.size());
+    for (const auto &arc : state.arcs) fst->AddArc(s, arc);
+    return s;
+  }
+
+  // Returns the state of the FST for a state of the current path that is no
+  // longer reachable by later entries.
+  StateId Freeze(const PendingState &state) {
+    const auto hash = Hash(state);
+    auto s = Find(state, hash);
+    if (s == kNoStateId) {
+      s = AddState(state, &fst_);
+      Register(hash, s);
+    }
+    return s;
+  }
+
+  // Fibonacci hashing: the top bits of the product.
+  size_t Index(uint64_t hash) const {
+    return (hash * 0x9E3779B97F4A7C15ULL) >> shift_;
+  }
+
+  void Register(uint64_t hash, StateId s) {
+    // Keeps the load at most 1/2.
+    if (2 * (num_registered_ + 1) > register_.size()) Rehash();
+    const size_t mask = register_.size() - 1;
+    size_t i = Index(hash);
+    while (register_[i].state != kNoStateId) i = (i + 1) & mask;
+    register_[i] = {hash, s};
+    ++num_registered_;
+  }
+
+  void Rehash() {
+    std::vector<RegisterSlot> slots(std::max<size_t>(16, 2 * register_.size()),
+                                    RegisterSlot{0, kNoStateId});
+    slots.swap(register_);
+    shift_ = 64;
+    for (size_t size = register_.size(); size > 1; size >>= 1) --shift_;
+    const size_t mask = register_.size() - 1;
+    for (const auto &slot : slots) {
+      if (slot.state == kNoStateId) continue;
+      size_t i = Index(slot.hash);
+      while (register_[i].state != kNoStateId) i = (i + 1) & mask;
+      register_[i] = slot;
+    }
+  }
+
+  void ClearRegister() {
+    register_.clear();
+    num_registered_ = 0;
+    shift_ = 64;
+  }
+
+  // Moves the entries so far into a FlatPrefixTree, by enumerating the paths
+  // of the FST built so far.
+  void StartFallback() {
+    VectorFst<Arc> fst;
+    ToFst(&fst);
+    fst_.DeleteStates();
+    ClearRegister();
+    fallback_ = std::make_unique<FlatPrefixTree<Arc, Policy>>();
+    std::vector<std::pair<Label, Label>> path;
+    // For each state on the path, the index of the next arc to follow.
+    std::vector<std::pair<StateId, size_t>> stack = {{fst.Start(), 0}};
+    AddToFallback(path, fst.Final(fst.Start()));
+    while (!stack.empty()) {
+      auto &top = stack.back();
+      if (top.second == fst.NumArcs(top.first)) {
+        stack.pop_back();
+        if (!path.empty()) path.pop_back();
+        continue;
+      }
+      ArcIterator<VectorFst<Arc>> aiter(fst, top.first);
+      aiter.Seek(top.second++);
+      const auto &arc = aiter.Value();
+      path.emplace_back(arc.ilabel, arc.olabel);
+      AddToFallback(path, fst.Final(arc.nextstate));
+      stack.emplace_back(arc.nextstate, 0);
+    }
+    pending_.assign(1, PendingState());
+    prev_.clear();
+  }
+
+  // Adds an entry, spelled as above, to the fallback prefix tree.
+  void AddToFallback(const std::vector<std::pair<Label, Label>> &word,
+                     Weight weight) {
+    if (weight == Weight::Zero()) return;
+    std::vector<Label> ilabels;
+    std::vector<Label> olabels;
+    for (const auto &symbol : word) {
+      if (symbol.first) ilabels.push_back(symbol.first);
+      if (symbol.second) olabels.push_back(symbol.second);
+    }
+    fallback_->Add(ilabels, olabels, std::move(weight));
+  }
+
+  // The frozen states, which are all distinct.
+  VectorFst<Arc> fst_;
+  // The frozen states, in a table with a power-of-two size, by their hashes.
+  std::vector<RegisterSlot> register_;
+  size_t num_registered_;
+  int shift_;
+  // The states on the path of the last entry, starting with the initial state.
+  std::vector<PendingState> pending_;
+  // The last entry added, and the one being added, spelled as pairs of labels.
+  std::vector<std::pair<Label, Label>> prev_;
+  std::vector<std::pair<Label, Label>> word_;
+  bool has_entries_;
+  // Takes over once an entry arrives out of order.
+  std::unique_ptr<FlatPrefixTree<Arc, Policy>> fallback_;
+
+  SortedPrefixTree(const SortedPrefixTree &) = delete;
+  SortedPrefixTree &operator=(const SortedPrefixTree &) = delete;
+};
+
+}  // namespace internal
+
+template <class Arc>
+using SortedTransducerPrefixTree =
+    internal::SortedPrefixTree<Arc, internal::PrefixTreeTransducerPolicy<Arc>>;
+
+// As with an `AcceptorPrefixTree`, `Add` only looks at the first of the two
+// strings passed.
+template <class Arc>
+using SortedAcceptorPrefixTree =
+    internal::SortedPrefixTree<Arc, internal::PrefixTreeAcceptorPolicy<Arc>>;
+
+}  // namespace fst
+
+#endif  // FST_UTIL_STRING_SORTED_PREFIX_TREE_H_
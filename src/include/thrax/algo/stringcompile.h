@@ -17,6 +17,7 @@
 
 #include <iterator>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -31,9 +32,13 @@
 // FSTs, keeping track of so-called generated labels.
 //
 // As this is a singleton class, the standard way to access it is to
-// define:
+// call:
 //
-//   static StringCompiler *compiler = StringCompiler::Get();
+//   StringCompiler *compiler = StringCompiler::Get();
+//
+// A thread may substitute its own instance for the singleton (see
+// SetThreadCompiler), so that concurrent compilations do not share generated
+// symbols; the result of Get() should therefore not be cached.
 //
 // Input strings can be compiled by viewing them as raw bytes (BYTE),
 // sequences of UTF-8-encoded Unicode codepoints (UTF8), or as a sequence of
@@ -68,6 +73,13 @@ class StringCompiler {
  public:
   static StringCompiler *Get();
 
+  // Returns a new instance, independent of the singleton.
+  static std::unique_ptr<StringCompiler> New();
+
+  // Makes Get() return the provided instance on the calling thread, or the
+  // singleton again if nullptr. The instance is not owned.
+  static void SetThreadCompiler(StringCompiler *compiler);
+
   // Extracts a list of labels from an string. If token_type =
   // TokenType::SYMBOL, then the user must pass a symbol table used to label the
   // string.
@@ -282,7 +294,7 @@ bool StringToLabels(const std::string &str,
                                          std::vector<Label> *labels,
                                          TokenType token_type = TokenType::BYTE,
                                          const SymbolTable *symbols = nullptr) {
-  static auto *compiler = internal::StringCompiler::Get();
+  auto *compiler = internal::StringCompiler::Get();
   return compiler->StringToLabels(str, labels, token_type, symbols);
 }
 
@@ -292,7 +304,7 @@ bool StringCompile(
     TokenType token_type = TokenType::BYTE,
     const SymbolTable *symbols = nullptr,
     typename Arc::Weight weight = Arc::Weight::One()) {
-  static auto *compiler = internal::StringCompiler::Get();
+  auto *compiler = internal::StringCompiler::Get();
   return compiler->Compile(str, fst, token_type, symbols, weight);
 }
 
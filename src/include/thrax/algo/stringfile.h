@@ -16,6 +16,7 @@
 #define FST_UTIL_STRING_STRINGFILE_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <fst/compat.h>
@@ -56,7 +57,14 @@ class StringFile {
   const std::string source_;
 };
 
-// File iterator expecting multiple columns separated by tab.
+// Splits the line at tabs into *columns, skipping empty ones as StringSplit
+// does. The columns point into the line.
+void SplitColumns(std::string_view line,
+                  std::vector<std::string_view> *columns);
+
+// File iterator expecting multiple columns separated by tab. The columns of
+// the current row point into the line buffer, which is reused from one line to
+// the next.
 class ColumnStringFile {
  public:
   explicit ColumnStringFile(const std::string &source) : sf_(source) {
@@ -70,7 +78,7 @@ class ColumnStringFile {
   bool Done() const { return sf_.Done(); }
 
   // Access to the underlying row vector.
-  const std::vector<std::string> &Row() const { return row_; }
+  const std::vector<std::string_view> &Row() const { return row_; }
 
   size_t LineNumber() const { return sf_.LineNumber(); }
 
@@ -79,12 +87,19 @@ class ColumnStringFile {
   bool Error() const { return sf_.Error(); }
 
  private:
-  void Parse() { row_ = ::fst::StringSplit(sf_.GetString(), '\t'); }
+  void Parse() { SplitColumns(sf_.GetString(), &row_); }
 
   StringFile sf_;
-  std::vector<std::string> row_;
+  std::vector<std::string_view> row_;
 };
 
+// Reads the whole file into *contents and splits it, at line boundaries, into
+// at most num_chunks chunks of roughly equal size, which point into *contents.
+// Returns false if the file cannot be read.
+bool ReadStringFileChunks(const std::string &source, int num_chunks,
+                          std::string *contents,
+                          std::vector<std::string_view> *chunks);
+
 }  // namespace internal
 }  // namespace fst
 
@@ -16,10 +16,17 @@
 #define FST_UTIL_STRING_STRINGMAP_H_
 
 // This file contains functions for compiling FSTs from pairs of strings
-// using a prefix tree.
+// using a prefix tree. Sorted input (e.g., a sorted string file) is compiled
+// directly into the minimal FST; see sorted_prefix_tree.h.
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -31,8 +38,10 @@
 #include <fst/string.h>
 #include <fst/symbol-table.h>
 #include <thrax/algo/prefix_tree.h>
+#include <thrax/algo/sorted_prefix_tree.h>
 #include <thrax/algo/stringcompile.h>
 #include <thrax/algo/stringfile.h>
+#include <thrax/algo/stringutil.h>
 
 namespace fst {
 namespace internal {
@@ -84,6 +93,13 @@ class StringMapCompiler {
     return Add(istring, ostring, std::move(weight));
   }
 
+  // Version for strings already converted to labels.
+  template <class Iterator>
+  void AddLabels(Iterator ibegin, Iterator iend, Iterator obegin,
+                 Iterator oend, Weight weight) {
+    ptree_.Add(ibegin, iend, obegin, oend, std::move(weight));
+  }
+
   void Compile(MutableFst<Arc> *fst) const { ptree_.ToFst(fst); }
 
  private:
@@ -95,7 +111,7 @@ class StringMapCompiler {
 };
 
 template <class StringType>
-bool StringMapLineIsAcceptor(std::vector<StringType> line) {
+bool StringMapLineIsAcceptor(const std::vector<StringType> &line) {
   switch (line.size()) {
     case 1:
       return true;
@@ -149,7 +165,7 @@ inline bool StringMapCheckRepresentableAsAcceptor(
 }
 
 template <class StringType>
-bool StringMapCheckRepresentableAsAcceptor(std::vector<StringType> lines,
+bool StringMapCheckRepresentableAsAcceptor(const std::vector<StringType> &lines,
                                            TokenType input_token_type,
                                            TokenType output_token_type,
                                            const SymbolTable *input_symbols,
@@ -164,48 +180,49 @@ bool StringMapCheckRepresentableAsAcceptor(std::vector<StringType> lines,
   return true;
 }
 
+// Adds a row of one to three columns (the input string, the output string and
+// the weight) to the compiler. Returns false if the row is ill-formed.
+template <class Arc, class PTree, class StringType>
+bool StringMapCompilerAddRow(const std::vector<StringType> &line,
+                             StringMapCompiler<Arc, PTree> *compiler) {
+  switch (line.size()) {
+    case 1: {
+      return compiler->Add(std::string(line[0]));
+    }
+    case 2: {
+      return compiler->Add(std::string(line[0]), std::string(line[1]));
+    }
+    case 3: {
+      return compiler->Add(std::string(line[0]), std::string(line[1]),
+                           std::string(line[2]));
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+// If acceptor is non-null, compilation stops at the first row which is not an
+// acceptor line, setting *acceptor to false.
 template <class PTree, class Arc>
 bool StringMapCompile(internal::ColumnStringFile *csf, MutableFst<Arc> *fst,
                       TokenType input_token_type, TokenType output_token_type,
                       const SymbolTable *input_symbols,
-                      const SymbolTable *output_symbols) {
+                      const SymbolTable *output_symbols,
+                      bool *acceptor = nullptr) {
   internal::StringMapCompiler<Arc, PTree> compiler(
       input_token_type, output_token_type, input_symbols, output_symbols);
   for (csf->Reset(); !csf->Done(); csf->Next()) {
     const auto &line = csf->Row();
-    const auto log_line_compilation_error = [&csf, &line]() {
+    if (acceptor && !StringMapLineIsAcceptor(line)) {
+      *acceptor = false;
+      return true;
+    }
+    if (!StringMapCompilerAddRow(line, &compiler)) {
       LOG(ERROR) << "StringFileCompile: Ill-formed line " << csf->LineNumber()
                  << " in file " << csf->Filename() << ": `"
                  << ::fst::StringJoin(line, "\t") << "`";
       return false;
-    };
-    switch (line.size()) {
-      case 1: {
-        if (!compiler.Add(std::string(line[0]))) {
-          log_line_compilation_error();
-          return false;
-        }
-        break;
-      }
-      case 2: {
-        if (!compiler.Add(std::string(line[0]), std::string(line[1]))) {
-          log_line_compilation_error();
-          return false;
-        }
-        break;
-      }
-      case 3: {
-        if (!compiler.Add(std::string(line[0]), std::string(line[1]),
-                          std::string(line[2]))) {
-          log_line_compilation_error();
-          return false;
-        }
-        break;
-      }
-      default: {
-        log_line_compilation_error();
-        return false;
-      }
     }
   }
   compiler.Compile(fst);
@@ -284,7 +301,7 @@ bool StringMapCompile(
 
 template <class Arc, class Container>
 bool StringMapCompileWithAcceptorCheck(
-    Container container, MutableFst<Arc> *fst,
+    const Container &container, MutableFst<Arc> *fst,
     TokenType input_token_type = TokenType::BYTE,
     TokenType output_token_type = TokenType::BYTE,
     const SymbolTable *input_symbols = nullptr,
@@ -294,29 +311,343 @@ bool StringMapCompileWithAcceptorCheck(
           container, input_token_type, output_token_type, input_symbols,
           output_symbols);
   if (representable_as_acceptor) {
-    return internal::StringMapCompile<AcceptorPrefixTree<Arc>>(
+    return internal::StringMapCompile<SortedAcceptorPrefixTree<Arc>>(
         container, fst, input_token_type, output_token_type, input_symbols,
         output_symbols);
   } else {
-    return internal::StringMapCompile<TransducerPrefixTree<Arc>>(
+    return internal::StringMapCompile<SortedTransducerPrefixTree<Arc>>(
         container, fst, input_token_type, output_token_type, input_symbols,
         output_symbols);
   }
 }
 
+// The file version fuses the check with compilation, rather than reading the
+// file twice: it compiles an acceptor until it reaches a row which is not an
+// acceptor line, and only then starts over compiling a transducer.
+template <class Arc>
+bool StringMapCompileWithAcceptorCheck(
+    ColumnStringFile *csf, MutableFst<Arc> *fst,
+    TokenType input_token_type = TokenType::BYTE,
+    TokenType output_token_type = TokenType::BYTE,
+    const SymbolTable *input_symbols = nullptr,
+    const SymbolTable *output_symbols = nullptr) {
+  if (StringMapSameTokenTypeKernel(input_token_type, output_token_type,
+                                   input_symbols, output_symbols)) {
+    bool acceptor = true;
+    if (!internal::StringMapCompile<SortedAcceptorPrefixTree<Arc>>(
+            csf, fst, input_token_type, output_token_type, input_symbols,
+            output_symbols, &acceptor)) {
+      return false;
+    }
+    if (acceptor) return true;
+  }
+  return internal::StringMapCompile<SortedTransducerPrefixTree<Arc>>(
+      csf, fst, input_token_type, output_token_type, input_symbols,
+      output_symbols);
+}
+
+// A chunk of a string file, parsed and converted to labels by a worker thread.
+template <class Arc>
+struct StringFileChunk {
+  using Label = typename Arc::Label;
+  using Weight = typename Arc::Weight;
+
+  // The output of an acceptor line shares the labels of its input.
+  static constexpr uint32_t kSameAsInput = std::numeric_limits<uint32_t>::max();
+
+  // The labels of each entry follow those of the previous one in `labels`.
+  struct Entry {
+    uint32_t ilength;
+    uint32_t olength;
+    Weight weight;
+  };
+
+  // A row left to the calling thread, to be added right before the entry at
+  // `position`. These are the rows with generated symbols, whose labels
+  // depend on the order in which they are first seen, the rows whose strings
+  // may not convert to labels, for which the calling thread reports the error,
+  // and the row which is otherwise ill-formed, if any, which ends the chunk.
+  struct Row {
+    size_t position;
+    size_t line;  // Within the chunk, from 1.
+    std::vector<std::string> columns;
+  };
+
+  std::vector<Label> labels;
+  std::vector<Entry> entries;
+  std::vector<Row> rows;
+  size_t num_lines = 0;
+  bool acceptor = true;  // Whether all the rows are acceptor lines.
+  bool failed = false;
+};
+
+// Returns true if the string is well-formed UTF-8, without overlong encodings,
+// surrogates or code points beyond U+10FFFF.
+inline bool IsStrictUTF8(std::string_view str) {
+  for (size_t i = 0; i < str.size();) {
+    const auto byte = static_cast<unsigned char>(str[i]);
+    size_t length;
+    uint32_t code_point;
+    if (byte < 0x80) {
+      ++i;
+      continue;
+    } else if ((byte & 0xe0) == 0xc0) {
+      length = 2;
+      code_point = byte & 0x1f;
+    } else if ((byte & 0xf0) == 0xe0) {
+      length = 3;
+      code_point = byte & 0x0f;
+    } else if ((byte & 0xf8) == 0xf0) {
+      length = 4;
+      code_point = byte & 0x07;
+    } else {
+      return false;
+    }
+    if (i + length > str.size()) return false;
+    for (size_t j = 1; j < length; ++j) {
+      const auto continuation = static_cast<unsigned char>(str[i + j]);
+      if ((continuation & 0xc0) != 0x80) return false;
+      code_point = (code_point << 6) | (continuation & 0x3f);
+    }
+    static constexpr uint32_t kMinCodePoint[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (code_point < kMinCodePoint[length] || code_point > 0x10ffff ||
+        (code_point >= 0xd800 && code_point <= 0xdfff)) {
+      return false;
+    }
+    i += length;
+  }
+  return true;
+}
+
+// Returns true if StringToLabels is sure to convert the string, which must not
+// contain brackets. Unlike StringToLabels, this logs nothing, so that worker
+// threads can leave reporting errors to the calling thread, which only does so
+// for the lines the sequential version reaches.
+inline bool StringToLabelsSucceeds(const std::string &str,
+                                   TokenType token_type,
+                                   const SymbolTable *symbols) {
+  switch (token_type) {
+    case TokenType::BYTE:
+      return true;
+    case TokenType::UTF8:
+      // Escapes only involve ASCII characters, so they can be ignored.
+      return IsStrictUTF8(str);
+    case TokenType::SYMBOL: {
+      if (str.empty()) return true;
+      if (!symbols) return false;
+      for (const auto token : ::fst::StringSplit(str, ' ')) {
+        if (symbols->Find(token) == kNoSymbol) return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parses the lines of the chunk as StringFile and ColumnStringFile do, and
+// converts the rows to labels. Stops early if an earlier chunk failed. Logs
+// nothing: errors are reported by the calling thread (see StringMapCompile).
+template <class Arc>
+void StringFileEncodeChunk(std::string_view text, int index,
+                           TokenType input_token_type,
+                           TokenType output_token_type,
+                           const SymbolTable *input_symbols,
+                           const SymbolTable *output_symbols,
+                           std::atomic<int> *first_failed,
+                           StringFileChunk<Arc> *chunk) {
+  using Chunk = StringFileChunk<Arc>;
+  using Weight = typename Arc::Weight;
+  const bool same_kernel = StringMapSameTokenTypeKernel(
+      input_token_type, output_token_type, input_symbols, output_symbols);
+  // Buffers reused from one line to the next.
+  std::string line;
+  std::vector<std::string_view> columns;
+  std::string istring;
+  std::string ostring;
+  const auto defer = [chunk, &columns]() {
+    chunk->rows.push_back(
+        {chunk->entries.size(), chunk->num_lines,
+         std::vector<std::string>(columns.begin(), columns.end())});
+  };
+  for (size_t begin = 0; begin < text.size();) {
+    if (first_failed->load(std::memory_order_relaxed) < index) return;
+    size_t end = text.find('\n', begin);
+    if (end == std::string_view::npos) end = text.size();
+    ++chunk->num_lines;
+    line.assign(text.data() + begin, end - begin);
+    begin = end + 1;
+    StripCommentAndRemoveEscape(&line);
+    if (line.empty()) continue;
+    SplitColumns(line, &columns);
+    if (!StringMapLineIsAcceptor(columns)) chunk->acceptor = false;
+    if (columns.empty() || columns.size() > 3) {
+      defer();
+      chunk->failed = true;
+      break;
+    }
+    // Generated symbols may only appear in the input and output strings.
+    const auto strings_end =
+        columns.begin() + std::min<size_t>(columns.size(), 2);
+    if (std::any_of(columns.begin(), strings_end,
+                    [](std::string_view column) {
+                      return column.find_first_of("[]") !=
+                             std::string_view::npos;
+                    })) {
+      defer();
+      continue;
+    }
+    istring.assign(columns[0]);
+    const bool convert_output =
+        !(same_kernel && StringMapLineIsAcceptor(columns));
+    if (convert_output) {
+      ostring.assign(columns.size() > 1 ? columns[1] : columns[0]);
+    }
+    if (!StringToLabelsSucceeds(istring, input_token_type, input_symbols) ||
+        (convert_output && !StringToLabelsSucceeds(ostring, output_token_type,
+                                                   output_symbols))) {
+      defer();
+      continue;
+    }
+    const size_t size = chunk->labels.size();
+    bool ok = StringToLabels(istring, &chunk->labels, input_token_type,
+                             input_symbols);
+    const size_t ilength = chunk->labels.size() - size;
+    uint32_t olength = Chunk::kSameAsInput;
+    if (ok && convert_output) {
+      ok = StringToLabels(ostring, &chunk->labels, output_token_type,
+                          output_symbols);
+      olength = chunk->labels.size() - size - ilength;
+    }
+    auto weight = Weight::One();
+    if (ok && columns.size() == 3) {
+      std::istringstream strm{std::string(columns[2])};
+      strm >> weight;
+      ok = !strm.fail();
+    }
+    if (!ok) {
+      chunk->labels.resize(size);
+      defer();
+      chunk->failed = true;
+      break;
+    }
+    chunk->entries.push_back({static_cast<uint32_t>(ilength), olength,
+                              std::move(weight)});
+  }
+  if (chunk->failed) {
+    // Records the earliest failed chunk.
+    int failed = first_failed->load();
+    while (index < failed &&
+           !first_failed->compare_exchange_weak(failed, index)) {
+    }
+  }
+}
+
+// Adds the chunks, in order, to a single prefix tree, compiling the rows left
+// to this thread as the sequential version does.
+template <class PTree, class Arc>
+bool StringMapCompile(const std::vector<StringFileChunk<Arc>> &chunks,
+                      const std::string &source, MutableFst<Arc> *fst,
+                      TokenType input_token_type, TokenType output_token_type,
+                      const SymbolTable *input_symbols,
+                      const SymbolTable *output_symbols) {
+  using Chunk = StringFileChunk<Arc>;
+  internal::StringMapCompiler<Arc, PTree> compiler(
+      input_token_type, output_token_type, input_symbols, output_symbols);
+  size_t first_line = 0;
+  for (const auto &chunk : chunks) {
+    auto labels = chunk.labels.begin();
+    auto row = chunk.rows.begin();
+    for (size_t i = 0; i <= chunk.entries.size(); ++i) {
+      for (; row != chunk.rows.end() && row->position == i; ++row) {
+        if (!StringMapCompilerAddRow(row->columns, &compiler)) {
+          LOG(ERROR) << "StringFileCompile: Ill-formed line "
+                     << first_line + row->line << " in file " << source
+                     << ": `" << ::fst::StringJoin(row->columns, "\t")
+                     << "`";
+          return false;
+        }
+      }
+      if (i == chunk.entries.size()) break;
+      const auto &entry = chunk.entries[i];
+      const auto iend = labels + entry.ilength;
+      if (entry.olength == Chunk::kSameAsInput) {
+        compiler.AddLabels(labels, iend, labels, iend, entry.weight);
+        labels = iend;
+      } else {
+        const auto oend = iend + entry.olength;
+        compiler.AddLabels(labels, iend, iend, oend, entry.weight);
+        labels = oend;
+      }
+    }
+    first_line += chunk.num_lines;
+  }
+  compiler.Compile(fst);
+  return true;
+}
+
+// Reads the whole file, and parses it and converts it to labels in chunks on
+// separate threads. The entries are then added to the prefix tree in their
+// order in the file, so the result, and the error reported for the first
+// ill-formed line, are those of the sequential version.
+template <class Arc>
+bool StringFileCompileInParallel(const std::string &source,
+                                 MutableFst<Arc> *fst,
+                                 TokenType input_token_type,
+                                 TokenType output_token_type,
+                                 const SymbolTable *input_symbols,
+                                 const SymbolTable *output_symbols,
+                                 int num_threads) {
+  std::string contents;
+  std::vector<std::string_view> texts;
+  if (!ReadStringFileChunks(source, num_threads, &contents, &texts)) {
+    return false;
+  }
+  const int num_chunks = texts.size();
+  std::vector<StringFileChunk<Arc>> chunks(num_chunks);
+  std::atomic<int> first_failed(num_chunks);
+  {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_chunks; ++i) {
+      threads.emplace_back(StringFileEncodeChunk<Arc>, texts[i], i,
+                           input_token_type, output_token_type,
+                           input_symbols, output_symbols, &first_failed,
+                           &chunks[i]);
+    }
+    for (auto &thread : threads) thread.join();
+  }
+  bool acceptor = StringMapSameTokenTypeKernel(
+      input_token_type, output_token_type, input_symbols, output_symbols);
+  for (const auto &chunk : chunks) acceptor = acceptor && chunk.acceptor;
+  if (acceptor) {
+    return StringMapCompile<SortedAcceptorPrefixTree<Arc>>(
+        chunks, source, fst, input_token_type, output_token_type,
+        input_symbols, output_symbols);
+  } else {
+    return StringMapCompile<SortedTransducerPrefixTree<Arc>>(
+        chunks, source, fst, input_token_type, output_token_type,
+        input_symbols, output_symbols);
+  }
+}
+
 }  // namespace internal
 
 // Compiles deterministic FST representing the union of the cross-product of
 // pairs of weighted string cross-products from a TSV file of string triples.
 // It will be an acceptor if all lines represent the same istring and ostring
-// and also the (token_type, symbols) is the same for input and output.
+// and also the (token_type, symbols) is the same for input and output. With
+// more than one thread, the file is parsed in chunks in parallel.
 template <class Arc>
 bool StringFileCompile(
     const std::string &source, MutableFst<Arc> *fst,
     TokenType input_token_type = TokenType::BYTE,
     TokenType output_token_type = TokenType::BYTE,
     const SymbolTable *input_symbols = nullptr,
-    const SymbolTable *output_symbols = nullptr) {
+    const SymbolTable *output_symbols = nullptr, int num_threads = 1) {
+  if (num_threads > 1) {
+    return internal::StringFileCompileInParallel(
+        source, fst, input_token_type, output_token_type, input_symbols,
+        output_symbols, num_threads);
+  }
   internal::ColumnStringFile csf(source);
   if (csf.Error()) return false;  // File opening failed.
   return internal::StringMapCompileWithAcceptorCheck(
@@ -28,6 +28,9 @@ namespace fst {
 // a comment) escape it with '\'; the escaping '\' in "\#" also removed.
 std::string StripCommentAndRemoveEscape(const std::string &line);
 
+// As above, but modifies the line in place.
+void StripCommentAndRemoveEscape(std::string *line);
+
 // Escapes characters (namely, backslash and square brackets) used to indicate
 // generated symbols.
 std::string Escape(const std::string &str);
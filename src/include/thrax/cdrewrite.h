@@ -20,12 +20,32 @@
 // 5.) The string 'ltr', 'rtl', or 'sim' for the direction of rewrite. [opt]
 // 6.) The string 'obl' or 'opt' for the rewrite mode. [opt]
 //
+// 7.) The string 'lazy'. [opt]
+//
 // If arguments 5 and 6 are omitted, we'll perform a left-to-right and
-// obligatory rewrite by default.
+// obligatory rewrite by default. The filters a rule is built from are built on
+// --cdrewrite_threads threads.
+//
+// With 'lazy' as the last argument, the filters are not composed into the rule
+// transducer: the result is their delayed composition, which is only expanded
+// as far as it is used. Exported, the filters are stored separately, and the
+// rule is applied by composing the input with their delayed composition (see
+// AbstractGrmManager). This suits rules over large alphabets which are only
+// applied to short strings; used in further operations in the grammar, such a
+// rule is expanded in full.
+//
+// CDRewriteCascade applies a sequence of such rules, as their composition
+// would, but compiles them together. Its arguments are the tau, lambda and rho
+// of each rule in turn, then sigma*, optionally followed by the direction and
+// mode strings, which apply to all rules, and by a determinization budget of
+// the form 'budget=N' for the optimization after each composition (see
+// Optimize). The rules share the machinery built from sigma, and are compiled
+// on --cdrewrite_threads threads.
 
 #ifndef THRAX_CDREWRITE_H_
 #define THRAX_CDREWRITE_H_
 
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -36,15 +56,30 @@
 #include <fst/fst.h>
 #include <fst/vector-fst.h>
 #include <thrax/algo/cdrewrite.h>
+#include <thrax/algo/composecascade.h>
 #include <thrax/algo/stringcompile.h>
+#include <thrax/compilation-context.h>
 #include <thrax/datatype.h>
 #include <thrax/function.h>
+#include <thrax/optimize.h>
 
 DECLARE_bool(save_symbols);  // From util/flags.cc.
+DECLARE_bool(cdrewrite_cache);  // From util/flags.cc.
+DECLARE_int32(cdrewrite_threads);  // From util/flags.cc.
 
 namespace thrax {
 namespace function {
 
+// Rules in a grammar mostly share their sigma, and often their contexts, so the
+// machines built from these are kept for the whole compilation. Returns nullptr
+// if there is no compilation context or caching is disabled.
+template <typename Arc>
+::fst::CDRewriteCache<Arc>* GetCDRewriteCache() {
+  auto* context = CompilationContext::Current();
+  if (!context || !FST_FLAGS_cdrewrite_cache) return nullptr;
+  return context->GetOrCreate<::fst::CDRewriteCache<Arc>>();
+}
+
 template <typename Arc>
 class CDRewrite : public Function<Arc> {
  public:
@@ -57,11 +92,19 @@ class CDRewrite : public Function<Arc> {
 
   std::unique_ptr<DataType> Execute(
       const std::vector<std::unique_ptr<DataType>>& args) final {
-    if (args.size() != 4 && args.size() != 6) {
-      std::cout << "CDRewrite: Expected 4 or 6 arguments but received "
+    if (args.size() < 4 || args.size() > 7) {
+      std::cout << "CDRewrite: Expected 4 to 7 arguments but received "
                 << args.size() << std::endl;
       return nullptr;
     }
+    // An odd number of arguments ends with 'lazy'.
+    const bool lazy = args.size() % 2;
+    if (lazy && (!args.back()->is<std::string>() ||
+                 *args.back()->get<std::string>() != "lazy")) {
+      std::cout << "CDRewrite: Expected 'lazy' for argument " << args.size()
+                << std::endl;
+      return nullptr;
+    }
     for (int i = 0; i < 4; ++i) {
       if (!args[i]->is<Transducer*>()) {
         std::cout << "CDRewrite: Expect FST for argument " << i + 1
@@ -143,7 +186,7 @@ class CDRewrite : public Function<Arc> {
     }
     ::fst::CDRewriteDirection dir = ::fst::LEFT_TO_RIGHT;
     ::fst::CDRewriteMode mode = ::fst::OBLIGATORY;
-    if (args.size() == 6) {
+    if (args.size() >= 6) {
       for (int i = 4; i < 6; ++i) {
         if (!args[i]->is<std::string>()) {
           std::cout << "CDRewrite: Expected string for argument " << i + 1
@@ -174,9 +217,24 @@ class CDRewrite : public Function<Arc> {
       }
     }
     auto output = std::make_unique<MutableTransducer>();
-    ::fst::CDRewriteCompile(tau, lambda, rho, sigma, output.get(), dir,
-                                mode, ::fst::kBosIndex,
-                                ::fst::kEosIndex);
+    if (lazy) {
+      std::vector<MutableTransducer> components;
+      ::fst::CDRewriteCompileComponents(
+          tau, lambda, rho, sigma, &components, dir, mode, ::fst::kBosIndex,
+          ::fst::kEosIndex, GetCDRewriteCache<Arc>(),
+          FST_FLAGS_cdrewrite_threads);
+      // A rule built directly is a single transducer, returned as usual.
+      if (components.size() > 1) {
+        return std::make_unique<DataType>(MakeCascade(&components, symbols));
+      }
+      *output = components.front();
+    } else {
+      ::fst::CDRewriteCompile(tau, lambda, rho, sigma, output.get(), dir,
+                                  mode, ::fst::kBosIndex,
+                                  ::fst::kEosIndex,
+                                  GetCDRewriteCache<Arc>(),
+                                  FST_FLAGS_cdrewrite_threads);
+    }
     if (FST_FLAGS_save_symbols) {
       output->SetInputSymbols(symbols);
       output->SetOutputSymbols(symbols);
@@ -185,10 +243,124 @@ class CDRewrite : public Function<Arc> {
   }
 
  private:
+  // Sorts the components of a rule for composition and composes them lazily.
+  static std::unique_ptr<Transducer> MakeCascade(
+      std::vector<MutableTransducer>* components,
+      const ::fst::SymbolTable* symbols) {
+    if (FST_FLAGS_save_symbols) {
+      components->front().SetInputSymbols(symbols);
+      components->back().SetOutputSymbols(symbols);
+    }
+    static const ::fst::ILabelCompare<Arc> icomp;
+    typename ::fst::ComposeCascadeFst<Arc>::Components shared;
+    for (auto& component : *components) {
+      ::fst::ArcSort(&component, icomp);
+      shared.push_back(std::make_shared<MutableTransducer>(component));
+    }
+    return std::make_unique<::fst::ComposeCascadeFst<Arc>>(std::move(shared));
+  }
+
   CDRewrite<Arc>(const CDRewrite<Arc>&) = delete;
   CDRewrite<Arc>& operator=(const CDRewrite<Arc>&) = delete;
 };
 
+template <typename Arc>
+class CDRewriteCascade : public Function<Arc> {
+ public:
+  using Transducer = ::fst::Fst<Arc>;
+  using MutableTransducer = ::fst::VectorFst<Arc>;
+
+  CDRewriteCascade() {}
+  ~CDRewriteCascade() final {}
+
+  std::unique_ptr<DataType> Execute(
+      const std::vector<std::unique_ptr<DataType>>& args) final {
+    int num_fsts = 0;
+    while (num_fsts < args.size() && args[num_fsts]->is<Transducer*>())
+      ++num_fsts;
+    if (num_fsts < 4 || num_fsts % 3 != 1) {
+      std::cout << "CDRewriteCascade: Expected tau, lambda and rho for each "
+                << "rule, followed by sigma, but received " << num_fsts
+                << " FSTs" << std::endl;
+      return nullptr;
+    }
+    // As in CDRewrite, the symbol tables must all match, and are removed for
+    // the compilation and put back on the result.
+    std::vector<MutableTransducer> fsts;
+    fsts.reserve(num_fsts);
+    for (int i = 0; i < num_fsts; ++i)
+      fsts.emplace_back(**args[i]->get<Transducer*>());
+    const ::fst::SymbolTable* symbols = nullptr;
+    if (FST_FLAGS_save_symbols) {
+      symbols = (*args[0]->get<Transducer*>())->InputSymbols();  // tau
+      for (int i = 0; i < num_fsts; ++i) {
+        if (!::fst::CompatSymbols(fsts[i].InputSymbols(),
+                                      fsts[i].OutputSymbols()) ||
+            !::fst::CompatSymbols(symbols, fsts[i].InputSymbols())) {
+          std::cout << "CDRewriteCascade: symbol tables of argument " << i + 1
+                    << " must match those of the first" << std::endl;
+          return nullptr;
+        }
+      }
+      for (auto& fst : fsts) {
+        fst.SetInputSymbols(nullptr);
+        fst.SetOutputSymbols(nullptr);
+      }
+    }
+    ::fst::CDRewriteDirection dir = ::fst::LEFT_TO_RIGHT;
+    ::fst::CDRewriteMode mode = ::fst::OBLIGATORY;
+    int64_t max_states = DefaultStateBudget();
+    for (int i = num_fsts; i < args.size(); ++i) {
+      if (!args[i]->is<std::string>()) {
+        std::cout << "CDRewriteCascade: Expected string for argument " << i + 1
+                  << std::endl;
+        return nullptr;
+      }
+      const auto& option = *args[i]->get<std::string>();
+      if (option == "ltr") {
+        dir = ::fst::LEFT_TO_RIGHT;
+      } else if (option == "rtl") {
+        dir = ::fst::RIGHT_TO_LEFT;
+      } else if (option == "sim") {
+        dir = ::fst::SIMULTANEOUS;
+      } else if (option == "obl") {
+        mode = ::fst::OBLIGATORY;
+      } else if (option == "opt") {
+        mode = ::fst::OPTIONAL;
+      } else if (IsStateBudgetOption(option)) {
+        if (!ParseStateBudget("CDRewriteCascade", option, &max_states))
+          return nullptr;
+      } else {
+        std::cout << "CDRewriteCascade: Invalid option: " << option
+                  << std::endl;
+        return nullptr;
+      }
+    }
+    std::vector<::fst::CDRewriteCascadeRule<Arc>> rules;
+    for (int i = 0; i + 1 < num_fsts; i += 3)
+      rules.push_back({&fsts[i], &fsts[i + 1], &fsts[i + 2]});
+    auto output = std::make_unique<MutableTransducer>();
+    if (!::fst::CDRewriteCascadeCompile(
+            rules, fsts.back(), output.get(), dir, mode, ::fst::kBosIndex,
+            ::fst::kEosIndex, GetCDRewriteCache<Arc>(),
+            FST_FLAGS_cdrewrite_threads, max_states)) {
+      VLOG(1) << "CDRewriteCascade: determinization exceeded " << max_states
+              << " states; minimized without determinizing";
+      if (auto* context = CompilationContext::Current())
+        context->NoteOptimizeFallback();
+    }
+    if (FST_FLAGS_save_symbols) {
+      output->SetInputSymbols(symbols);
+      output->SetOutputSymbols(symbols);
+    }
+    return std::make_unique<DataType>(std::move(output));
+  }
+
+ private:
+  CDRewriteCascade<Arc>(const CDRewriteCascade<Arc>&) = delete;
+  CDRewriteCascade<Arc>& operator=(const CDRewriteCascade<Arc>&) = delete;
+};
+
 }  // namespace function
 }  // namespace thrax
 
@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 
 #include <fstream>
@@ -31,6 +32,11 @@
 
 #include <fst/compat.h>
 
+// OpenFst's logging has VLOG but not VLOG_IS_ON.
+#ifndef VLOG_IS_ON
+#define VLOG_IS_ON(level) ((level) <= FST_FLAGS_v)
+#endif
+
 namespace thrax {
 
 // Operations on strings.
@@ -72,6 +78,29 @@ void ReadFileToStringOrDie(const std::string &filename, std::string *store);
 
 bool RecursivelyCreateDir(const std::string &path);
 
+// Creates an empty file with a unique name in the directory of the path, for
+// writing a new version of the file which is then renamed over it. Neither
+// readers nor concurrent writers thus see a partially written file. Returns
+// the name of the temporary file, or the empty string on failure.
+std::string MakeTempFileFor(const std::string &path);
+
+// What we remember about a file to decide whether it changed.
+struct FileStamp {
+  bool exists = false;
+  int64_t mtime_ns = 0;
+  int64_t size = 0;
+
+  bool operator==(const FileStamp &other) const {
+    return exists == other.exists && mtime_ns == other.mtime_ns &&
+           size == other.size;
+  }
+
+  bool operator!=(const FileStamp &other) const { return !(*this == other); }
+};
+
+// Returns the stamp of the file, which is missing if the file cannot be found.
+FileStamp StatFile(const std::string &path);
+
 class File {
  public:
   File() {}
@@ -0,0 +1,214 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// The state of a single grammar compilation.
+
+#ifndef THRAX_COMPILATION_CONTEXT_H_
+#define THRAX_COMPILATION_CONTEXT_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/algo/stringcompile.h>
+#include <thrax/compile-profiler.h>
+#include <thrax/evaluation-cache.h>
+#include <thrax/spill-store.h>
+
+namespace thrax {
+
+// Holds one object of each type asked for, default-constructing it on first
+// use. This lets templated code, such as the evaluator, keep state per arc
+// type in a non-templated owner.
+class TypedSlots {
+ public:
+  TypedSlots() {}
+
+  template <class T>
+  T* GetOrCreate() {
+    auto& slot = slots_[&SlotKey<T>::kKey];
+    if (!slot) slot = std::make_unique<Slot<T>>();
+    return &static_cast<Slot<T>*>(slot.get())->value;
+  }
+
+ private:
+  struct SlotBase {
+    virtual ~SlotBase() {}
+  };
+
+  template <class T>
+  struct Slot : public SlotBase {
+    T value;
+  };
+
+  // The address of kKey identifies the type.
+  template <class T>
+  struct SlotKey {
+    static const char kKey;
+  };
+
+  std::map<const void*, std::unique_ptr<SlotBase>> slots_;
+
+  TypedSlots(const TypedSlots&) = delete;
+  TypedSlots& operator=(const TypedSlots&) = delete;
+};
+
+template <class T>
+const char TypedSlots::SlotKey<T>::kKey = 0;
+
+// State kept across the compilations of a long-running process, such as
+// thraxcompile-server: the evaluation cache, so that rules whose inputs did not
+// change are not recomputed, and whatever else the compilations keep in its
+// slots (e.g., the parsed grammars). The compilations sharing it must run one
+// at a time.
+class PersistentState {
+ public:
+  // Caches up to the given number of bytes of results; 0 disables the cache.
+  explicit PersistentState(int64_t evaluation_cache_bytes);
+
+  ~PersistentState();
+
+  // Returns nullptr if not caching.
+  EvaluationCache* evaluation_cache() { return evaluation_cache_.get(); }
+
+  // Returns the object of type T held across compilations (see TypedSlots).
+  template <class T>
+  T* GetOrCreate() {
+    return slots_.GetOrCreate<T>();
+  }
+
+ private:
+  std::unique_ptr<EvaluationCache> evaluation_cache_;
+  // Declared last so that its objects are destroyed first.
+  TypedSlots slots_;
+
+  PersistentState(const PersistentState&) = delete;
+  PersistentState& operator=(const PersistentState&) = delete;
+};
+
+// Holds everything a compilation shares between the top-level grammar and the
+// grammars it imports: the grammars loaded along the way, the labels generated
+// for bracketed symbols (and how to remap those of imported archives), the
+// evaluation cache, the spill store and the profiler. Compilations with
+// separate contexts can run concurrently on different threads.
+//
+// The context is made current on the compiling thread, which is how code deep
+// in the evaluation, such as the C++ functions, finds it.
+class CompilationContext {
+ public:
+  // Sets up the evaluation cache, the spill store and the profiler as requested
+  // by the flags.
+  CompilationContext();
+
+  // As above, but uses the evaluation cache of the persistent state (which is
+  // not owned) rather than one of its own.
+  explicit CompilationContext(PersistentState* persistent);
+
+  ~CompilationContext();
+
+  // Returns the context of the compilation running on this thread, or nullptr
+  // if there is none.
+  static CompilationContext* Current();
+
+  // Makes the context (and its generated symbols) current on this thread for
+  // the lifetime of the object.
+  class Scope {
+   public:
+    explicit Scope(CompilationContext* context);
+
+    ~Scope();
+
+   private:
+    CompilationContext* prev_;
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+  // A number unique to this context among those created by the process. The
+  // cached results of grammar functions are keyed by it, since their bodies
+  // may generate labels and so are only valid within one compilation.
+  int64_t serial() const { return serial_; }
+
+  // Returns nullptr if not profiling.
+  CompileProfiler* profiler() { return profiler_.get(); }
+
+  // Returns nullptr if not caching.
+  EvaluationCache* evaluation_cache() { return evaluation_cache_; }
+
+  // Returns nullptr if the context was not given a persistent state.
+  PersistentState* persistent() { return persistent_; }
+
+  // Returns nullptr if there is no memory budget.
+  SpillStore* spill_store() { return spill_store_.get(); }
+
+  // Keeps account of the (estimated) bytes held by the FSTs bound to variables,
+  // and of the peak.
+  void AddLiveFstBytes(int64_t bytes) {
+    live_fst_bytes_ += bytes;
+    if (live_fst_bytes_ > peak_live_fst_bytes_)
+      peak_live_fst_bytes_ = live_fst_bytes_;
+  }
+
+  int64_t live_fst_bytes() const { return live_fst_bytes_; }
+
+  int64_t peak_live_fst_bytes() const { return peak_live_fst_bytes_; }
+
+  // Counts the optimizations that exceeded their determinization budget (see
+  // optimize.h).
+  void NoteOptimizeFallback() { ++optimize_fallbacks_; }
+
+  int64_t optimize_fallbacks() const { return optimize_fallbacks_; }
+
+  // Maps the generated labels of the archive being imported to the ones of
+  // this compilation.
+  std::map<int64_t, int64_t>* label_remap() { return &label_remap_; }
+
+  // Returns the object of type T held by the context (see TypedSlots), which
+  // lives as long as the compilation.
+  template <class T>
+  T* GetOrCreate() {
+    return slots_.GetOrCreate<T>();
+  }
+
+  // Logs the peak live FST bytes (with -v=1) and the cache and spill
+  // statistics, and writes the profile if requested by the flags. Call this
+  // once the compilation is complete.
+  void Report() const;
+
+ private:
+  const int64_t serial_;
+  std::unique_ptr<::fst::internal::StringCompiler> string_compiler_;
+  std::map<int64_t, int64_t> label_remap_;
+  std::unique_ptr<CompileProfiler> profiler_;
+  PersistentState* persistent_;
+  std::unique_ptr<EvaluationCache> owned_evaluation_cache_;
+  EvaluationCache* evaluation_cache_;
+  std::unique_ptr<SpillStore> spill_store_;
+  int64_t live_fst_bytes_;
+  int64_t peak_live_fst_bytes_;
+  int64_t optimize_fallbacks_;
+  // Declared last so that its objects (e.g., the loaded grammars) are
+  // destroyed first.
+  TypedSlots slots_;
+
+  CompilationContext(const CompilationContext&) = delete;
+  CompilationContext& operator=(const CompilationContext&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_COMPILATION_CONTEXT_H_
@@ -0,0 +1,172 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A profiler for grammar compilation. The evaluator opens a (nested) record for
+// every rule, function call and implicit optimization it performs, noting the
+// grammar location, the wall time spent and the sizes of the FSTs going in and
+// out. The records can be written as a Chrome trace (for chrome://tracing or
+// Perfetto) and as a summary table of the most expensive grammar lines.
+
+#ifndef THRAX_COMPILE_PROFILER_H_
+#define THRAX_COMPILE_PROFILER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <fst/expanded-fst.h>
+#include <fst/fst.h>
+#include <fst/properties.h>
+
+DECLARE_string(profile_trace);
+DECLARE_string(profile_summary);
+
+namespace thrax {
+
+class CompileProfiler {
+ public:
+  // Size of an FST going into or coming out of an operation. Counts are -1 if
+  // the FST is delayed, since counting its states would expand it. The size of
+  // a delayed result is instead recorded as an input of the operation that
+  // expands it: an implicit optimization or an export.
+  struct FstSize {
+    int64_t states = -1;
+    int64_t arcs = -1;
+  };
+
+  CompileProfiler();
+
+  // Returns true if profiling was requested on the command line.
+  static bool Enabled() {
+    return !FST_FLAGS_profile_trace.empty() ||
+           !FST_FLAGS_profile_summary.empty();
+  }
+
+  template <typename Arc>
+  static FstSize SizeOf(const ::fst::Fst<Arc>& fst) {
+    FstSize size;
+    if (!fst.Properties(::fst::kExpanded, false)) return size;
+    const auto& efst = static_cast<const ::fst::ExpandedFst<Arc>&>(fst);
+    size.states = efst.NumStates();
+    size.arcs = 0;
+    for (typename Arc::StateId s = 0; s < size.states; ++s)
+      size.arcs += efst.NumArcs(s);
+    return size;
+  }
+
+  // Opens a record. Records opened while another is open are nested in it.
+  void Begin(const std::string& file, int line, const std::string& name);
+
+  // Adds the size of one input FST to the innermost open record.
+  void AddInput(const FstSize& size);
+
+  // Marks the innermost open record as served from the evaluation cache,
+  // saving the given time.
+  void NoteCacheHit(double saved_seconds);
+
+  // Closes the innermost open record.
+  void End(const FstSize& output);
+
+  // Writes all records in the Chrome trace event format.
+  bool WriteTrace(const std::string& path) const;
+
+  // Writes a table of the grammar lines sorted by the time spent on them (not
+  // counting time spent in nested records).
+  void WriteSummary(std::ostream& strm) const;
+
+  bool WriteSummary(const std::string& path) const;
+
+  // Writes whichever outputs were requested with --profile_trace and
+  // --profile_summary.
+  bool WriteRequestedOutputs() const;
+
+ private:
+  struct Record {
+    std::string file;
+    int line;
+    std::string name;
+    double begin_us;
+    double duration_us;
+    double self_us;
+    int64_t input_states;
+    int64_t input_arcs;
+    int64_t output_states;
+    int64_t output_arcs;
+    int64_t peak_rss_kb;
+    // Time it would have taken without the evaluation cache.
+    double saved_us;
+  };
+
+  double Now() const;
+
+  const std::chrono::steady_clock::time_point start_;
+  std::vector<Record> records_;
+  // Indices of the currently open records, innermost last.
+  std::vector<size_t> open_;
+
+  CompileProfiler(const CompileProfiler&) = delete;
+  CompileProfiler& operator=(const CompileProfiler&) = delete;
+};
+
+// Opens a record for the lifetime of the object. Does nothing if the profiler
+// is null, so callers need not check whether profiling is enabled. The record
+// is named by the kind of operation, followed by its subject if any (e.g.,
+// "rule" and the rule name); the name is only put together when profiling.
+class ProfileScope {
+ public:
+  ProfileScope(CompileProfiler* profiler, std::string_view file, int line,
+               std::string_view kind, std::string_view subject = {})
+      : profiler_(profiler) {
+    if (!profiler_) return;
+    std::string name(kind);
+    if (!subject.empty()) name.append(" ").append(subject);
+    profiler_->Begin(std::string(file), line, name);
+  }
+
+  ~ProfileScope() {
+    if (profiler_) profiler_->End(output_);
+  }
+
+  bool active() const { return profiler_ != nullptr; }
+
+  template <typename Arc>
+  void AddInput(const ::fst::Fst<Arc>& fst) {
+    if (profiler_) profiler_->AddInput(CompileProfiler::SizeOf(fst));
+  }
+
+  void NoteCacheHit(double saved_seconds) {
+    if (profiler_) profiler_->NoteCacheHit(saved_seconds);
+  }
+
+  template <typename Arc>
+  void SetOutput(const ::fst::Fst<Arc>& fst) {
+    if (profiler_) output_ = CompileProfiler::SizeOf(fst);
+  }
+
+ private:
+  CompileProfiler* profiler_;
+  CompileProfiler::FstSize output_;
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_COMPILE_PROFILER_H_
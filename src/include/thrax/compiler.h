@@ -37,8 +37,7 @@ bool CompileGrammar(const std::string& input_grammar,
     return grammar.PrintAst(line_numbers_in_ast);
   } else if (grammar.EvaluateAst()) {
     const GrmManagerSpec<Arc>* manager = grammar.GetGrmManager();
-    manager->ExportFar(output_far);
-    return true;
+    return manager->ExportFar(output_far);
   }
   return false;
 }
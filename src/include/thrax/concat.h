@@ -14,7 +14,8 @@
 //
 // Wrapper for the concatenation function, which expands the second argument and
 // concatenates into there (destructive-mode) or just uses ConcatFst
-// (delayed-mode).
+// (delayed-mode). In destructive mode, any number of arguments may be given;
+// the evaluator uses this to build chains like a b c in one operation.
 
 #ifndef THRAX_CONCAT_H_
 #define THRAX_CONCAT_H_
@@ -47,29 +48,38 @@ class Concat : public BinaryFstFunction<Arc> {
   std::unique_ptr<Transducer> BinaryFstExecute(
       const Transducer& left, const Transducer& right,
       const std::vector<std::unique_ptr<DataType>>& args) final {
-    if (args.size() != 2) {
-      std::cout << "Concat: Expected 2 arguments but got " << args.size()
-                << std::endl;
-      return nullptr;
-    }
-    if (FST_FLAGS_save_symbols) {
-      if (!::fst::CompatSymbols(left.InputSymbols(),
-                                    right.InputSymbols())) {
-        std::cout << "Concat: input symbol table of 1st argument "
-                  << "does not match input symbol table of 2nd argument"
+    for (int i = 2; i < args.size(); ++i) {
+      if (!args[i]->is<Transducer*>()) {
+        std::cout << "Concat: Expected FST for argument " << i + 1
                   << std::endl;
         return nullptr;
       }
-      if (!::fst::CompatSymbols(left.OutputSymbols(),
-                                    right.OutputSymbols())) {
-        std::cout << "Concat: output symbol table of 1st argument "
-                  << "does not match output symbol table of 2nd argument"
-                  << std::endl;
-        return nullptr;
+    }
+    if (FST_FLAGS_save_symbols) {
+      for (int i = 1; i < args.size(); ++i) {
+        const Transducer& fst = **args[i]->get<Transducer*>();
+        if (!::fst::CompatSymbols(left.InputSymbols(), fst.InputSymbols())) {
+          std::cout << "Concat: input symbol table of 1st argument "
+                    << "does not match input symbol table of argument "
+                    << i + 1 << std::endl;
+          return nullptr;
+        }
+        if (!::fst::CompatSymbols(left.OutputSymbols(),
+                                  fst.OutputSymbols())) {
+          std::cout << "Concat: output symbol table of 1st argument "
+                    << "does not match output symbol table of argument "
+                    << i + 1 << std::endl;
+          return nullptr;
+        }
       }
     }
-    auto mutable_right = std::make_unique<MutableTransducer>(right);
-    ::fst::Concat(left, mutable_right.get());
+    // Prepending each argument to the expanded copy of the last one, right to
+    // left, only visits each argument once (appending would rescan the growing
+    // result for its final states every time).
+    auto mutable_right = std::make_unique<MutableTransducer>(
+        **args.back()->get<Transducer*>());
+    for (int i = args.size() - 2; i >= 0; --i)
+      ::fst::Concat(**args[i]->get<Transducer*>(), mutable_right.get());
     return mutable_right;
   }
 
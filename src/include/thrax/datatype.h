@@ -30,6 +30,8 @@
 
 namespace thrax {
 
+class EvaluationKey;
+
 template <typename T>
 struct is_fst_raw_ptr : std::false_type {};
 template <typename Arc>
@@ -37,6 +39,12 @@ struct is_fst_raw_ptr<::fst::Fst<Arc> *> : std::true_type {};
 template <typename T>
 inline constexpr bool is_fst_raw_ptr_v = is_fst_raw_ptr<T>::value;
 
+// Symbol tables and strings are shared by all copies of a DataType (and so are
+// immutable once stored).
+template <typename T>
+inline constexpr bool is_shared_data_type_v =
+    std::is_same_v<T, ::fst::SymbolTable> || std::is_same_v<T, std::string>;
+
 class DataType {
  public:
   explicit DataType(std::unique_ptr<::fst::Fst<::fst::StdArc>> thing)
@@ -45,10 +53,16 @@ class DataType {
       : thing_(thing.release()) {}
   explicit DataType(std::unique_ptr<::fst::Fst<::fst::Log64Arc>> thing)
       : thing_(thing.release()) {}
-  explicit DataType(const ::fst::SymbolTable &thing) : thing_(thing) {}
-  explicit DataType(const std::string &thing) : thing_(thing) {}
+  explicit DataType(const ::fst::SymbolTable &thing)
+      : thing_(std::make_shared<const ::fst::SymbolTable>(thing)) {}
+  explicit DataType(std::shared_ptr<const ::fst::SymbolTable> thing)
+      : thing_(std::move(thing)) {}
+  explicit DataType(std::string thing)
+      : thing_(std::make_shared<const std::string>(std::move(thing))) {}
   explicit DataType(int thing) : thing_(thing) {}
 
+  // Copies are cheap: FSTs are copied shallowly, and symbol tables and strings
+  // are shared.
   std::unique_ptr<DataType> Copy() const {
     // NB: We can't directly create a private constructor from `ThingType` for
     // this purpose since `std::variant` makes its constituent types implicitly
@@ -63,6 +77,7 @@ class DataType {
             return ThingType{arg};
         },
         thing_);
+    out->key_ = key_;
     return out;
   }
 
@@ -77,26 +92,50 @@ class DataType {
 
   template <typename T>
   bool is() const {
-    return std::holds_alternative<T>(thing_);
+    return std::holds_alternative<Stored<T>>(thing_);
   }
 
   template <typename T>
   const T* get() const {
-    return std::get_if<T>(&thing_);
+    const auto *stored = std::get_if<Stored<T>>(&thing_);
+    if constexpr (is_shared_data_type_v<T>) {
+      return stored ? stored->get() : nullptr;
+    } else {
+      return stored;
+    }
   }
 
+  // Shared values cannot be modified in place.
   template <typename T>
   T* get_mutable() {
+    static_assert(!is_shared_data_type_v<T>, "Shared values are immutable");
     return std::get_if<T>(&thing_);
   }
 
+  // The key identifying the value, or nullptr if none has been made yet. It is
+  // derived from the contents of the value or, for the result of a pure
+  // function, from the function name and the keys of its arguments. Copies
+  // share the key. See evaluation-cache.h.
+  const std::shared_ptr<const EvaluationKey> &key() const { return key_; }
+
+  void set_key(std::shared_ptr<const EvaluationKey> key) {
+    key_ = std::move(key);
+  }
+
  private:
   using ThingType = std::variant<::fst::Fst<::fst::StdArc> *,
                                   ::fst::Fst<::fst::LogArc> *,
                                   ::fst::Fst<::fst::Log64Arc> *,
-                                  ::fst::SymbolTable, std::string, int>;
+                                  std::shared_ptr<const ::fst::SymbolTable>,
+                                  std::shared_ptr<const std::string>, int>;
+
+  // The type in the variant that holds a T.
+  template <typename T>
+  using Stored = std::conditional_t<is_shared_data_type_v<T>,
+                                    std::shared_ptr<const T>, T>;
 
   ThingType thing_;
+  std::shared_ptr<const EvaluationKey> key_;
   DataType() : thing_() {}
   DataType(const DataType &) = delete;
   DataType &operator=(const DataType &) = delete;
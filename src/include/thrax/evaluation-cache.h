@@ -0,0 +1,170 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Memoization of function results during grammar evaluation.
+//
+// Every value the evaluator computes can carry a key (see DataType). Leaves
+// (strings, numbers, symbol tables and expanded FSTs) are keyed by their
+// contents. The key of the result of a pure function is the function name and
+// the keys of its arguments, which costs nothing to build and also works for
+// delayed FSTs. Identical sub-expressions anywhere in a grammar thus get equal
+// keys, and the EvaluationCache maps those keys to the values already computed
+// for them.
+//
+// Keys are looked up by a 64-bit fingerprint, but a hit is only taken once the
+// keys have been compared in full. Leaf strings and numbers are kept and
+// compared as such, symbol tables by their MD5 checksum, and FSTs by a second,
+// independent 64-bit fingerprint. Keys thus hold no FSTs, which would keep
+// variables in memory after they are freed or spilled.
+//
+// The cache is off by default (--evaluation_cache_mb=0): fingerprinting leaves
+// and comparing keys costs time of its own, which only pays off for grammars
+// that repeat expensive sub-expressions.
+
+#ifndef THRAX_EVALUATION_CACHE_H_
+#define THRAX_EVALUATION_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/datatype.h>
+
+DECLARE_int64(evaluation_cache_mb);
+DECLARE_bool(memoize_functions);
+
+namespace thrax {
+
+// The full identity of a value: either the value itself (a leaf), or the
+// operation and the keys of the arguments that the value was computed from.
+// Keys are immutable, and shared by all copies of a value.
+class EvaluationKey {
+ public:
+  // Returns the key of the value itself, which must not be a delayed FST.
+  static std::shared_ptr<const EvaluationKey> Leaf(const DataType& value);
+
+  // Returns the key for the result of applying the named operation to values
+  // with the given keys.
+  static std::shared_ptr<const EvaluationKey> Derived(
+      const std::string& operation,
+      std::vector<std::shared_ptr<const EvaluationKey>> arguments);
+
+  // A hash of the key; equal keys have equal fingerprints.
+  uint64_t fingerprint() const { return fingerprint_; }
+
+  // Returns true if the keys identify the same value. The fingerprints only
+  // tell most unequal keys apart quickly; otherwise, the keys are compared in
+  // full, down to the leaves.
+  bool Equals(const EvaluationKey& other) const;
+
+  // Estimates the memory held by the key and the keys it is derived from, each
+  // counted once.
+  int64_t Bytes() const;
+
+ private:
+  EvaluationKey() {}
+
+  uint64_t fingerprint_ = 0;
+  bool leaf_ = false;
+  // For a leaf, the string or number, or the name and checksum of the symbol
+  // table; empty for an FST.
+  std::string contents_;
+  // For a leaf FST, its fingerprint with another seed; for other leaves, the
+  // kind of value; 0 for derived keys.
+  uint64_t check_ = 0;
+  // Empty for a leaf.
+  std::string operation_;
+  std::vector<std::shared_ptr<const EvaluationKey>> arguments_;
+
+  EvaluationKey(const EvaluationKey&) = delete;
+  EvaluationKey& operator=(const EvaluationKey&) = delete;
+};
+
+// Returns the key of the value, making the value its own key if it does not
+// have one yet. Returns nullptr if the value is a delayed FST without a key,
+// since hashing it would expand it.
+std::shared_ptr<const EvaluationKey> GetEvaluationKey(DataType* value);
+
+// Estimates the memory held by the value, in bytes. Delayed FSTs are counted
+// as empty, since their size depends on how much of them gets expanded.
+int64_t EstimateDataTypeBytes(const DataType& value);
+
+// A least-recently-used map from fingerprints to values, bounded by the
+// estimated size of the values it holds.
+class EvaluationCache {
+ public:
+  explicit EvaluationCache(int64_t max_bytes);
+
+  // Returns true for functions whose results depend only on their arguments.
+  // The assertions are excluded since calling them is the point, and so are
+  // the functions which read files or generate labels, since their results
+  // also depend on the files and on the labels generated so far. The results
+  // of these are keyed by their contents instead.
+  static bool IsPureFunction(const std::string& function_name);
+
+  // Returns true if the result of this call depends only on its arguments:
+  // either the function is pure, or it is StringFst compiling a literal without
+  // generated labels.
+  static bool IsPureCall(
+      const std::string& function_name,
+      const std::vector<std::unique_ptr<DataType>>* arguments);
+
+  // Returns a copy of the value cached under the key, or nullptr. On a hit,
+  // *seconds is set to the time it took to compute the value originally.
+  std::unique_ptr<DataType> Find(const EvaluationKey& key, double* seconds);
+
+  // Caches a copy of the value, which took the given time to compute. Delayed
+  // FSTs are not cached: they would pin their inputs in memory without being
+  // accounted for. The key is accounted for with the value.
+  void Insert(std::shared_ptr<const EvaluationKey> key, const DataType& value,
+              double seconds);
+
+  int64_t lookups() const { return lookups_; }
+
+  int64_t hits() const { return hits_; }
+
+  // Returns a one-line summary of the hit rate and the time saved.
+  std::string Stats() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const EvaluationKey> key;
+    std::unique_ptr<DataType> value;
+    int64_t bytes;
+    double seconds;
+  };
+
+  const int64_t max_bytes_;
+  int64_t bytes_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  int64_t lookups_;
+  int64_t hits_;
+  // Lookups whose fingerprint matched an entry with a different key.
+  int64_t collisions_;
+  double saved_seconds_;
+
+  EvaluationCache(const EvaluationCache&) = delete;
+  EvaluationCache& operator=(const EvaluationCache&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_EVALUATION_CACHE_H_
@@ -15,6 +15,7 @@
 #ifndef THRAX_EVALUATOR_H_
 #define THRAX_EVALUATOR_H_
 
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
@@ -24,6 +25,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <fst/compat.h>
@@ -47,9 +49,15 @@
 #include <thrax/rule-node.h>
 #include <thrax/statement-node.h>
 #include <thrax/string-node.h>
+#include <thrax/abstract-grm-manager.h>
 #include <thrax/grm-compiler.h>
-#include <thrax/identifier-counter.h>
+#include <thrax/compilation-context.h>
+#include <thrax/compile-profiler.h>
+#include <thrax/evaluation-cache.h>
+#include <thrax/liveness-analyzer.h>
 #include <thrax/printer.h>
+#include <thrax/purity-checker.h>
+#include <thrax/spill-store.h>
 #include <thrax/datatype.h>
 #include <thrax/function.h>
 #include <thrax/optimize.h>
@@ -57,6 +65,7 @@
 #include <thrax/symbols.h>
 #include <thrax/namespace.h>
 #include <thrax/walker.h>
+#include <thrax/algo/composecascade.h>
 #include <unordered_set>
 #include <fst/compat.h>
 #include <thrax/compat/stlfunctions.h>
@@ -90,20 +99,29 @@ function::Function<::fst::LogArc>* GetFunction(
 template <typename Arc>
 class GrmCompilerSpec;
 
+template <typename Arc>
+class ParsedGrammarCache;
+
 template <typename Arc>
 class AstEvaluator : public AstWalker {
  public:
   using Transducer = ::fst::Fst<Arc>;
   using MutableTransducer = ::fst::VectorFst<Arc>;
   using LabelMapper = std::map<int64_t, int64_t>;
+  // The grammars opened by imports during a compilation, kept in its context.
+  using LoadedGrammars = std::vector<std::shared_ptr<GrmCompilerSpec<Arc>>>;
 
   // This constructor sets up the evaluator to run all nodes using a new
   // environment namespace.
   AstEvaluator()
       : AstWalker(),
         env_(new Namespace()),
-        id_counter_(nullptr),
         run_all_(true),
+        context_(nullptr),
+        profiler_(nullptr),
+        cache_(nullptr),
+        clock_(0),
+        spill_store_(nullptr),
         return_value_(nullptr),
         success_(true),
         optimize_embedding_(-1) {
@@ -112,7 +130,7 @@ class AstEvaluator : public AstWalker {
     env_->SetTopLevel();
     // If we're parsing the entire file, then we need some space for local
     // variables (as we actually execute the body).
-    env_->PushLocalEnvironment();
+    PushFrame();
   }
 
   // This constructor will only run import and function nodes, loading them into
@@ -120,8 +138,12 @@ class AstEvaluator : public AstWalker {
   explicit AstEvaluator(Namespace* env)
       : AstWalker(),
         env_(env),
-        id_counter_(nullptr),
         run_all_(false),
+        context_(nullptr),
+        profiler_(nullptr),
+        cache_(nullptr),
+        clock_(0),
+        spill_store_(nullptr),
         return_value_(nullptr),
         success_(true),
         optimize_embedding_(-1) {}
@@ -129,12 +151,11 @@ class AstEvaluator : public AstWalker {
   ~AstEvaluator() override {
     // We only own the environment if we ran all of the nodes. Similarly, if we
     // run all of the nodes then we should've created one layer of local
-    // variable space. Finally, the top-level grammar should own all of the
-    // parsed ASTs via the grammars, so we'll kill those, too.
+    // variable space. The parsed ASTs of imported grammars are owned by the
+    // compilation context.
     if (run_all_) {
-      env_->PopLocalEnvironment();
+      PopFrame();
       delete env_;
-      STLDeleteElements(&loaded_grammars_);
     }
   }
 
@@ -152,8 +173,14 @@ class AstEvaluator : public AstWalker {
     success_ = false;
   }
 
-  void SetIdCounter(std::unique_ptr<AstIdentifierCounter> counter) {
-    id_counter_ = std::move(counter);
+  // Evaluates within the provided compilation context, which is not owned and
+  // must be set before evaluation. It holds the grammars loaded by imports and
+  // the profiler and evaluation cache, if any.
+  void SetContext(CompilationContext* context) {
+    context_ = context;
+    profiler_ = context->profiler();
+    cache_ = context->evaluation_cache();
+    spill_store_ = context->spill_store();
   }
 
   void Visit(CollectionNode* node) override {
@@ -164,8 +191,7 @@ class AstEvaluator : public AstWalker {
     VLOG(2) << "Visiting Function";
     if (!Success()) return;
     const std::string& name = node->GetName()->Get();
-    IdentifierNode function_inode(name);
-    if (!env_->Get<FunctionNode>(function_inode)) {  // Add only if new.
+    if (!env_->Get<FunctionNode>(*node->GetName())) {  // Add only if new.
       // The functions are held with the GrmCompilerSpec (more specifically the
       // abstract syntax node tree). So, we'll insert them without deletion now,
       // and kill them all at the end when we dispose of the grammar compilers.
@@ -189,6 +215,7 @@ class AstEvaluator : public AstWalker {
     CollectionNode* functions = node->GetFunctions();
     for (int i = 0; i < functions->Size(); ++i) (*functions)[i]->Accept(this);
     if (run_all_) {
+      liveness_.AnalyzeGrammar(node);
       CollectionNode* statements = node->GetStatements();
       for (int i = 0; i < statements->Size(); ++i) {
         StatementNode* stmt = fst::down_cast<StatementNode*>((*statements)[i]);
@@ -230,15 +257,30 @@ class AstEvaluator : public AstWalker {
       env_ = prev_env;
       return;
     }
-    auto* grammar = new GrmCompilerSpec<Arc>();
-    if (!grammar->ParseFile(path) ||
-        !grammar->EvaluateAstWithEnvironment(env_, false)) {
+    ProfileScope scope(profiler_, file_, node->getline(), "import",
+                       node->GetPath()->Get());
+    // With a persistent state, a grammar parsed by an earlier compilation is
+    // reused if it did not change since.
+    std::shared_ptr<GrmCompilerSpec<Arc>> grammar;
+    if (auto* persistent = context_->persistent()) {
+      grammar =
+          persistent->GetOrCreate<ParsedGrammarCache<Arc>>()->Get(path);
+    } else {
+      grammar = std::make_shared<GrmCompilerSpec<Arc>>();
+      if (!grammar->ParseFile(path)) grammar = nullptr;
+    }
+    if (grammar) {
+      // The grammar must outlive this evaluator, since the functions it
+      // defines remain reachable through the namespace.
+      context_->GetOrCreate<LoadedGrammars>()->push_back(grammar);
+      grammar->SetContext(context_);
+    }
+    if (!grammar || !grammar->EvaluateAstWithEnvironment(env_, false)) {
       Error(*node,
             ::fst::StrCat("Errors while importing grm source file: ", path));
       env_ = prev_env;
       return;
     }
-    loaded_grammars_.push_back(grammar);
     // Loads up the exported FSTs.
     std::string far_path = path.substr(0, path.length() - 3) + "far";
     VLOG(2) << "Opening (and loading FSTs from) companion far: " << far_path;
@@ -266,11 +308,20 @@ class AstEvaluator : public AstWalker {
     }
     // Adds the FSTs to that namespace. We'll loop through the reader, but quit
     // if we ever have an error.
+    typename AbstractGrmManager<Arc>::FstMap cascade_components;
     for (/* far_reader starts at the beginning */;
          Success() && !far_reader->Done(); far_reader->Next()) {
       const auto& key = far_reader->GetKey();
       if (key == kStringFstSymtabFst) {
         continue;
+      } else if (key.compare(0, std::strlen(kCascadeComponentPrefix),
+                             kCascadeComponentPrefix) == 0) {
+        // A component of an exported delayed composition, which is added once
+        // all of them are read.
+        MutableTransducer tmpfst(*(far_reader->GetFst()));
+        RemapGeneratedLabels(&tmpfst);
+        ReassignSymbols(&tmpfst);
+        cascade_components[key] = fst::WrapUnique(tmpfst.Copy());
       } else {
         // Otherwise, we just have a normal exported FST. So we can just add it
         // into the variables.
@@ -291,6 +342,13 @@ class AstEvaluator : public AstWalker {
         }
       }
     }
+    AbstractGrmManager<Arc>::AssembleCascades(&cascade_components);
+    for (auto& pair : cascade_components) {
+      IdentifierNode key_inode(pair.first);
+      if (env_->Get<DataType>(key_inode)) continue;  // Add only if new.
+      std::unique_ptr<Transducer> fst(pair.second->Copy());
+      env_->Insert(pair.first, std::make_unique<DataType>(std::move(fst)));
+    }
 
     // Restores the previous namespace.
     env_ = prev_env;
@@ -330,10 +388,23 @@ class AstEvaluator : public AstWalker {
       return;
     }
     const std::string& name = identifier->GetIdentifier();
+    ProfileScope scope(profiler_, file_, node->getline(), "rule", name);
+    const int64_t fallbacks = context_ ? context_->optimize_fallbacks() : 0;
     node->Get()->Accept(this);
     std::unique_ptr<DataType> thing = GetReturnValue();
+    if (context_ && context_->optimize_fallbacks() > fallbacks) {
+      LOG(WARNING) << file_ << ":" << node->getline() << ": Rule " << name
+                   << " exceeded the determinization budget of Optimize";
+    }
+    if (scope.active() && thing && thing->is<Transducer*>())
+      scope.SetOutput(**thing->get<Transducer*>());
+    // A value that is never used need not be kept.
+    if (liveness_.IsDead(node)) {
+      VLOG(3) << "Dropping unused variable: " << name;
+      return;
+    }
     // Inserts the new variable, dying if it clobbers a pre-existing object.
-    if (!env_->InsertLocal(name, std::move(thing))) {
+    if (!BindLocal(identifier->GetIdentifierId(), std::move(thing))) {
       Error(*identifier,
             ::fst::StrCat("Cannot clobber existing variable: ", name));
       return;
@@ -352,11 +423,14 @@ class AstEvaluator : public AstWalker {
   }
 
   // Visiting a StatementNode simply passes on the Accept() request to the
-  // underlying node.
+  // underlying node, then releases the variables last used in the statement.
   void Visit(StatementNode* node) override {
     VLOG(2) << "Visiting StatementNode";
     if (!Success()) return;
     node->Get()->Accept(this);
+    if (const auto* releases = liveness_.ReleasesAfter(node)) {
+      for (const auto id : *releases) ReleaseLocal(id);
+    }
   }
 
   void Visit(StringFstNode* node) override {
@@ -399,6 +473,11 @@ class AstEvaluator : public AstWalker {
       // of the top-level environment, so it fails to find it here and will die.
       // The choices are to try to make the compilation more clever about this
       // in the first place, which is hairy, or catch it here.
+      if (!Touch(fst_i->GetIdentifierId())) {
+        Error(*fst_i,
+              ::fst::StrCat("Cannot read back spilled FST: ", fst_i->Get()));
+        return;
+      }
       if (env_->Get<DataType>(*fst_i) == nullptr) {
         LOG(WARNING) << "Cannot find exportable fst with name "
                      << name
@@ -411,9 +490,20 @@ class AstEvaluator : public AstWalker {
               ::fst::StrCat("Cannot export non-FST variable: ", fst_i->Get()));
         return;
       }
+      ProfileScope scope(profiler_, file_, fst_i->getline(), "export", name);
       Transducer* fst =
           *env_->Get<DataType>(*fst_i)->template get<Transducer*>();
+      // A delayed composition is exported as it is, so that its components are
+      // stored in its place (see AbstractGrmManager).
+      if (const auto* cascade =
+              dynamic_cast<const ::fst::ComposeCascadeFst<Arc>*>(fst)) {
+        (*fsts)[name] = ExportCascade(*cascade);
+        continue;
+      }
+      // Records the size of a delayed result as it is expanded.
       auto nfst = std::make_unique<MutableTransducer>(*fst);
+      scope.AddInput(*nfst);
+      scope.SetOutput(*nfst);
       // If the transducer has input symbols or output symbols, and if those are
       // either the byte symbol table or the utf8 symbol table, then we must
       // reassign those tables, since we may have added generated labels. In the
@@ -471,17 +561,48 @@ class AstEvaluator : public AstWalker {
       FunctionNode* func_node, const Node& debug_location_node,
       Namespace* func_namespace,
       std::unique_ptr<std::vector<std::unique_ptr<DataType>>> arguments) {
-    Namespace* prev_env = env_;
-    env_ = func_namespace;
-    env_->PushLocalEnvironment();
-    // Creates a new layer of environment symbol table and binds the passed
-    // arguments.
     CollectionNode* fa_node = func_node->GetArguments();
     if (fa_node->Size() != arguments->size()) {
       Error(debug_location_node,
             ::fst::StrCat("Expected ", fa_node->Size(), " arguments but got ",
                          arguments->size()));
     }
+    // From here on, locations are in the body of the function, so errors and
+    // profiling records refer to the file defining it.
+    const std::string prev_file = file_;
+    if (!func_namespace->IsTopLevel()) file_ = func_namespace->GetFilename();
+    ProfileScope scope(profiler_, file_, func_node->getline(),
+                       func_node->GetName()->Get());
+    if (scope.active()) AddInputSizes(*arguments, &scope);
+    // A pure function returns the same result for the same arguments, so its
+    // result is cached like those of the C++ functions. The key identifies
+    // the definition (rather than the name, which may be shadowed) within
+    // this compilation, in which the AST nodes stay put.
+    std::shared_ptr<const EvaluationKey> key;
+    if (cache_ && FST_FLAGS_memoize_functions && Success() &&
+        purity_checker_.IsPure(func_node, func_namespace)) {
+      key = CallKey(::fst::StrCat("func ", context_->serial(), " ",
+                                  reinterpret_cast<uintptr_t>(func_node)),
+                    arguments.get());
+    }
+    if (key) {
+      double seconds;
+      auto output = cache_->Find(*key, &seconds);
+      if (output) {
+        scope.NoteCacheHit(seconds);
+        file_ = prev_file;
+        if (output->is<Transducer*>())
+          scope.SetOutput(**output->get<Transducer*>());
+        return output;
+      }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    liveness_.AnalyzeFunction(func_node);
+    Namespace* prev_env = env_;
+    env_ = func_namespace;
+    PushFrame();
+    // Creates a new layer of environment symbol table and binds the passed
+    // arguments, which we own.
     for (int i = 0; Success() && i < fa_node->Size(); ++i) {
       IdentifierNode* fa_identifier =
           fst::down_cast<IdentifierNode*>((*fa_node)[i]);
@@ -490,9 +611,7 @@ class AstEvaluator : public AstWalker {
                                            fa_identifier->Get()));
         break;
       }
-      const std::string& arg_name = fa_identifier->GetIdentifier();
-      auto arg = (*arguments)[i]->Copy();
-      env_->InsertLocal(arg_name, std::move(arg));
+      BindLocal(fa_identifier->GetIdentifierId(), std::move((*arguments)[i]));
     }
     // Iterates over the statements and runs each.
     CollectionNode* fb_node = func_node->GetBody();
@@ -506,8 +625,18 @@ class AstEvaluator : public AstWalker {
       }
     }
     // Tosses out the function-scope environment.
-    env_->PopLocalEnvironment();
+    PopFrame();
     env_ = prev_env;
+    file_ = prev_file;
+    if (key && output && Success()) {
+      output->set_key(key);
+      cache_->Insert(key, *output,
+                     std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+    }
+    if (output && output->is<Transducer*>())
+      scope.SetOutput(**output->get<Transducer*>());
     return output;
   }
 
@@ -522,11 +651,163 @@ class AstEvaluator : public AstWalker {
     function::Function<Arc>* func = GetFunction<Arc>(function_name);
     // If we get a nullptr function, then the name was invalid.
     if (!func) return nullptr;
+    return RunCFunction(func, function_name, debug_location_node,
+                        std::move(arguments));
+  }
+
+  // Executes the C++ function on the provided arguments, as named in profiles
+  // and in the keys of the evaluation cache. This takes ownership of the
+  // arguments.
+  std::unique_ptr<DataType> RunCFunction(
+      function::Function<Arc>* func, const std::string& function_name,
+      const Node& debug_location_node,
+      std::unique_ptr<std::vector<std::unique_ptr<DataType>>> arguments) {
+    ProfileScope scope(profiler_, file_, debug_location_node.getline(),
+                       function_name);
+    if (scope.active() && arguments) AddInputSizes(*arguments, &scope);
+    // The key of the result is derived from the arguments before the function
+    // takes them.
+    const auto key =
+        cache_ && EvaluationCache::IsPureCall(function_name, arguments.get())
+            ? CallKey(function_name, arguments.get())
+            : nullptr;
+    if (key) {
+      double seconds;
+      auto output = cache_->Find(*key, &seconds);
+      if (output) {
+        scope.NoteCacheHit(seconds);
+        if (output->is<Transducer*>())
+          scope.SetOutput(**output->get<Transducer*>());
+        return output;
+      }
+    }
+    const auto start = std::chrono::steady_clock::now();
     auto output = func->Run(std::move(arguments));
-    if (!output) Error(debug_location_node, "C++ function call failed");
+    if (!output) {
+      Error(debug_location_node, "C++ function call failed");
+      return output;
+    }
+    if (output->is<Transducer*>())
+      scope.SetOutput(**output->get<Transducer*>());
+    if (key) {
+      output->set_key(key);
+      cache_->Insert(key, *output,
+                     std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+    }
     return output;
   }
 
+  // Returns the key of the result of calling the named function on the
+  // arguments, or nullptr if some argument has no key (i.e., it is a delayed
+  // FST that did not come from a function call).
+  static std::shared_ptr<const EvaluationKey> CallKey(
+      const std::string& function_name,
+      std::vector<std::unique_ptr<DataType>>* arguments) {
+    std::vector<std::shared_ptr<const EvaluationKey>> argument_keys;
+    if (arguments) {
+      argument_keys.reserve(arguments->size());
+      for (auto& argument : *arguments) {
+        if (!argument) return nullptr;
+        auto argument_key = GetEvaluationKey(argument.get());
+        if (!argument_key) return nullptr;
+        argument_keys.push_back(std::move(argument_key));
+      }
+    }
+    return EvaluationKey::Derived(function_name, std::move(argument_keys));
+  }
+
+  // Returns the operands of the chain of unions or concatenations (according to
+  // the node's type) rooted at the node, in order. Nested nodes of the same
+  // type are expanded, unless they carry a weight or are to be optimized. Uses
+  // an explicit stack, since the parser nests long chains deeply.
+  static std::vector<Node*> FlattenChain(FstNode* node) {
+    std::vector<Node*> operands;
+    std::vector<Node*> stack = {node->GetArgument(1), node->GetArgument(0)};
+    while (!stack.empty()) {
+      Node* operand = stack.back();
+      stack.pop_back();
+      FstNode* fst_operand = dynamic_cast<FstNode*>(operand);
+      if (fst_operand && fst_operand->GetType() == node->GetType() &&
+          !fst_operand->HasWeight() && !fst_operand->ShouldOptimize()) {
+        stack.push_back(fst_operand->GetArgument(1));
+        stack.push_back(fst_operand->GetArgument(0));
+      } else {
+        operands.push_back(operand);
+      }
+    }
+    return operands;
+  }
+
+  // If all the operands are unweighted string literals in the same byte or
+  // UTF-8 parse mode, returns the arguments for StringUnion (the parse mode
+  // followed by the texts), and nullptr otherwise.
+  static std::unique_ptr<std::vector<std::unique_ptr<DataType>>>
+  GetStringUnionArguments(const std::vector<Node*>& operands) {
+    auto args = std::make_unique<std::vector<std::unique_ptr<DataType>>>();
+    args->reserve(operands.size() + 1);
+    int parse_mode = -1;
+    for (Node* operand : operands) {
+      FstNode* fst_operand = dynamic_cast<FstNode*>(operand);
+      if (!fst_operand ||
+          fst_operand->GetType() != FstNode::STRING_FSTNODE ||
+          fst_operand->HasWeight() || fst_operand->ShouldOptimize()) {
+        return nullptr;
+      }
+      StringFstNode* snode = fst::down_cast<StringFstNode*>(fst_operand);
+      const int mode = snode->GetParseMode();
+      if (mode != StringFstNode::BYTE && mode != StringFstNode::UTF8)
+        return nullptr;
+      if (parse_mode == -1) {
+        parse_mode = mode;
+        args->push_back(std::make_unique<DataType>(mode));
+      } else if (mode != parse_mode) {
+        return nullptr;
+      }
+      args->push_back(std::make_unique<DataType>(
+          fst::down_cast<StringNode*>(snode->GetArgument(0))->Get()));
+    }
+    return args;
+  }
+
+  // Evaluates a chain of unions or concatenations with a single call to the
+  // n-ary Union or Concat function, rather than one nested call per operator.
+  // Unions of string literals are compiled directly into a prefix tree.
+  std::unique_ptr<DataType> MakeFstFromChain(const std::string& function_name,
+                                             FstNode* node) {
+    const std::vector<Node*> operands = FlattenChain(node);
+    VLOG(2) << function_name << " of " << operands.size() << " operands";
+    if (node->GetType() == FstNode::UNION_FSTNODE) {
+      auto args = GetStringUnionArguments(operands);
+      if (args) {
+        // StringUnion is internal to the evaluator, so it is not registered.
+        function::StringUnion<Arc> string_union;
+        return RunCFunction(&string_union, "StringUnion", *node,
+                            std::move(args));
+      }
+    }
+    auto args = std::make_unique<std::vector<std::unique_ptr<DataType>>>();
+    args->reserve(operands.size());
+    for (Node* operand : operands) {
+      operand->Accept(this);
+      std::unique_ptr<DataType> return_value = GetReturnValue();
+      if (!return_value) return nullptr;
+      args->push_back(std::move(return_value));
+    }
+    return MakeFstFromCFunction(function_name, *node, std::move(args));
+  }
+
+  // Adds the sizes of the FST arguments to the profiling record.
+  static void AddInputSizes(
+      const std::vector<std::unique_ptr<DataType>>& arguments,
+      ProfileScope* scope) {
+    for (const auto& argument : arguments) {
+      if (argument && argument->is<Transducer*>())
+        scope->AddInput(**argument->get<Transducer*>());
+    }
+  }
+
   // The main evaluator function---this takes in an FstNode and returns the
   // object specified. Note that this is a misnomer (for historical
   // reasons)---we can actually return things other than an FST (whatever
@@ -536,16 +817,14 @@ class AstEvaluator : public AstWalker {
     switch (node->GetType()) {
       case FstNode::CONCAT_FSTNODE: {
         VLOG(2) << "Concat Fst:";
-        auto args = GetArgumentsFromFstNode(node, 2);
-        output = MakeFstFromCFunction("Concat", *node, std::move(args));
-        CHECK_NE(output, nullptr);
+        output = MakeFstFromChain("Concat", node);
+        if (!output) return nullptr;
         break;
       }
       case FstNode::UNION_FSTNODE: {
         VLOG(2) << "Union Fst:";
-        auto args = GetArgumentsFromFstNode(node, 2);
-        output = MakeFstFromCFunction("Union", *node, std::move(args));
-        CHECK_NE(output, nullptr);
+        output = MakeFstFromChain("Union", node);
+        if (!output) return nullptr;
         break;
       }
       case FstNode::DIFFERENCE_FSTNODE: {
@@ -594,24 +873,30 @@ class AstEvaluator : public AstWalker {
         IdentifierNode* identifier =
             fst::down_cast<IdentifierNode*>(node->GetArgument(0));
         VLOG(2) << "Identifier Fst: " << identifier->Get();
-        DataType* original = env_->Get<DataType>(*identifier);
+        // At the last use of a local variable, we take its value rather than
+        // copy it, so that it is freed as soon as it has been consumed (and
+        // is not copied on write if the consumer modifies it).
+        if (!identifier->HasNamespaces() &&
+            !Touch(identifier->GetIdentifierId())) {
+          Error(*identifier, ::fst::StrCat("Cannot read back spilled FST: ",
+                                           identifier->Get()));
+          return nullptr;
+        }
+        if (liveness_.IsLastUse(identifier)) {
+          VLOG(3) << "Releasing local variable: " << identifier->Get();
+          output = ReleaseLocal(identifier->GetIdentifierId());
+        }
+        DataType* original = output.get();
+        if (!output) original = env_->Get<DataType>(*identifier);
         if (!original) {
           Error(*identifier,
                 ::fst::StrCat("Undefined symbol: ", identifier->Get()));
           return nullptr;
         }
-        output = original->Copy();
-        // If we're currently at the top level namespace (i.e., compiling the
-        // main body of the primary compilation target), and if the identifier
-        // is one without aliases, then we may wish to free the memory if this
-        // is the final access.
-        if (env_->IsTopLevel() &&
-            env_->LocalEnvironmentDepth() == 1 &&
-            !identifier->HasNamespaces() &&
-            !id_counter_->Decrement(identifier->GetIdentifier())) {
-          VLOG(3) << "Erasing local variable: " << identifier->GetIdentifier();
-          CHECK(env_->EraseLocal(identifier->GetIdentifier()));
-        }
+        // Keys the value once, where it is stored, rather than in each of its
+        // copies.
+        if (cache_) GetEvaluationKey(original);
+        if (!output) output = original->Copy();
         break;
       }
       case FstNode::STRING_FSTNODE: {
@@ -693,15 +978,54 @@ class AstEvaluator : public AstWalker {
       if (node->HasWeight()) {
         Transducer* unweighted_fst = *output->get<Transducer*>();
         auto weighted_fst = AttachWeight(*unweighted_fst, node->GetWeight());
+        auto key = output->key();
         output = std::make_unique<DataType>(std::move(weighted_fst));
+        if (key) {
+          output->set_key(EvaluationKey::Derived(
+              "AttachWeight",
+              {std::move(key),
+               EvaluationKey::Leaf(DataType(node->GetWeight()))}));
+        }
       }
       // Now, we might wish to always optimize the FSTs, or the node is slated
       // to be optimized (e.g. a composition node within an Optimize
       // FUNCTION_FSTNODE).
       if (FST_FLAGS_optimize_all_fsts || node->ShouldOptimize()) {
-        auto optimized_fst = function::Optimize<Arc>::ActuallyOptimize(
-            **output->get<Transducer*>());
-        output = std::make_unique<DataType>(std::move(optimized_fst));
+        ProfileScope scope(profiler_, file_, node->getline(),
+                           "Optimize (implicit)");
+        std::shared_ptr<const EvaluationKey> key;
+        if (cache_) key = GetEvaluationKey(output.get());
+        if (key) key = EvaluationKey::Derived("Optimize (implicit)", {key});
+        double seconds;
+        std::unique_ptr<DataType> optimized =
+            key ? cache_->Find(*key, &seconds) : nullptr;
+        if (optimized) {
+          scope.AddInput(**output->get<Transducer*>());
+          scope.NoteCacheHit(seconds);
+        } else {
+          const Transducer* input = *output->get<Transducer*>();
+          // Optimization expands a delayed input anyway; when profiling, it is
+          // expanded beforehand so that the size of the delayed result gets
+          // recorded.
+          std::unique_ptr<MutableTransducer> expanded;
+          if (scope.active() && !input->Properties(::fst::kExpanded, false)) {
+            expanded = std::make_unique<MutableTransducer>(*input);
+            input = expanded.get();
+          }
+          scope.AddInput(*input);
+          const auto start = std::chrono::steady_clock::now();
+          optimized = std::make_unique<DataType>(
+              function::Optimize<Arc>::ActuallyOptimize(*input));
+          if (key) {
+            optimized->set_key(key);
+            cache_->Insert(key, *optimized,
+                           std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+          }
+        }
+        scope.SetOutput(**optimized->get<Transducer*>());
+        output = std::move(optimized);
         // This is the interesting case to be able to keep track of.
         if (node->ShouldOptimize())
           VLOG(2) << "Optimizing at line " << node->getline();
@@ -772,6 +1096,139 @@ class AstEvaluator : public AstWalker {
     }
   }
 
+  // An FST bound to a variable, with the memory it holds.
+  struct LiveFst {
+    int64_t bytes;
+    DataType* value;  // Owned by the namespace.
+    uint64_t last_use;
+    // Where the FST has been written while it is not in memory, else empty.
+    std::string spill_path;
+  };
+
+  // Binds the value to a variable in the innermost local environment, keeping
+  // track of the memory held by the FSTs bound there. Returns false if the
+  // variable is already bound.
+  bool BindLocal(IdentifierInterner::Id id, std::unique_ptr<DataType> value) {
+    const int64_t bytes = value && value->is<Transducer*>()
+                              ? EstimateDataTypeBytes(*value)
+                              : 0;
+    DataType* stored = value.get();
+    if (!env_->InsertLocal(id, std::move(value))) return false;
+    if (bytes) {
+      frames_.back()[id] = LiveFst{bytes, stored, ++clock_, ""};
+      if (context_) context_->AddLiveFstBytes(bytes);
+      EnforceMemoryBudget(id);
+    }
+    return true;
+  }
+
+  // Unbinds a variable from the innermost local environment and returns its
+  // value.
+  std::unique_ptr<DataType> ReleaseLocal(IdentifierInterner::Id id) {
+    auto& frame = frames_.back();
+    const auto it = frame.find(id);
+    if (it != frame.end()) {
+      Forget(it->second);
+      frame.erase(it);
+    }
+    return env_->ReleaseLocal<DataType>(id);
+  }
+
+  void PushFrame() {
+    env_->PushLocalEnvironment();
+    frames_.emplace_back();
+  }
+
+  void PopFrame() {
+    for (auto& binding : frames_.back()) Forget(binding.second);
+    frames_.pop_back();
+    env_->PopLocalEnvironment();
+  }
+
+  // Stops accounting for an FST that is being unbound.
+  void Forget(const LiveFst& live) {
+    if (!live.spill_path.empty()) {
+      spill_store_->Remove(live.spill_path);
+    } else if (context_) {
+      context_->AddLiveFstBytes(-live.bytes);
+    }
+  }
+
+  // Marks a variable of the innermost local environment as used, reading its
+  // FST back from disk if it was spilled. Returns false if that fails.
+  bool Touch(IdentifierInterner::Id id) {
+    if (frames_.empty()) return true;
+    auto& frame = frames_.back();
+    const auto it = frame.find(id);
+    if (it == frame.end()) return true;
+    LiveFst& live = it->second;
+    live.last_use = ++clock_;
+    if (live.spill_path.empty()) return true;
+    std::unique_ptr<Transducer> fst(Transducer::Read(live.spill_path));
+    if (!fst) return false;
+    *live.value->template get_mutable<Transducer*>() = fst.release();
+    spill_store_->Remove(live.spill_path);
+    spill_store_->NoteReload();
+    live.spill_path.clear();
+    context_->AddLiveFstBytes(live.bytes);
+    EnforceMemoryBudget(id);
+    return true;
+  }
+
+  // While the FSTs bound to variables are over the memory budget, writes the
+  // least recently used one to disk and frees it. The variable `keep` of the
+  // innermost local environment, which is about to be used, stays in memory.
+  void EnforceMemoryBudget(IdentifierInterner::Id keep) {
+    if (!spill_store_) return;
+    while (context_->live_fst_bytes() > spill_store_->max_bytes()) {
+      LiveFst* victim = nullptr;
+      for (auto& frame : frames_) {
+        for (auto& binding : frame) {
+          LiveFst& live = binding.second;
+          // Delayed FSTs hold no accounted memory, and cannot be written.
+          if (!live.spill_path.empty() || !live.bytes) continue;
+          if (&frame == &frames_.back() && binding.first == keep) continue;
+          if (!victim || live.last_use < victim->last_use) victim = &live;
+        }
+      }
+      if (!victim || !Spill(victim)) return;
+    }
+  }
+
+  bool Spill(LiveFst* live) {
+    const std::string path = spill_store_->NewPath();
+    if (path.empty()) return false;
+    Transducer** fst = live->value->template get_mutable<Transducer*>();
+    if (!(*fst)->Write(path)) {
+      LOG(WARNING) << "Cannot write FST to " << path
+                   << "; keeping it in memory";
+      spill_store_->Remove(path);
+      return false;
+    }
+    // Copies of the FST still in use elsewhere keep their shared state, so this
+    // frees the memory only once they are gone as well.
+    delete *fst;
+    *fst = nullptr;
+    live->spill_path = path;
+    context_->AddLiveFstBytes(-live->bytes);
+    spill_store_->NoteSpill(live->bytes);
+    return true;
+  }
+
+  // Reassigns the symbols of the components of a delayed composition, as
+  // GetFsts does for the other FSTs it exports.
+  std::unique_ptr<const Transducer> ExportCascade(
+      const ::fst::ComposeCascadeFst<Arc>& cascade) {
+    typename ::fst::ComposeCascadeFst<Arc>::Components components;
+    for (const auto& component : cascade.GetComponents()) {
+      auto ncomponent = std::make_shared<MutableTransducer>(*component);
+      ReassignSymbols(ncomponent.get());
+      components.push_back(std::move(ncomponent));
+    }
+    return std::make_unique<::fst::ComposeCascadeFst<Arc>>(
+        std::move(components));
+  }
+
   // Remaps the generated labels of this FST using a StringFst's remap.
   void RemapGeneratedLabels(MutableTransducer* fst) {
     for (::fst::StateIterator<MutableTransducer> siter(*fst); !siter.Done();
@@ -790,20 +1247,25 @@ class AstEvaluator : public AstWalker {
   }
 
   Namespace* env_;  // Only owned if `run_all_` is true.
-  std::unique_ptr<AstIdentifierCounter> id_counter_;
   const bool run_all_;
+  CompilationContext* context_;  // Not owned.
+  CompileProfiler* profiler_;  // Not owned; nullptr if not profiling.
+  EvaluationCache* cache_;     // Not owned; nullptr if not caching.
+  // Decides which grammar functions may be cached.
+  AstPurityChecker purity_checker_;
+  // Decides when local variables may be released.
+  AstLivenessAnalyzer liveness_;
+  // For each local environment pushed, the FSTs bound in it (that hold any
+  // memory).
+  std::vector<std::unordered_map<IdentifierInterner::Id, LiveFst>> frames_;
+  // Counts the uses of variables, to find the least recently used ones.
+  uint64_t clock_;
+  SpillStore* spill_store_;  // Not owned; nullptr if there is no budget.
 
   // A list of the names of the FSTs we want exported at the end. We'll find
   // these FSTs from the local environment. Note that these pointers are owned
   // by the original AST, not us.
   std::set<IdentifierNode*> exported_fsts_;
-  // A list of grammars that we've opened (and thus need to close at the end).
-  // TODO(ttai): This is dangerous right now since if we have two simulatneous
-  // compilations within the same process, then they'll be incorrectly sharing
-  // this. It'd be nice to have a copy-function on the AST nodes so we can just
-  // make a copy of the relevant bits of the AST (the function nodes) and store
-  // just that.
-  static std::vector<GrmCompilerSpec<Arc>*> loaded_grammars_;
   // This is the "return" datatype that is returned by a number of nodes.
   std::unique_ptr<DataType> return_value_;
   AstPrinter printer_;
@@ -823,9 +1285,6 @@ class AstEvaluator : public AstWalker {
   AstEvaluator<Arc>& operator=(const AstEvaluator<Arc>&) = delete;
 };
 
-template <typename Arc>
-std::vector<GrmCompilerSpec<Arc>*> AstEvaluator<Arc>::loaded_grammars_;
-
 }  // namespace thrax
 
 #endif  // THRAX_EVALUATOR_H_
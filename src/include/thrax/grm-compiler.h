@@ -19,7 +19,9 @@
 #ifndef NLP_GRM_LANGUAGE_GRM_COMPILER_H_
 #define NLP_GRM_LANGUAGE_GRM_COMPILER_H_
 
+#include <algorithm>
 #include <iostream> // NOLINT
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -29,10 +31,12 @@
 #include <thrax/compat/utils.h>
 #include <fst/arc.h>
 #include <thrax/node.h>
+#include <thrax/node-arena.h>
 #include <thrax/grm-manager.h>
+#include <thrax/identifier-interner.h>
 #include <thrax/lexer.h>
+#include <thrax/compilation-context.h>
 #include <thrax/evaluator.h>
-#include <thrax/identifier-counter.h>
 #include <thrax/printer.h>
 
 DECLARE_bool(print_ast);
@@ -99,6 +103,9 @@ class GrmCompilerSpec : public GrmCompilerParserInterface {
   // and utf8 symbol tables.
   bool EvaluateAstWithEnvironment(Namespace* env, bool top_level);
 
+  // Returns false once parsing or evaluation failed.
+  bool Success() const { return success_; }
+
   // ***************************************************************************
   // The following functions give access to, modify, or serialize internal data.
 
@@ -116,6 +123,12 @@ class GrmCompilerSpec : public GrmCompilerParserInterface {
   // however, so it should not be deleted by the caller.
   const GrmManagerSpec<Arc>* GetGrmManager() const { return &grm_manager_; }
 
+  // Evaluates within the provided compilation context, which is not owned.
+  // This is how imported grammars share the state of the importing one. If no
+  // context is set, evaluation uses the one current on this thread, or else
+  // creates its own for the duration of the evaluation.
+  void SetContext(CompilationContext* context) { context_ = context; }
+
   // ***************************************************************************
   // Various other useful functions.
 
@@ -125,8 +138,17 @@ class GrmCompilerSpec : public GrmCompilerParserInterface {
   void Error(const std::string& message) override;
 
  private:
+  // Parses the grammar the lexer has been given to scan.
+  bool Parse();
+
   Lexer lexer_;
 
+  // Interns the identifiers of asts_ (and of the grammars they import), so it
+  // must outlive them.
+  std::shared_ptr<IdentifierInterner> interner_;
+
+  NodeArena arena_;  // Holds the nodes of asts_, so it must outlive them.
+
   std::vector<std::unique_ptr<Node>>
       asts_;            // The list of actual ASTs owned by this compiler.
 
@@ -136,12 +158,14 @@ class GrmCompilerSpec : public GrmCompilerParserInterface {
 
   std::string file_;  // File currently being processed
 
+  CompilationContext* context_;
+
   GrmCompilerSpec(const GrmCompilerSpec&) = delete;
   GrmCompilerSpec& operator=(const GrmCompilerSpec&) = delete;
 };
 
 template <typename Arc>
-GrmCompilerSpec<Arc>::GrmCompilerSpec() {}
+GrmCompilerSpec<Arc>::GrmCompilerSpec() : context_(nullptr) {}
 
 template <typename Arc>
 void GrmCompilerSpec<Arc>::SetAst(std::unique_ptr<Node> root) {
@@ -176,33 +200,42 @@ bool GrmCompilerSpec<Arc>::EvaluateAstWithEnvironment(Namespace* env,
     PrintAst(FST_FLAGS_line_numbers_in_ast);
   }
   VLOG(1) << "Commencing main compilation (AST evaluation).";
+  IdentifierInterner::Scope interner_scope(interner_);
+  CompilationContext* const prev_context = context_;
+  std::unique_ptr<CompilationContext> context;
+  if (!context_) context_ = CompilationContext::Current();
+  if (!context_) {
+    context = std::make_unique<CompilationContext>();
+    context_ = context.get();
+  }
+  CompilationContext::Scope scope(context_);
   std::unique_ptr<AstEvaluator<Arc>> evaluator;
   if (env) {
     // If we have an environment, then we pass it to the Evaluator so that it
     // knows that we only want the includes.
     evaluator = std::make_unique<AstEvaluator<Arc>>(env);
   } else {
-    // We want to get a count of the identifiers so that we can free their
-    // memory when the time comes.
-    auto id_counter = std::make_unique<AstIdentifierCounter>();
-    GetAst()->Accept(id_counter.get());
     // If we don't have an environment, then we're doing the top level version,
     // where we execute the body.
     evaluator = std::make_unique<AstEvaluator<Arc>>();
-    evaluator->SetIdCounter(std::move(id_counter));
   }
   evaluator->set_file(file_);
+  evaluator->SetContext(context_);
   GetAst()->Accept(evaluator.get());
   if (evaluator->Success()) {
     // We can always retrieve the FSTs. If there are none (ex., since we're
     // only importing the file), this operation is still safe/fast.
     VLOG(1) << "Compilation complete. Expanding exported FSTs.";
+    // Drops the FSTs of any previous evaluation of the same AST.
+    grm_manager_.GetFstMap()->clear();
     evaluator->GetFsts(grm_manager_.GetFstMap(), top_level);
     grm_manager_.SortRuleInputLabels();
   } else {
     std::cout << "Compilation failed." << std::endl;
     success_ = false;
   }
+  if (context) context->Report();
+  context_ = prev_context;
   return success_;
 }
 
@@ -220,6 +253,8 @@ template <typename Arc>
 bool GrmCompilerSpec<Arc>::ParseFile(const std::string& filename) {
   VLOG(1) << "Parsing file: " << filename;
   file_ = filename;
+  // Where possible, the lexer scans the file in place from a memory mapping.
+  if (lexer_.ScanFile(filename)) return Parse();
   std::string contents;
   ReadFileToStringOrDie(filename, &contents);
   // Adds a newline in case one was left off. It doesn't hurt to have an extra
@@ -235,12 +270,96 @@ int CallParser(GrmCompilerParserInterface* compiler);
 
 template <typename Arc>
 bool GrmCompilerSpec<Arc>::ParseContents(const std::string& contents) {
-  success_ = true;
   lexer_.ScanString(contents);
+  return Parse();
+}
+
+template <typename Arc>
+bool GrmCompilerSpec<Arc>::Parse() {
+  success_ = true;
+  // An imported grammar shares the interner of the grammar importing it (or
+  // whichever one the caller installed); any other gets its own.
+  if (!interner_) {
+    interner_ = IdentifierInterner::Current();
+    if (!interner_) interner_ = std::make_shared<IdentifierInterner>();
+  }
+  IdentifierInterner::Scope interner_scope(interner_);
+  // The parser allocates the nodes (including any it abandons on errors) from
+  // our arena.
+  NodeArena::Scope scope(&arena_);
   CallParser(this);
   return success_;
 }
 
+// Grammars parsed by earlier compilations, kept in a PersistentState so that
+// unchanged grammars are not parsed again: the same AST is simply evaluated
+// anew. A grammar is parsed again once its file changes, or if it failed to
+// evaluate. The grammars are shared, so that a compilation still using one
+// keeps it alive after it is replaced.
+//
+// The grammars of a generation share an interner (see IdentifierInterner), so
+// that they can import one another. Names of replaced grammars stay in it, so
+// once there have been as many replacements as there are grammars, the cache
+// starts a new generation, with a new interner, and parses the grammars afresh.
+template <typename Arc>
+class ParsedGrammarCache {
+ public:
+  ParsedGrammarCache() : interner_(std::make_shared<IdentifierInterner>()) {}
+
+  // Returns the grammar parsed from the file, or nullptr if it fails to parse.
+  std::shared_ptr<GrmCompilerSpec<Arc>> Get(const std::string& path);
+
+  // Starts a new generation if it is due. Call this only between compilations,
+  // since the grammars of a compilation must share an interner.
+  void MaybeStartGeneration();
+
+ private:
+  struct Entry {
+    FileStamp stamp;
+    std::shared_ptr<GrmCompilerSpec<Arc>> grammar;
+  };
+
+  std::map<std::string, Entry> grammars_;
+  std::shared_ptr<IdentifierInterner> interner_;
+  // The number of grammars parsed again in this generation.
+  size_t reparses_ = 0;
+
+  ParsedGrammarCache(const ParsedGrammarCache&) = delete;
+  ParsedGrammarCache& operator=(const ParsedGrammarCache&) = delete;
+};
+
+template <typename Arc>
+std::shared_ptr<GrmCompilerSpec<Arc>> ParsedGrammarCache<Arc>::Get(
+    const std::string& path) {
+  // Takes the stamp before parsing, so that an edit made meanwhile is seen as
+  // a change next time.
+  const auto stamp = StatFile(path);
+  auto& entry = grammars_[path];
+  if (entry.grammar && entry.stamp == stamp && entry.grammar->Success()) {
+    VLOG(1) << "Reusing parsed grammar: " << path;
+    return entry.grammar;
+  }
+  if (entry.grammar) ++reparses_;
+  entry.stamp = stamp;
+  entry.grammar = std::make_shared<GrmCompilerSpec<Arc>>();
+  IdentifierInterner::Scope interner_scope(interner_);
+  if (!entry.grammar->ParseFile(path)) {
+    grammars_.erase(path);
+    return nullptr;
+  }
+  return entry.grammar;
+}
+
+template <typename Arc>
+void ParsedGrammarCache<Arc>::MaybeStartGeneration() {
+  if (reparses_ < std::max<size_t>(grammars_.size(), 1)) return;
+  VLOG(1) << "Dropping " << grammars_.size() << " parsed grammars and "
+          << interner_->Size() << " interned names";
+  grammars_.clear();
+  interner_ = std::make_shared<IdentifierInterner>();
+  reparses_ = 0;
+}
+
 // A lot of code outside this build uses GrmCompiler with the old meaning of
 // GrmCompilerSpec<::fst::StdArc>, forward-declaring it as a class. To
 // obviate the need to change all that outside code, we provide this derived
@@ -19,6 +19,7 @@
 #ifndef NLP_GRM_LANGUAGE_GRM_MANAGER_H_
 #define NLP_GRM_LANGUAGE_GRM_MANAGER_H_
 
+#include <cstdio>
 #include <memory>
 
 #include <fst/compat.h>
@@ -47,8 +48,8 @@ class GrmManagerSpec : public AbstractGrmManager<Arc> {
   bool LoadArchive(const std::string &filename);
 
   // This function will write the created FSTs into an FST archive with the
-  // provided filename.
-  void ExportFar(const std::string &filename) const override;
+  // provided filename. Returns true on success and false otherwise.
+  bool ExportFar(const std::string &filename) const override;
 
  private:
   GrmManagerSpec(const GrmManagerSpec &) = delete;
@@ -71,29 +72,55 @@ bool GrmManagerSpec<Arc>::LoadArchive(const std::string &filename) {
 }
 
 template <typename Arc>
-void GrmManagerSpec<Arc>::ExportFar(const std::string &filename) const {
+bool GrmManagerSpec<Arc>::ExportFar(const std::string &filename) const {
   const std::string dir(
       JoinPath(FST_FLAGS_outdir, StripBasename(filename)));
   VLOG(1) << "Creating output directory: " << dir;
-  if (!RecursivelyCreateDir(dir))
-    LOG(FATAL) << "Unable to create output directory: " << dir;
+  if (!RecursivelyCreateDir(dir)) {
+    LOG(ERROR) << "Unable to create output directory: " << dir;
+    return false;
+  }
 
   const std::string out_path(
       JoinPath(FST_FLAGS_outdir, filename));
+  // The archive is written to a file of its own next to its final location and
+  // then renamed over it, so that readers never see a partially written FAR,
+  // and concurrent writers do not write into the same file.
+  const std::string tmp_path(MakeTempFileFor(out_path));
+  if (tmp_path.empty()) {
+    LOG(ERROR) << "Failed to create a temporary file for: " << out_path;
+    return false;
+  }
   std::unique_ptr<::fst::FarWriter<Arc>> writer(
 #ifndef NO_GOOGLE
-      ::fst::STTableFarWriter<Arc>::Create(out_path));
+      ::fst::STTableFarWriter<Arc>::Create(tmp_path));
 #else
-      ::fst::STTableFarWriter<Arc>::Create(out_path));
+      ::fst::STTableFarWriter<Arc>::Create(tmp_path));
 #endif  // NO_GOOGLE
   if (!writer) {
-    LOG(FATAL) << "Failed to create writer for: " << out_path;
+    LOG(ERROR) << "Failed to create writer for: " << tmp_path;
+    std::remove(tmp_path.c_str());
+    return false;
   }
-  const auto &fsts = Base::GetFstMap();
+  const auto fsts = Base::GetArchiveFsts();
   for (auto it = fsts.cbegin(); it != fsts.cend(); ++it) {
     VLOG(1) << "Writing FST: " << it->first;
     writer->Add(it->first, *it->second);
   }
+  const bool error = writer->Error();
+  // The STTable index is only written out when the writer is destroyed.
+  writer.reset();
+  if (error) {
+    LOG(ERROR) << "Failed to write: " << tmp_path;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  if (std::rename(tmp_path.c_str(), out_path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to move " << tmp_path << " to " << out_path;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
 }
 
 // A lot of code outside this build uses GrmManager with the old meaning of
@@ -0,0 +1,88 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Interns identifier components (and grammar filenames) as small integer IDs.
+// The parser interns every identifier when it builds the IdentifierNode, which
+// keeps only the IDs, so that name resolution during evaluation hashes and
+// compares integers rather than building and hashing strings.
+//
+// An interner is installed on the current thread (see Scope) while a grammar
+// is parsed or evaluated. A compilation's grammars (the top-level one and those
+// it imports) share one, so that their IDs are comparable; see GrmCompilerSpec.
+// The compile server shares one across the compilations of a generation of
+// parsed grammars; see ParsedGrammarCache. An interner thus lives only as long
+// as the grammars parsed with it, and since each is used by one compilation at
+// a time, it needs no locking.
+
+#ifndef THRAX_IDENTIFIER_INTERNER_H_
+#define THRAX_IDENTIFIER_INTERNER_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+
+namespace thrax {
+
+class IdentifierInterner {
+ public:
+  using Id = uint32_t;
+
+  IdentifierInterner() = default;
+
+  // Returns the interner installed on this thread, or nullptr.
+  static const std::shared_ptr<IdentifierInterner>& Current();
+
+  // Installs the interner on this thread for the lifetime of the scope.
+  class Scope {
+   public:
+    explicit Scope(std::shared_ptr<IdentifierInterner> interner);
+
+    ~Scope();
+
+   private:
+    std::shared_ptr<IdentifierInterner> previous_;
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+  // Returns the ID of the name, assigning the next free one if it is new.
+  Id Intern(std::string_view name);
+
+  // Returns the name that was interned as the given ID. The reference stays
+  // valid as long as the interner.
+  const std::string& Name(Id id) const;
+
+  // Returns the number of distinct names interned so far.
+  size_t Size() const { return names_.size(); }
+
+ private:
+  // Names by ID. A deque never moves its elements, so the keys of ids_ can
+  // point into it.
+  std::deque<std::string> names_;
+  std::unordered_map<std::string_view, Id> ids_;
+
+  IdentifierInterner(const IdentifierInterner&) = delete;
+  IdentifierInterner& operator=(const IdentifierInterner&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_IDENTIFIER_INTERNER_H_
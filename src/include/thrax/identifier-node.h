@@ -13,8 +13,8 @@
 // limitations under the License.
 //
 // An identifier is a variable name, essentially. This node parses module
-// namespaces, splitting on the dots and provides iteration capabilities over
-// the identifier.
+// namespaces, splitting on the dots. It keeps the components only as IDs of the
+// interner installed while it is built, and resolves their names through it.
 
 #ifndef THRAX_IDENTIFIER_NODE_H_
 #define THRAX_IDENTIFIER_NODE_H_
@@ -24,6 +24,7 @@
 
 #include <fst/compat.h>
 #include <thrax/compat/compat.h>
+#include <thrax/identifier-interner.h>
 #include <thrax/node.h>
 
 namespace thrax {
@@ -32,6 +33,8 @@ class AstWalker;
 
 class IdentifierNode : public Node {
  public:
+  // An IdentifierInterner must be installed on this thread; it must outlive
+  // the node.
   explicit IdentifierNode(const std::string& name);
 
   IdentifierNode(const std::string& name, int begin_pos);
@@ -39,24 +42,23 @@ class IdentifierNode : public Node {
   ~IdentifierNode() override = default;
 
   // Return the entire identifier as originally used in the source.
-  const std::string& Get() const;
+  std::string Get() const;
 
   // Returns the actual identifier - the last component.  For example, if the
   // identifier is foo.bar.baz, this will return baz.
   const std::string& GetIdentifier() const;
 
+  // Returns the interned ID of GetIdentifier().
+  IdentifierInterner::Id GetIdentifierId() const;
+
   // Returns the beginning byte position of the identifier in the source.
   int GetBeginPos() const;
 
   // Returns true if there are any namespace qualifiers and false otherwise.
   bool HasNamespaces() const;
 
-  // STL-style iterator-based accessors of the namespace list.
-  typedef std::vector<std::string>::const_iterator const_iterator;
-
-  const_iterator begin() const;
-
-  const_iterator end() const;
+  // Returns the interned IDs of the namespace components, in order.
+  const std::vector<IdentifierInterner::Id>& GetNamespaceIds() const;
 
   // Returns true if the identifier provided is valid.  We check for:
   //   - No empty components.
@@ -68,12 +70,12 @@ class IdentifierNode : public Node {
   void Accept(AstWalker* walker) override;
 
  private:
-  bool CalculateValidity();
+  static bool CalculateValidity(const std::vector<std::string>& components);
 
-  std::string full_name_;
-  std::string identifier_;
-  // The full_name_ broken up by namespaces.
-  std::vector<std::string> namespaces_;
+  IdentifierInterner* interner_;
+  // The interned IDs of the last component and of the namespaces before it.
+  IdentifierInterner::Id identifier_id_;
+  std::vector<IdentifierInterner::Id> namespace_ids_;
   int begin_pos_;
   bool valid_;
 
@@ -20,11 +20,15 @@
 #include <string.h>
 #include <algorithm>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <fst/compat.h>
+#include <fst/mapped-file.h>
 #include <thrax/compat/compat.h>
 #include <thrax/compat/utils.h>
 
@@ -47,18 +51,31 @@ class Lexer {
 
   static const std::set<std::string> kKeywords;
 
-  // Must be called before the grammar is processed via repeated calls to
-  // YYLex().
+  // One of these must be called before the grammar is processed via repeated
+  // calls to YYLex(). ScanString() scans a copy of the string. ScanBuffer()
+  // scans the buffer in place, so it must outlive the lexer. ScanFile() maps
+  // the file into memory and scans it in place; it returns false if the file
+  // cannot be mapped or does not end in a newline (which the parser needs), in
+  // which case nothing is scanned.
   void ScanString(const std::string &str) {
-    grammar_.push(GrammarFile("", str));
+    owned_contents_.push_back(std::make_unique<std::string>(str));
+    ScanBuffer(*owned_contents_.back());
   }
 
+  void ScanBuffer(std::string_view buffer, const std::string &filename = "") {
+    grammar_.push(GrammarFile(filename, buffer));
+  }
+
+  bool ScanFile(const std::string &filename);
+
   // Parses one token and returns its type. Token data is accessible via
   // 'YYString()'.
   TokenClass YYLex();
 
-  // Access to the most recently read string.
-  const std::string &YYString() const;
+  // Access to the most recently read string, which remains valid until the
+  // next call to YYLex(). It points into the grammar itself unless the token
+  // is a string literal with escape sequences.
+  std::string_view YYString() const;
 
   // Access to the beginning and one past end positions of the most recently
   // read string. The difference between the two may not equal the length of
@@ -80,11 +97,11 @@ class Lexer {
     if (grammar_.empty()) return "";
     int end = curr_file()->pos;
     int start = curr_file()->content.rfind('\n', end - 1);
-    if (start == std::string::npos)
+    if (start == std::string_view::npos)
       start = 0;
     else
       ++start;  // Skip over the actual newline.
-    return curr_file()->content.substr(start, end - start);
+    return std::string(curr_file()->content.substr(start, end - start));
   }
 
   // Path to current grammar file.
@@ -95,13 +112,15 @@ class Lexer {
  private:
   // Information about the current token.
   struct Token {
-    std::string token_string;
+    std::string_view token_string;  // Into the grammar or into unescaped.
+    std::string unescaped;  // Holds string literals with escape sequences.
     TokenClass token_class;
     int begin_pos;
     int end_pos;
 
     void Reset() {
-      token_string.clear();
+      token_string = std::string_view();
+      unescaped.clear();
       token_class = EOS;
       begin_pos = -1;
       end_pos = -1;
@@ -109,19 +128,23 @@ class Lexer {
   };
 
   struct GrammarFile {
-    GrammarFile(const std::string &fn, const std::string &cont)
+    GrammarFile(const std::string &fn, std::string_view cont)
         : filename(fn), content(cont), pos(0), line_number(1) {}
     GrammarFile()
         : pos(0), line_number(1) {}
 
     std::string filename;
-    std::string content;
+    std::string_view content;  // Owned by the lexer or by the caller.
     int pos;
     int line_number;
   };
 
   Token curr_token_;            // Current token data.
   std::stack<GrammarFile> grammar_;
+  // The storage behind the grammars scanned with ScanString() and ScanFile().
+  // It is kept after the grammars are popped, since tokens may point into it.
+  std::vector<std::unique_ptr<std::string>> owned_contents_;
+  std::vector<std::unique_ptr<::fst::MappedFile>> mapped_files_;
 
   GrammarFile *curr_file() { return &grammar_.top(); }
   const GrammarFile *curr_file() const { return &grammar_.top(); }
@@ -143,6 +166,11 @@ class Lexer {
     return c;
   }
 
+  // Returns the address of the next character in the current file.
+  const char *CurrentData() const {
+    return curr_file()->content.data() + curr_file()->pos;
+  }
+
   // Moves processing position one character back.
   void UnGetChar() {
     GrammarFile *const current_file = curr_file();
@@ -0,0 +1,134 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef THRAX_LIVENESS_ANALYZER_H_
+#define THRAX_LIVENESS_ANALYZER_H_
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/identifier-interner.h>
+#include <thrax/walker.h>
+
+namespace thrax {
+
+class CollectionNode;
+class FstNode;
+class FunctionNode;
+class GrammarNode;
+class IdentifierNode;
+class ImportNode;
+class Node;
+class RepetitionFstNode;
+class ReturnNode;
+class RuleNode;
+class StatementNode;
+class StringFstNode;
+class StringNode;
+
+// An AST walker that finds, for the main body of a grammar and for each
+// function body, where each local variable is used for the last time, so that
+// the evaluator can release its value right away instead of at the end of the
+// scope. Bodies are straight-line code, so the last use in the text is the last
+// use in every evaluation.
+//
+// A variable whose last use is its only reference in that statement can be
+// moved out of the environment at that reference. One referenced several times
+// in its last statement is released once the statement completes, since the
+// evaluator need not visit the references in textual order. The value of a rule
+// that is never referenced is not kept at all. Exported variables are kept for
+// the export, and variables defined more than once are left alone so that the
+// evaluator still reports the clobbering.
+class AstLivenessAnalyzer : public AstWalker {
+ public:
+  using Id = IdentifierInterner::Id;
+
+  AstLivenessAnalyzer();
+  ~AstLivenessAnalyzer() override;
+
+  // Analyzes the statements of the main body of the grammar.
+  void AnalyzeGrammar(GrammarNode* node);
+
+  // Analyzes the body of the function, unless it was analyzed before.
+  void AnalyzeFunction(FunctionNode* node);
+
+  // Returns true if the variable referenced can be moved out of the
+  // environment at this reference.
+  bool IsLastUse(const IdentifierNode* node) const {
+    return last_uses_.count(node);
+  }
+
+  // Returns the variables to release once the statement has been evaluated, or
+  // nullptr if there are none.
+  const std::vector<Id>* ReleasesAfter(const StatementNode* node) const;
+
+  // Returns true if the value of the rule is never used.
+  bool IsDead(const RuleNode* node) const { return dead_rules_.count(node); }
+
+  void Visit(CollectionNode* node) override;
+  void Visit(FstNode* node) override;
+  void Visit(RepetitionFstNode* node) override;
+  void Visit(ReturnNode* node) override;
+  void Visit(RuleNode* node) override;
+  void Visit(StatementNode* node) override;
+  void Visit(StringFstNode* node) override;
+
+  // The following functions have no useful work to be done, since these nodes
+  // cannot reference local variables (or, for identifiers, are handled by
+  // their parent nodes).
+  void Visit(FunctionNode* node) override {}
+  void Visit(GrammarNode* node) override {}
+  void Visit(IdentifierNode* node) override {}
+  void Visit(ImportNode* node) override {}
+  void Visit(StringNode* node) override {}
+
+ private:
+  // The most recent reference to a variable.
+  struct Use {
+    const IdentifierNode* node;
+    const StatementNode* statement;
+    int count;  // The number of references within the statement.
+  };
+
+  // A variable of the scope being analyzed.
+  struct Variable {
+    int definitions = 0;
+    const RuleNode* rule = nullptr;  // The defining rule, if any.
+    bool exported = false;
+    Use last_use = {nullptr, nullptr, 0};
+  };
+
+  // Analyzes a sequence of statements, with the arguments bound on entry.
+  void AnalyzeScope(CollectionNode* arguments, CollectionNode* statements);
+
+  // The variables of the scope being analyzed, and the statement being walked.
+  std::unordered_map<Id, Variable> variables_;
+  const StatementNode* statement_;
+  // The results.
+  std::unordered_set<const IdentifierNode*> last_uses_;
+  std::unordered_map<const StatementNode*, std::vector<Id>> releases_after_;
+  std::unordered_set<const RuleNode*> dead_rules_;
+  std::set<const FunctionNode*> analyzed_functions_;
+
+  AstLivenessAnalyzer(const AstLivenessAnalyzer&) = delete;
+  AstLivenessAnalyzer& operator=(const AstLivenessAnalyzer&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_LIVENESS_ANALYZER_H_
@@ -15,6 +15,7 @@
 #ifndef THRAX_NAMESPACE_H_
 #define THRAX_NAMESPACE_H_
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <stack>
@@ -22,6 +23,7 @@
 
 #include <fst/compat.h>
 #include <thrax/compat/compat.h>
+#include <thrax/identifier-interner.h>
 #include <thrax/identifier-node.h>
 #include <thrax/resource-map.h>
 
@@ -31,8 +33,14 @@ namespace thrax {
 // identifiers. Essentially, this is a manager/wrapper for `ResourceMap`,
 // collecting shared resources into a single map and allowing local variables to
 // live in a hierarchical stack of maps.
+//
+// Names are interned (see IdentifierInterner), and the maps are keyed by
+// integers: local variables by the ID of their name, and shared resources by
+// the ID of the namespace's filename combined with the ID of the name.
 class Namespace {
  public:
+  using Id = IdentifierInterner::Id;
+
   Namespace();
 
   ~Namespace();
@@ -57,32 +65,51 @@ class Namespace {
   // Adds the provided resource to this namespace. Returns true if the resource
   // was a new insertion and false if we clobbered a pre-existing object. The
   // second version inserts the object without taking over ownership of the
-  // pointer.
+  // pointer. Names may be given as strings or as interned IDs.
+  template <typename T>
+  bool Insert(Id identifier_id, std::unique_ptr<T> resource) {
+    return resources_->Insert(MapKey(identifier_id), std::move(resource));
+  }
+
   template <typename T>
   bool Insert(const std::string& identifier_name, std::unique_ptr<T> resource) {
-    const std::string& name = ConstructMapName(identifier_name);
-    return resources_->Insert(name, std::move(resource));
+    return Insert(Intern(identifier_name), std::move(resource));
+  }
+
+  template <typename T>
+  bool InsertWithoutDelete(Id identifier_id, T* resource) {
+    return resources_->InsertWithDeleter(MapKey(identifier_id), resource,
+                                         nullptr);
   }
 
   template <typename T>
   bool InsertWithoutDelete(const std::string& identifier_name, T* resource) {
-    const std::string& name = ConstructMapName(identifier_name);
-    return resources_->InsertWithDeleter(name, resource, nullptr);
+    return InsertWithoutDelete(Intern(identifier_name), resource);
   }
 
   // The same as the above, but this time, we insert into the local namespace
   // instead of the globally shared one.
+  template <typename T>
+  bool InsertLocal(Id identifier_id, std::unique_ptr<T> resource) {
+    return local_env_.top()->Insert(identifier_id, std::move(resource));
+  }
+
   template <typename T>
   bool InsertLocal(const std::string& identifier_name,
                    std::unique_ptr<T> resource) {
-    return local_env_.top()->Insert(identifier_name, std::move(resource));
+    return InsertLocal(Intern(identifier_name), std::move(resource));
+  }
+
+  template <typename T>
+  bool InsertLocalWithoutDelete(Id identifier_id, T* resource) {
+    return local_env_.top()->InsertWithDeleter(identifier_id, resource,
+                                               nullptr);
   }
 
   template <typename T>
   bool InsertLocalWithoutDelete(const std::string& identifier_name,
                                 T* resource) {
-    return local_env_.top()->InsertWithDeleter(identifier_name, resource,
-                                               nullptr);
+    return InsertLocalWithoutDelete(Intern(identifier_name), resource);
   }
 
   // Returns the resource associated with this namespace (and nullptr if the
@@ -91,13 +118,13 @@ class Namespace {
   // namespace where it was found.
   template <typename T>
   T* Get(const IdentifierNode& identifier, Namespace** where) {
+    const Id id = identifier.GetIdentifierId();
     // If the identifier doesn't have a namespace, then we should check the
     // local variables first if possible.
     if (!identifier.HasNamespaces() && !local_env_.empty()) {
-      const std::string& name = identifier.GetIdentifier();
-      if (local_env_.top()->ContainsType<T>(name)) {
+      if (T* resource = local_env_.top()->GetIfType<T>(id)) {
         if (where) *where = this;
-        return local_env_.top()->Get<T>(name);
+        return resource;
       }
     }
 
@@ -106,11 +133,9 @@ class Namespace {
     // global map.
     Namespace* final_namespace = ResolveNamespace(identifier);
     if (final_namespace) {
-      const std::string& name =
-          final_namespace->ConstructMapName(identifier.GetIdentifier());
-      if (resources_->ContainsType<T>(name)) {
+      if (T* resource = resources_->GetIfType<T>(final_namespace->MapKey(id))) {
         if (where) *where = final_namespace;
-        return resources_->Get<T>(name);
+        return resource;
       }
     }
     return nullptr;
@@ -121,7 +146,16 @@ class Namespace {
     return Get<T>(identifier, nullptr);
   }
 
+  // Removes the provided identifier from the top-most local environment and
+  // returns its value, or nullptr if it is not there.
+  template <typename T>
+  std::unique_ptr<T> ReleaseLocal(Id identifier_id) {
+    return local_env_.top()->template Release<T>(identifier_id);
+  }
+
   // Removes the provided identifier from the top-most local environment.
+  bool EraseLocal(Id identifier_id);
+
   bool EraseLocal(const std::string& identifier);
 
   // Returns namespace in the identifier, according to the current iterator
@@ -135,39 +169,47 @@ class Namespace {
   bool IsTopLevel() const;
 
  private:
+  // Shared resources are keyed by MapKey(), local variables by the ID alone.
+  // A compilation evaluates its grammar and imports on a single thread, so the
+  // maps need no locking.
+  using Resources = BasicResourceMap<uint64_t, ResourceMapNoLockPolicy>;
+
   // This constructor creates a sub-namespace that shares resources with the
   // parent. As such, it should be invoked only through AddSubNamespace().
-  Namespace(const std::string& filename, ResourceMap* resource_map);
+  Namespace(const std::string& filename, Resources* resource_map);
 
-  // Creates the semi-unique joined name for a given identifier, currently the
-  // filename followed by a slash followed by the identifier name.
-  std::string ConstructMapName(const std::string& identifier_name) const;
+  // Names are interned by the interner installed while the grammars are
+  // evaluated, which is the one their identifiers were interned by.
+  static Id Intern(const std::string& name) {
+    return IdentifierInterner::Current()->Intern(name);
+  }
 
-  // Internal version of ResolveNamespace() which also takes an iterator to the
-  // current identifier's namespace position.
-  Namespace* ResolveNamespaceInternal(
-      const IdentifierNode& identifier,
-      IdentifierNode::const_iterator* identifier_nspos);
+  // Creates the unique key for a given identifier in the shared map: the ID of
+  // the filename in the upper half and the ID of the identifier in the lower.
+  uint64_t MapKey(Id identifier_id) const {
+    return (static_cast<uint64_t>(filename_id_) << 32) | identifier_id;
+  }
 
   // This is true if this namespace is the top-level one (i.e., the one
   // corresponding to the main body of the file currently being compiled) and
   // false otherwise.
   bool toplevel_;
-  // The filename associated with this particular namespace alias.
+  // The filename associated with this particular namespace alias, and its ID.
   std::string filename_;
-  // Provides a mapping from a single-component alias to the next Namespace
-  // object. This map is expected to be reasonably small, so we'll use a normal
-  // map instead of a hash_map.
-  std::map<std::string, std::unique_ptr<Namespace>> alias_namespace_map_;
-  // The actual map of string to global resources. This resource map will likely
-  // be shared across this namespace and all sub-namespaces. Keys are those
-  // provided by ConstructMapName().
-  ResourceMap* resources_;
+  Id filename_id_;
+  // Provides a mapping from the ID of a single-component alias to the next
+  // Namespace object. This map is expected to be reasonably small, so we'll use
+  // a normal map instead of a hash_map.
+  std::map<Id, std::unique_ptr<Namespace>> alias_namespace_map_;
+  // The actual map of global resources. This resource map will likely be shared
+  // across this namespace and all sub-namespaces. Keys are those provided by
+  // MapKey().
+  Resources* resources_;
   bool owns_resources_;
   // We still, however, need a list of local variables on a per-namespace basis.
   // This will be for function calls primarily and other non-globally-exported
   // stuff.
-  std::stack<std::unique_ptr<ResourceMap>> local_env_;
+  std::stack<std::unique_ptr<Resources>> local_env_;
 
   Namespace(const Namespace&) = delete;
   Namespace& operator=(const Namespace&) = delete;
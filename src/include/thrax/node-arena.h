@@ -0,0 +1,80 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An arena for the nodes of an abstract syntax tree.
+//
+// The parser creates a node for nearly every token of a grammar, and large
+// generated grammars have hundreds of thousands of them. While a NodeArena is
+// installed on the current thread (via NodeArena::Scope), Node::operator new
+// carves nodes out of the arena's blocks rather than allocating each one
+// separately, and Node::operator delete leaves their memory to the arena. The
+// nodes' destructors still run as usual, so the owning pointers within the
+// tree work unchanged; the arena only has to outlive the trees built in it.
+
+#ifndef THRAX_NODE_ARENA_H_
+#define THRAX_NODE_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+
+namespace thrax {
+
+class NodeArena {
+ public:
+  explicit NodeArena(size_t block_size = kDefaultBlockSize);
+
+  // Returns a suitably aligned block of the given size, which stays valid
+  // until the arena is destroyed.
+  void* Allocate(size_t size);
+
+  // Returns the number of bytes handed out so far.
+  size_t BytesAllocated() const { return bytes_allocated_; }
+
+  // Returns the arena installed on this thread, or nullptr.
+  static NodeArena* Current();
+
+  // Installs the arena on this thread for the lifetime of the scope.
+  class Scope {
+   public:
+    explicit Scope(NodeArena* arena);
+
+    ~Scope();
+
+   private:
+    NodeArena* const previous_;
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+ private:
+  static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+  const size_t block_size_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_;        // The free part of the current block.
+  size_t remaining_;  // Its size.
+  size_t bytes_allocated_;
+
+  NodeArena(const NodeArena&) = delete;
+  NodeArena& operator=(const NodeArena&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_NODE_ARENA_H_
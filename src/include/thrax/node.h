@@ -17,6 +17,8 @@
 #ifndef THRAX_NODE_H_
 #define THRAX_NODE_H_
 
+#include <cstddef>
+
 #include <fst/compat.h>
 #include <thrax/compat/compat.h>
 namespace thrax {
@@ -37,6 +39,12 @@ class Node {
 
   int getline() const;
 
+  // Nodes are allocated from the NodeArena current on this thread, if any, and
+  // from the heap otherwise.
+  static void* operator new(size_t size);
+
+  static void operator delete(void* ptr);
+
  protected:
   int line_number_;  // Where in the file this node is found.
 
@@ -14,24 +14,85 @@
 //
 // This function does a cleaning up of an FST by determinizing and minimizing
 // it. If it's a transducer, we encode the arcs beforehand.
+//
+// Determinization can blow up exponentially. An optional second argument of
+// the form 'budget=N' (or --optimize_state_budget) caps the number of states
+// it may produce; past that, the FST is only minimized as a non-deterministic
+// acceptor, and the rule is reported by the evaluator.
+//
+// An FST which may have weighted cycles is made deterministic according to a
+// strategy, given as another optional argument (or --optimize_strategy):
+//
+//   'encode': encodes the labels and weights before determinizing.
+//   'push': pushes the weights and encodes only the labels, falling back to
+//     'encode' when determinization of the pushed FST fails to converge;
+//     tropical-semiring FSTs without negative weights only.
+//   'auto': 'push' where it applies, 'encode' otherwise.
+//
+// The default is 'encode'.
+//
+// With --v=1, each optimization logs the sizes before and after, and its time.
 
 #ifndef THRAX_OPTIMIZE_H_
 #define THRAX_OPTIMIZE_H_
 
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <fst/compat.h>
 #include <thrax/compat/compat.h>
+#include <thrax/compat/utils.h>
 #include <fst/vector-fst.h>
 #include <thrax/algo/optimize.h>
+#include <thrax/compilation-context.h>
 #include <thrax/datatype.h>
 #include <thrax/function.h>
 
+DECLARE_int64(optimize_state_budget);  // From util/flags.cc.
+DECLARE_string(optimize_strategy);     // From util/flags.cc.
+
 namespace thrax {
 namespace function {
 
+// Determinization budgets, as taken by Optimize and CDRewriteCascade.
+
+inline constexpr char kStateBudgetPrefix[] = "budget=";
+
+// Returns the budget set by --optimize_state_budget, or -1 if there is none.
+inline int64_t DefaultStateBudget() {
+  return FST_FLAGS_optimize_state_budget > 0 ? FST_FLAGS_optimize_state_budget
+                                             : -1;
+}
+
+// Returns true if the argument is an option of the form 'budget=N'.
+inline bool IsStateBudgetOption(const std::string& option) {
+  return option.compare(0, sizeof(kStateBudgetPrefix) - 1,
+                        kStateBudgetPrefix) == 0;
+}
+
+// Parses a 'budget=N' option into *max_states. If N is not a positive integer,
+// reports this on behalf of the named function and returns false.
+inline bool ParseStateBudget(const std::string& function_name,
+                             const std::string& option, int64_t* max_states) {
+  if (IsStateBudgetOption(option)) {
+    char* end = nullptr;
+    const char* digits = option.c_str() + sizeof(kStateBudgetPrefix) - 1;
+    const int64_t value = std::strtoll(digits, &end, 10);
+    if (end != digits && *end == '\0' && value > 0) {
+      *max_states = value;
+      return true;
+    }
+  }
+  std::cout << function_name << ": Invalid state budget: " << option
+            << std::endl;
+  return false;
+}
+
 template <typename Arc>
 class Optimize : public UnaryFstFunction<Arc> {
  public:
@@ -46,8 +107,55 @@ class Optimize : public UnaryFstFunction<Arc> {
   // rigmarole.
   static std::unique_ptr<Transducer> ActuallyOptimize(
       const Transducer& fst, bool compute_props = false) {
+    return ActuallyOptimize(fst, compute_props, DefaultStateBudget());
+  }
+
+  // As above, but determinization gives up past max_states states (if
+  // non-negative).
+  static std::unique_ptr<Transducer> ActuallyOptimize(const Transducer& fst,
+                                                      bool compute_props,
+                                                      int64_t max_states) {
+    ::fst::OptimizeStrategy strategy;
+    if (!GetStrategy(FST_FLAGS_optimize_strategy, &strategy)) {
+      LOG(WARNING) << "Optimize: Unknown --optimize_strategy: "
+                   << FST_FLAGS_optimize_strategy << "; using 'encode'";
+      strategy = ::fst::OPTIMIZE_ENCODE_WEIGHTS;
+    }
+    return ActuallyOptimize(fst, compute_props, max_states, strategy);
+  }
+
+  // As above, with the given strategy for FSTs with weighted cycles.
+  static std::unique_ptr<Transducer> ActuallyOptimize(
+      const Transducer& fst, bool compute_props, int64_t max_states,
+      ::fst::OptimizeStrategy strategy) {
+    // Counting the arcs takes a pass over the FST, so the sizes and the time
+    // are only measured if they will be logged.
+    const bool log_stats = VLOG_IS_ON(1);
+    std::chrono::steady_clock::time_point start;
+    if (log_stats) start = std::chrono::steady_clock::now();
     auto output = std::make_unique<MutableTransducer>(fst);
-    ::fst::Optimize(output.get(), compute_props);
+    size_t num_states = 0;
+    size_t num_arcs = 0;
+    if (log_stats) {
+      num_states = output->NumStates();
+      num_arcs = NumArcs(*output);
+    }
+    if (!::fst::Optimize(output.get(), compute_props, max_states, strategy)) {
+      VLOG(1) << "Optimize: determinization exceeded " << max_states
+              << " states; minimized without determinizing";
+      if (auto* context = CompilationContext::Current())
+        context->NoteOptimizeFallback();
+    }
+    if (log_stats) {
+      VLOG(1) << "Optimize (" << StrategyName(strategy) << "): " << num_states
+              << " states, " << num_arcs << " arcs -> "
+              << output->NumStates() << " states, " << NumArcs(*output)
+              << " arcs in "
+              << std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << "s";
+    }
     return output;
   }
 
@@ -62,16 +170,67 @@ class Optimize : public UnaryFstFunction<Arc> {
   std::unique_ptr<Transducer> UnaryFstExecute(
       const Transducer& fst,
       const std::vector<std::unique_ptr<DataType>>& args) final {
-    if (args.size() != 1) {
-      std::cout << "Optimize: Expected 1 argument but got " << args.size()
+    if (args.size() < 1 || args.size() > 3) {
+      std::cout << "Optimize: Expected 1-3 arguments but got " << args.size()
                 << std::endl;
       return nullptr;
     }
-
-    return ActuallyOptimize(fst);
+    if (args.size() == 1) return ActuallyOptimize(fst);
+    int64_t max_states = DefaultStateBudget();
+    ::fst::OptimizeStrategy strategy;
+    if (!GetStrategy(FST_FLAGS_optimize_strategy, &strategy))
+      strategy = ::fst::OPTIMIZE_ENCODE_WEIGHTS;
+    for (int i = 1; i < args.size(); ++i) {
+      if (!args[i]->is<std::string>()) {
+        std::cout << "Optimize: Expected string for argument " << i + 1
+                  << std::endl;
+        return nullptr;
+      }
+      const auto& option = *args[i]->get<std::string>();
+      if (GetStrategy(option, &strategy)) continue;
+      if (!IsStateBudgetOption(option)) {
+        std::cout << "Optimize: Expected 'budget=N', 'auto', 'encode' or "
+                  << "'push' for argument " << i + 1 << std::endl;
+        return nullptr;
+      }
+      if (!ParseStateBudget("Optimize", option, &max_states)) return nullptr;
+    }
+    return ActuallyOptimize(fst, false, max_states, strategy);
   }
 
  private:
+  static bool GetStrategy(const std::string& name,
+                          ::fst::OptimizeStrategy* strategy) {
+    if (name == "auto") {
+      *strategy = ::fst::OPTIMIZE_AUTO;
+    } else if (name == "encode") {
+      *strategy = ::fst::OPTIMIZE_ENCODE_WEIGHTS;
+    } else if (name == "push") {
+      *strategy = ::fst::OPTIMIZE_PUSH_WEIGHTS;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  static const char* StrategyName(::fst::OptimizeStrategy strategy) {
+    switch (strategy) {
+      case ::fst::OPTIMIZE_ENCODE_WEIGHTS:
+        return "encode";
+      case ::fst::OPTIMIZE_PUSH_WEIGHTS:
+        return "push";
+      default:
+        return "auto";
+    }
+  }
+
+  static size_t NumArcs(const MutableTransducer& fst) {
+    size_t num_arcs = 0;
+    for (typename Arc::StateId s = 0; s < fst.NumStates(); ++s)
+      num_arcs += fst.NumArcs(s);
+    return num_arcs;
+  }
+
   Optimize<Arc>(const Optimize<Arc>&) = delete;
   Optimize<Arc>& operator=(const Optimize<Arc>&) = delete;
 };
@@ -0,0 +1,82 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef THRAX_PURITY_CHECKER_H_
+#define THRAX_PURITY_CHECKER_H_
+
+#include <map>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+#include <thrax/walker.h>
+
+namespace thrax {
+
+class CollectionNode;
+class FstNode;
+class FunctionNode;
+class GrammarNode;
+class IdentifierNode;
+class ImportNode;
+class Namespace;
+class RepetitionFstNode;
+class ReturnNode;
+class RuleNode;
+class StatementNode;
+class StringFstNode;
+class StringNode;
+
+// An AST walker that determines whether a call to a grammar function can have
+// any effect besides returning its result, namely whether its body calls an
+// assertion, directly or through other functions. The results of pure
+// functions depend only on their arguments and may be reused.
+class AstPurityChecker : public AstWalker {
+ public:
+  AstPurityChecker();
+  ~AstPurityChecker() override;
+
+  // Returns true if the function, defined in the provided namespace, is pure.
+  // The answer is remembered for subsequent calls.
+  bool IsPure(FunctionNode* node, Namespace* env);
+
+  void Visit(CollectionNode* node) override;
+  void Visit(FstNode* node) override;
+  void Visit(RepetitionFstNode* node) override;
+  void Visit(ReturnNode* node) override;
+  void Visit(RuleNode* node) override;
+  void Visit(StatementNode* node) override;
+  void Visit(StringFstNode* node) override;
+
+  // The following functions have no useful work to be done, since these nodes
+  // cannot contain calls (or, for functions, are only checked when called).
+  void Visit(FunctionNode* node) override {}
+  void Visit(GrammarNode* node) override {}
+  void Visit(IdentifierNode* node) override {}
+  void Visit(ImportNode* node) override {}
+  void Visit(StringNode* node) override {}
+
+ private:
+  std::map<const FunctionNode*, bool> pure_;
+  // The namespace in which the function being checked resolves its calls.
+  Namespace* env_;
+  // Whether the function being checked is pure so far.
+  bool pure_so_far_;
+
+  AstPurityChecker(const AstPurityChecker&) = delete;
+  AstPurityChecker& operator=(const AstPurityChecker&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_PURITY_CHECKER_H_
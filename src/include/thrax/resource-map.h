@@ -14,13 +14,19 @@
 //
 // A generic resource manager that can hold objects of any pointer type.
 // Pointers can be placed into the ResourceMap associated with particular string
-// keys.  At a later time, those pointers can then be retrieved again using the
-// appropriate keys along with the types of the original pointers.  The
+// keys (or, with BasicResourceMap, keys of any hashable type, such as the
+// interned identifier IDs the evaluator's namespaces use).  At a later time,
+// those pointers can then be retrieved again using the appropriate keys along
+// with the types of the original pointers.  The
 // ResourceMap takes and maintains (forever) ownership of all provided pointers.
 //
 // ResourceMap is thread-safe with respect to itself.  Pointers can be provided
 // to multiple clients, however, and might be accessed/modified in a non-safe
-// manner (depending on the object).
+// manner (depending on the object).  A BasicResourceMap that is only used from
+// one thread can skip the locking with ResourceMapNoLockPolicy.
+//
+// The objects are held in a flat open-addressing table, and Find() retrieves
+// an object together with its type in a single probe.
 //
 // Example:
 //   ResourceMap map;
@@ -39,24 +45,48 @@
 #ifndef THRAX_RESOURCE_MAP_H_
 #define THRAX_RESOURCE_MAP_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
 #include <typeinfo>
+#include <utility>
+#include <vector>
 
 #include <fst/compat.h>
 #include <thrax/compat/compat.h>
-#include <unordered_map>
 
 namespace thrax {
 
-class ResourceMap {
- private:
-  struct Resource;
-  using Map = std::unordered_map<std::string, std::unique_ptr<Resource>>;
+// Lock policies for BasicResourceMap. Each provides a Mutex and a scoped Lock
+// constructed from a pointer to it.
+struct ResourceMapMutexPolicy {
+  using Mutex = ::fst::Mutex;
+  using Lock = ::fst::MutexLock;
+};
+
+struct ResourceMapNoLockPolicy {
+  struct Mutex {};
+
+  struct Lock {
+    explicit Lock(Mutex*) {}
+  };
+};
 
+template <typename Key, typename LockPolicy = ResourceMapMutexPolicy>
+class BasicResourceMap {
  public:
-  ResourceMap() = default;
+  // A stored object along with the type it was stored as.
+  struct Resource {
+    const void* data;
+    const std::type_info* type;
+    std::function<void()> deleter;
+  };
+
+  BasicResourceMap() : size_(0), erased_(0), shift_(64) {}
+
+  ~BasicResourceMap() { ClearSlots(); }
 
   // Inserts the specified object into the map using the provided name,
   // replacing any existing object. Returns true if the object is a new
@@ -64,7 +94,7 @@ class ResourceMap {
   // Generates a default pointer deleter functor. This method will construct a
   // deleter that frees the object by calling delete.
   template <typename T>
-  bool Insert(const std::string& name, std::unique_ptr<T> thing) {
+  bool Insert(const Key& name, std::unique_ptr<T> thing) {
     const T* thing_ptr = thing.get();
     auto deleter = [thing_ptr](){ delete thing_ptr; };
     return InsertWithDeleter(name, thing.release(), std::move(deleter));
@@ -74,16 +104,33 @@ class ResourceMap {
   // functor. If a delete functor is provided, ResourceMap will take ownership
   // of the functor pointer and call it when the object dies.
   template <typename T>
-  bool InsertWithDeleter(const std::string& name, T* thing,
+  bool InsertWithDeleter(const Key& name, T* thing,
                          std::function<void()> deleter) {
-    ::fst::MutexLock lock(&mutex_);
-    // Searches the map for the correct hash position of the new insert.
-    // Creates a new Resource container to hold the pointer as well as a deleter
-    // functor, which we create now since we only are sure of the type at this
-    // moment.
-    auto ret = map_.insert_or_assign(name, std::make_unique<Resource>(
-        static_cast<const void*>(thing), typeid(thing), std::move(deleter)));
-    return ret.second;
+    Lock lock(&mutex_);
+    // Keeps at least half of the slots empty, so that probes stay short.
+    if (2 * (size_ + erased_ + 1) > slots_.size()) Rehash();
+    Slot& slot = slots_[InsertIndex(name)];
+    const bool inserted = slot.state != Slot::kFull;
+    if (inserted) {
+      if (slot.state == Slot::kErased) --erased_;
+      slot.state = Slot::kFull;
+      slot.key = name;
+      ++size_;
+    } else {
+      Destroy(&slot.resource);
+    }
+    // The resource holds the pointer as well as a deleter functor, which we
+    // create now since we only are sure of the type at this moment.
+    slot.resource = Resource{static_cast<const void*>(thing), &typeid(thing),
+                             std::move(deleter)};
+    return inserted;
+  }
+
+  // Returns the object with the provided name along with its type, or nullptr
+  // if there is none. The result is valid until the map is next modified.
+  const Resource* Find(const Key& name) const {
+    Lock lock(&mutex_);
+    return FindResource(name);
   }
 
   // Retrieves the object with the provided name and templated type. Returns
@@ -92,103 +139,203 @@ class ResourceMap {
   // ownership of the pointer, so clients should not delete the pointer
   // received.
   template <typename T>
-  T* Get(const std::string& name) const {
-    ::fst::MutexLock lock(&mutex_);
-    const auto it = map_.find(name);
-    if (it == map_.end()) return nullptr;
-    CheckType<T>(it, name);
-    // We need to remove the const if the client's original type wasn't const.
-    // If it was, however, we'll stick it right back on during the static_cast
-    // and return.
-    return static_cast<T *>(const_cast<void *>(it->second->data));
+  T* Get(const Key& name) const {
+    Lock lock(&mutex_);
+    const Resource* resource = FindResource(name);
+    if (!resource) return nullptr;
+    CheckType<T>(*resource, name);
+    return Cast<T>(*resource);
+  }
+
+  // Like Get(), but returns nullptr rather than crashing if the object is of
+  // another type. This replaces a call to ContainsType() followed by Get().
+  template <typename T>
+  T* GetIfType(const Key& name) const {
+    Lock lock(&mutex_);
+    const Resource* resource = FindResource(name);
+    if (!resource || *resource->type != typeid(T*)) return nullptr;
+    return Cast<T>(*resource);
   }
 
   // Returns true if the map contains an object with the given name
   // (disregarding the type of the stored object).
-  bool Contains(const std::string& name) const {
-    ::fst::MutexLock lock(&mutex_);
-    return map_.find(name) != map_.end();
-  }
+  bool Contains(const Key& name) const { return Find(name) != nullptr; }
 
   // Returns true if the map contains an object with the given name of the
   // proper type.
   template <typename T>
-  bool ContainsType(const std::string& name) const {
-    ::fst::MutexLock lock(&mutex_);
-    const auto it = map_.find(name);
-    return it != map_.end() && it->second->type == typeid(T*);
+  bool ContainsType(const Key& name) const {
+    Lock lock(&mutex_);
+    const Resource* resource = FindResource(name);
+    return resource && *resource->type == typeid(T*);
   }
 
   // Removes the specified object from the map. Returns true if an object was
   // successfully erased, and false if the object didn't exist.
-  bool Erase(const std::string& name) {
-    ::fst::MutexLock lock(&mutex_);
-    auto it = map_.find(name);
-    if (it == map_.end()) return false;
-    map_.erase(it);
+  bool Erase(const Key& name) {
+    Lock lock(&mutex_);
+    const size_t index = FindIndex(name);
+    if (index == kNotFound) return false;
+    Destroy(&slots_[index].resource);
+    EraseSlot(index);
     return true;
   }
 
   template <typename T>
-  std::unique_ptr<T> Release(const std::string& name) {
-    ::fst::MutexLock lock(&mutex_);
+  std::unique_ptr<T> Release(const Key& name) {
+    Lock lock(&mutex_);
     std::unique_ptr<T> val = nullptr;
-    auto it = map_.find(name);
-    if (it != map_.end()) {
-      CheckType<T>(it, name);
-      val = fst::WrapUnique(
-          static_cast<T*>(const_cast<void*>(it->second->data)));
-      // Releases the data in the Resource, then delete the Resource
-      // but not the data it contains
-      it->second->Release();
-      map_.erase(it);
+    const size_t index = FindIndex(name);
+    if (index != kNotFound) {
+      Resource* resource = &slots_[index].resource;
+      CheckType<T>(*resource, name);
+      val = fst::WrapUnique(Cast<T>(*resource));
+      // Forgets the data without deleting it.
+      *resource = Resource{nullptr, nullptr, nullptr};
+      EraseSlot(index);
     }
     return val;
   }
 
   // Returns the number of elements in the map.
   int Size() const {
-    ::fst::MutexLock lock(&mutex_);
-    return map_.size();
+    Lock lock(&mutex_);
+    return size_;
   }
 
   // Erases all elements in the current map.
   void Clear() {
-    ::fst::MutexLock lock(&mutex_);
-    map_.clear();
+    Lock lock(&mutex_);
+    ClearSlots();
   }
 
  private:
+  using Lock = typename LockPolicy::Lock;
+
+  struct Slot {
+    enum State : uint8_t { kEmpty, kFull, kErased };
+
+    State state = kEmpty;
+    Key key;
+    Resource resource = {nullptr, nullptr, nullptr};
+  };
+
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+  static constexpr size_t kMinSlots = 16;
+
   // Checks that the desired type is actually the same as the one originally
   // stored.  T should be the base (non-pointer) type.
   template <typename T>
-  void CheckType(Map::const_iterator it, const std::string& name) const {
-    const auto &original_type = it->second->type;
+  static void CheckType(const Resource& resource, const Key& name) {
+    const auto &original_type = *resource.type;
     const auto &requested_type = typeid(T*);
     CHECK(original_type == requested_type)
         ;  // NOLINT
   }
 
-  struct Resource {
-    Resource(const void* data_, const std::type_info& type_,
-             std::function<void()> deleter_)
-        : data(data_), type(type_), deleter(std::move(deleter_)) {}
+  // We need to remove the const if the client's original type wasn't const.
+  // If it was, however, we'll stick it right back on during the static_cast.
+  template <typename T>
+  static T* Cast(const Resource& resource) {
+    return static_cast<T*>(const_cast<void*>(resource.data));
+  }
+
+  static void Destroy(Resource* resource) {
+    if (resource->deleter) resource->deleter();
+    *resource = Resource{nullptr, nullptr, nullptr};
+  }
+
+  // Returns the slot to start probing from: the top bits of the hash, spread
+  // by Fibonacci hashing so that clustered keys (like consecutive IDs) do not
+  // collide.
+  size_t HomeIndex(const Key& name) const {
+    return (static_cast<uint64_t>(std::hash<Key>()(name)) *
+            0x9e3779b97f4a7c15ULL) >> shift_;
+  }
 
-    ~Resource() {
-      if (deleter) deleter();
+  const Resource* FindResource(const Key& name) const {
+    const size_t index = FindIndex(name);
+    return index == kNotFound ? nullptr : &slots_[index].resource;
+  }
+
+  size_t FindIndex(const Key& name) const {
+    if (!size_) return kNotFound;
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = HomeIndex(name);; i = (i + 1) & mask) {
+      const Slot& slot = slots_[i];
+      if (slot.state == Slot::kEmpty) return kNotFound;
+      if (slot.state == Slot::kFull && slot.key == name) return i;
     }
+  }
 
-    void Release() { deleter = nullptr; }
+  // Returns the slot holding the key if there is one, and otherwise the first
+  // free slot on its probe sequence (reusing erased slots).
+  size_t InsertIndex(const Key& name) const {
+    const size_t mask = slots_.size() - 1;
+    size_t erased = kNotFound;
+    for (size_t i = HomeIndex(name);; i = (i + 1) & mask) {
+      const Slot& slot = slots_[i];
+      if (slot.state == Slot::kEmpty) return erased == kNotFound ? i : erased;
+      if (slot.state == Slot::kErased) {
+        if (erased == kNotFound) erased = i;
+      } else if (slot.key == name) {
+        return i;
+      }
+    }
+  }
 
-    const void* data;
-    const std::type_info& type;
-    std::function<void()> deleter;
-  };
+  void EraseSlot(size_t index) {
+    Slot& slot = slots_[index];
+    slot.state = Slot::kErased;
+    slot.key = Key();
+    --size_;
+    ++erased_;
+  }
+
+  // Resizes the table for the current number of objects (at most a quarter
+  // full), dropping the erased slots.
+  void Rehash() {
+    size_t num_slots = kMinSlots;
+    int shift = 64 - 4;
+    while (num_slots < 4 * (size_ + 1)) {
+      num_slots *= 2;
+      --shift;
+    }
+    std::vector<Slot> old_slots(num_slots);
+    old_slots.swap(slots_);
+    shift_ = shift;
+    erased_ = 0;
+    for (auto& old_slot : old_slots) {
+      if (old_slot.state != Slot::kFull) continue;
+      Slot& slot = slots_[InsertIndex(old_slot.key)];
+      slot.state = Slot::kFull;
+      slot.key = std::move(old_slot.key);
+      slot.resource = std::move(old_slot.resource);
+    }
+  }
+
+  void ClearSlots() {
+    for (auto& slot : slots_) {
+      if (slot.state == Slot::kFull) Destroy(&slot.resource);
+    }
+    slots_.clear();
+    size_ = 0;
+    erased_ = 0;
+    shift_ = 64;
+  }
+
+  std::vector<Slot> slots_;  // The number of slots is a power of two.
+  size_t size_;              // The number of full slots.
+  size_t erased_;            // The number of erased slots.
+  int shift_;                // 64 minus the log of the number of slots.
+  mutable typename LockPolicy::Mutex mutex_;
 
-  Map map_;
-  mutable ::fst::Mutex mutex_;
+  BasicResourceMap(const BasicResourceMap&) = delete;
+  BasicResourceMap& operator=(const BasicResourceMap&) = delete;
 };
 
+using ResourceMap = BasicResourceMap<std::string>;
+
 };  // namespace thrax
 
 #endif  // THRAX_RESOURCE_MAP_H_
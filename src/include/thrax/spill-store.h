@@ -0,0 +1,82 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Writing the FSTs bound to grammar variables to disk when a compilation would
+// otherwise exceed its memory budget.
+//
+// The evaluator keeps an estimate of the memory held by the FSTs bound to
+// variables (see EstimateDataTypeBytes). With --max_memory_mb set, whenever the
+// estimate exceeds the budget it writes the least recently used of them to the
+// SpillStore's directory and frees them, and reads them back the next time they
+// are referenced.
+
+#ifndef THRAX_SPILL_STORE_H_
+#define THRAX_SPILL_STORE_H_
+
+#include <cstdint>
+#include <string>
+
+#include <fst/compat.h>
+#include <thrax/compat/compat.h>
+
+DECLARE_int64(max_memory_mb);
+DECLARE_string(spill_dir);
+
+namespace thrax {
+
+// Owns a private directory for the spilled FSTs, which it removes (along with
+// any files left in it) when destroyed.
+class SpillStore {
+ public:
+  explicit SpillStore(int64_t max_bytes);
+
+  ~SpillStore();
+
+  // The budget for the FSTs held in memory, in bytes.
+  int64_t max_bytes() const { return max_bytes_; }
+
+  // Returns a path at which to write a spilled FST, or the empty string if the
+  // spill directory cannot be created.
+  std::string NewPath();
+
+  // Removes a spilled file once it has been read back or is no longer needed.
+  void Remove(const std::string& path);
+
+  void NoteSpill(int64_t bytes) {
+    ++spills_;
+    spilled_bytes_ += bytes;
+  }
+
+  void NoteReload() { ++reloads_; }
+
+  // Returns a one-line summary of the FSTs written and read back.
+  std::string Stats() const;
+
+ private:
+  const int64_t max_bytes_;
+  std::string directory_;
+  // Set once creating the directory has failed, so that we do not retry.
+  bool failed_;
+  int64_t next_file_;
+  int64_t spills_;
+  int64_t spilled_bytes_;
+  int64_t reloads_;
+
+  SpillStore(const SpillStore&) = delete;
+  SpillStore& operator=(const SpillStore&) = delete;
+};
+
+}  // namespace thrax
+
+#endif  // THRAX_SPILL_STORE_H_
@@ -17,7 +17,11 @@
 #ifndef THRAX_STRINGFILE_H_
 #define THRAX_STRINGFILE_H_
 
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <vector>
@@ -29,6 +33,7 @@
 #include <fst/push.h>
 #include <fst/rmepsilon.h>
 #include <fst/string.h>
+#include <thrax/algo/fingerprint.h>
 #include <thrax/algo/stringmap.h>
 #include <thrax/datatype.h>
 #include <thrax/function.h>
@@ -36,6 +41,8 @@
 
 DECLARE_bool(save_symbols);  // From util/flags.cc.
 DECLARE_string(indir);  // From util/flags.cc.
+DECLARE_int32(stringfile_threads);  // From util/flags.cc.
+DECLARE_bool(stringfile_cache);  // From util/flags.cc.
 
 namespace thrax {
 namespace function {
@@ -115,9 +122,21 @@ class StringFile : public Function<Arc> {
     }
     const auto filename = JoinPath(FST_FLAGS_indir,
                                            *args[0]->get<std::string>());
+    std::string cache_path;
+    uint64_t cache_key = 0;
+    if (FST_FLAGS_stringfile_cache &&
+        CacheKey(filename, imode, omode, isymbols, osymbols, &cache_key)) {
+      cache_path = ::fst::StrCat(filename, ".", Arc::Type(), ".fstcache");
+      auto cached = ReadCache(cache_path, cache_key);
+      if (cached) {
+        VLOG(1) << "StringFile: Using cached " << cache_path;
+        return std::make_unique<DataType>(std::move(cached));
+      }
+    }
     auto fst = std::make_unique<MutableTransducer>();
     if (!::fst::StringFileCompile(filename, fst.get(), imode, omode,
-                                      isymbols, osymbols)) {
+                                      isymbols, osymbols,
+                                      FST_FLAGS_stringfile_threads)) {
       std::cout << "StringFile: File inaccessible or malformed" << std::endl;
       return nullptr;
     }
@@ -134,8 +153,90 @@ class StringFile : public Function<Arc> {
       fst->SetInputSymbols(isymbols);
       fst->SetOutputSymbols(osymbols);
     }
+    if (!cache_path.empty()) WriteCache(cache_path, cache_key, *fst);
     return std::make_unique<DataType>(std::move(fst));
   }
+
+ private:
+  // Identifies the cache files of StringFile.
+  static constexpr int32_t kCacheMagic = 0x5354461a;
+
+  // Computes the key under which the FST compiled from the file is cached:
+  // a fingerprint of its contents, the parse modes, the symbol tables and the
+  // arc type. Returns false if the file cannot be read, or if it may use
+  // generated symbols, whose labels depend on what else was compiled first.
+  static bool CacheKey(const std::string &filename, ::fst::TokenType imode,
+                       ::fst::TokenType omode,
+                       const ::fst::SymbolTable *isymbols,
+                       const ::fst::SymbolTable *osymbols, uint64_t *key) {
+    std::ifstream strm(filename, std::ios::binary);
+    if (!strm) return false;
+    const std::string contents((std::istreambuf_iterator<char>(strm)),
+                               std::istreambuf_iterator<char>());
+    if (strm.bad()) return false;
+    if ((imode != ::fst::TokenType::SYMBOL ||
+         omode != ::fst::TokenType::SYMBOL) &&
+        contents.find('[') != std::string::npos) {
+      return false;
+    }
+    uint64_t fingerprint = ::fst::FingerprintBytes(contents);
+    fingerprint = ::fst::FingerprintCombine(
+        fingerprint, ::fst::FingerprintBytes(Arc::Type()));
+    fingerprint =
+        ::fst::FingerprintCombine(fingerprint, static_cast<uint64_t>(imode));
+    fingerprint =
+        ::fst::FingerprintCombine(fingerprint, static_cast<uint64_t>(omode));
+    fingerprint = ::fst::FingerprintCombine(
+        fingerprint, isymbols ? ::fst::FingerprintSymbolTable(*isymbols) : 0);
+    fingerprint = ::fst::FingerprintCombine(
+        fingerprint, osymbols ? ::fst::FingerprintSymbolTable(*osymbols) : 0);
+    *key = ::fst::FingerprintCombine(fingerprint, FST_FLAGS_save_symbols);
+    return true;
+  }
+
+  // Returns the FST cached at the path, or nullptr if there is none or it
+  // was cached under another key.
+  static std::unique_ptr<MutableTransducer> ReadCache(const std::string &path,
+                                                      uint64_t key) {
+    std::ifstream strm(path, std::ios::binary);
+    if (!strm) return nullptr;
+    int32_t magic = 0;
+    uint64_t cached_key = 0;
+    strm.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    strm.read(reinterpret_cast<char *>(&cached_key), sizeof(cached_key));
+    if (!strm || magic != kCacheMagic || cached_key != key) return nullptr;
+    return ::fst::WrapUnique(
+        MutableTransducer::Read(strm, ::fst::FstReadOptions(path)));
+  }
+
+  // Writes the FST to the cache. It is written to a temporary file of its own
+  // first and then renamed, so that concurrent compilations (which may write
+  // the same cache) never see a partial or interleaved one. Failing to write
+  // the cache is not an error.
+  static void WriteCache(const std::string &path, uint64_t key,
+                         const MutableTransducer &fst) {
+    const auto tmp_path = MakeTempFileFor(path);
+    if (tmp_path.empty()) {
+      VLOG(1) << "StringFile: Cannot write cache " << path;
+      return;
+    }
+    {
+      std::ofstream strm(tmp_path, std::ios::binary);
+      strm.write(reinterpret_cast<const char *>(&kCacheMagic),
+                 sizeof(kCacheMagic));
+      strm.write(reinterpret_cast<const char *>(&key), sizeof(key));
+      if (!strm || !fst.Write(strm, ::fst::FstWriteOptions(tmp_path)) ||
+          !strm.flush()) {
+        VLOG(1) << "StringFile: Cannot write cache " << tmp_path;
+        std::remove(tmp_path.c_str());
+        return;
+      }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      VLOG(1) << "StringFile: Cannot write cache " << path;
+      std::remove(tmp_path.c_str());
+    }
+  }
 };
 
 }  // namespace function
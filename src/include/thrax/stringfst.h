@@ -32,7 +32,10 @@
 #include <fst/compat.h>
 #include <thrax/compat/compat.h>
 #include <fst/string.h>
+#include <thrax/algo/flat_prefix_tree.h>
 #include <thrax/algo/stringcompile.h>
+#include <thrax/algo/stringmap.h>
+#include <thrax/compilation-context.h>
 #include <thrax/fst-node.h>
 #include <thrax/datatype.h>
 #include <thrax/function.h>
@@ -94,28 +97,34 @@ class StringFst : public Function<Arc> {
       std::cout << "StringFst: Failed to compile string: " << text << std::endl;
       return nullptr;
     }
-    if (FST_FLAGS_save_symbols) {
-      const ::fst::SymbolTable* syms_to_attach = nullptr;
-      switch (mode) {
-        case ::fst::TokenType::BYTE: {
-          syms_to_attach = GetByteSymbolTable();
-          break;
-        }
-        case ::fst::TokenType::UTF8: {
-          syms_to_attach = GetUtf8SymbolTable();
-          break;
-        }
-        case ::fst::TokenType::SYMBOL: {
-          syms_to_attach = symtab;
-        }
-      }
-      fst->SetInputSymbols(syms_to_attach);
-      fst->SetOutputSymbols(syms_to_attach);
-    }
+    if (FST_FLAGS_save_symbols) AttachSymbols(mode, symtab, fst.get());
     return std::make_unique<DataType>(std::move(fst));
   }
 
  public:
+  // Attaches the symbol table matching the parse mode to both sides of the
+  // FST, as required with --save_symbols.
+  static void AttachSymbols(::fst::TokenType mode,
+                            const ::fst::SymbolTable* symtab,
+                            MutableTransducer* fst) {
+    const ::fst::SymbolTable* syms_to_attach = nullptr;
+    switch (mode) {
+      case ::fst::TokenType::BYTE: {
+        syms_to_attach = GetByteSymbolTable();
+        break;
+      }
+      case ::fst::TokenType::UTF8: {
+        syms_to_attach = GetUtf8SymbolTable();
+        break;
+      }
+      case ::fst::TokenType::SYMBOL: {
+        syms_to_attach = symtab;
+      }
+    }
+    fst->SetInputSymbols(syms_to_attach);
+    fst->SetOutputSymbols(syms_to_attach);
+  }
+
   // Returns a symbol table corresponding to the generated labels used thus far
   // in this compilation. This returns nullptr if there were no generated
   // labels.
@@ -152,16 +161,16 @@ class StringFst : public Function<Arc> {
   // This takes in a symbol table and merges it into the current symbol/label
   // map, returning true on success or failure if we encounter any conflicts.
   static bool MergeLabelSymbolTable(const ::fst::SymbolTable& symtab) {
-    return ::fst::thrax_internal::MergeIntoGeneratedSymbols(symtab,
-                                                                &remap_);
+    return ::fst::thrax_internal::MergeIntoGeneratedSymbols(symtab, Remap());
   }
 
-  static void ClearRemap() { remap_.clear(); }
+  static void ClearRemap() { Remap()->clear(); }
 
   // Returns the remap value, or ::fst::kNoLabel
   static int64_t FindRemapLabel(int64_t old_label) {
-    const auto it = remap_.find(old_label);
-    return it == remap_.end() ? ::fst::kNoLabel : it->second;
+    const auto* remap = Remap();
+    const auto it = remap->find(old_label);
+    return it == remap->end() ? ::fst::kNoLabel : it->second;
   }
 
   // This stores the assigned label for the provided symbol (from the map) into
@@ -180,10 +189,17 @@ class StringFst : public Function<Arc> {
   // clean up between test runs. This is somewhat less appropriately named than
   // it used to be since it clears more than just the generated SymbolTable.
   static void ClearSymbolLabelMapForTest() {
-    remap_.clear();
+    Remap()->clear();
     ::fst::thrax_internal::ResetGeneratedSymbols();
   }
 
+  // Returns the remap of the current compilation, or a process-wide one when
+  // called outside of a compilation.
+  static std::map<int64_t, int64_t>* Remap() {
+    auto* context = CompilationContext::Current();
+    return context ? context->label_remap() : &remap_;
+  }
+
   static std::map<int64_t, int64_t> remap_;
 
   friend class CategoryTest;
@@ -198,6 +214,59 @@ class StringFst : public Function<Arc> {
 template <typename Arc>
 typename std::map<int64_t, int64_t> StringFst<Arc>::remap_;
 
+// Compiles the union of any number of byte or UTF-8 strings, as given by a
+// parse mode followed by the texts, into a prefix tree acceptor. The evaluator
+// uses this for unions of string literals, which would otherwise become an
+// epsilon-laden union of one FST per string.
+template <typename Arc>
+class StringUnion : public Function<Arc> {
+ public:
+  using MutableTransducer = ::fst::VectorFst<Arc>;
+
+  StringUnion() {}
+  ~StringUnion() final {}
+
+ protected:
+  std::unique_ptr<DataType> Execute(
+      const std::vector<std::unique_ptr<DataType>>& args) final {
+    CHECK_GE(args.size(), 2);
+    auto mode = ::fst::TokenType::BYTE;
+    switch (*args[0]->get<int>()) {
+      case StringFstNode::BYTE: {
+        mode = ::fst::TokenType::BYTE;
+        break;
+      }
+      case StringFstNode::UTF8: {
+        mode = ::fst::TokenType::UTF8;
+        break;
+      }
+      default: {
+        LOG(FATAL) << "Unhandled parse mode.";
+      }
+    }
+    ::fst::internal::StringMapCompiler<Arc,
+                                       ::fst::FlatAcceptorPrefixTree<Arc>>
+        compiler(mode, mode);
+    for (int i = 1; i < args.size(); ++i) {
+      const auto& text = *args[i]->get<std::string>();
+      if (!compiler.Add(text)) {
+        std::cout << "StringUnion: Failed to compile string: " << text
+                  << std::endl;
+        return nullptr;
+      }
+    }
+    auto fst = std::make_unique<MutableTransducer>();
+    compiler.Compile(fst.get());
+    if (FST_FLAGS_save_symbols)
+      StringFst<Arc>::AttachSymbols(mode, nullptr, fst.get());
+    return std::make_unique<DataType>(std::move(fst));
+  }
+
+ private:
+  StringUnion<Arc>(const StringUnion<Arc>&) = delete;
+  StringUnion<Arc>& operator=(const StringUnion<Arc>&) = delete;
+};
+
 }  // namespace function
 }  // namespace thrax
 
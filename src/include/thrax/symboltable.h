@@ -56,14 +56,14 @@ class SymbolTable : public Function<Arc> {
     const auto& file = JoinPath(FST_FLAGS_indir,
                                         *args[0]->get<std::string>());
     VLOG(2) << "Loading symbol table: " << file;
-    std::unique_ptr<::fst::SymbolTable> symtab(
+    std::shared_ptr<const ::fst::SymbolTable> symtab(
         ::fst::SymbolTable::ReadText(file));
     if (!symtab) {
       std::cout << "SymbolTable: Unable to load symbol table file: " << file
                 << std::endl;
       return nullptr;
     }
-    return std::make_unique<DataType>(*symtab);
+    return std::make_unique<DataType>(std::move(symtab));
   }
 
  private:
@@ -13,7 +13,9 @@
 // limitations under the License.
 //
 // Wrapper for the union function, which expands the first argument and unions
-// into it (destructive-mode) or just uses UnionFst (delayed-mode).
+// into it (destructive-mode) or just uses UnionFst (delayed-mode). In
+// destructive mode, any number of arguments may be given; the evaluator uses
+// this to build chains like a | b | c in one operation.
 
 #ifndef THRAX_UNION_H_
 #define THRAX_UNION_H_
@@ -46,29 +48,36 @@ class Union : public BinaryFstFunction<Arc> {
   std::unique_ptr<Transducer> BinaryFstExecute(
       const Transducer& left, const Transducer& right,
       const std::vector<std::unique_ptr<DataType>>& args) final {
-    if (args.size() != 2) {
-      std::cout << "Union: Expected 2 arguments but got " << args.size()
-                << std::endl;
-      return nullptr;
-    }
-    if (FST_FLAGS_save_symbols) {
-      if (!::fst::CompatSymbols(left.InputSymbols(),
-                                    right.InputSymbols())) {
-        std::cout << "Union: input symbol table of 1st argument "
-                  << "does not match input symbol table of 2nd argument"
+    for (int i = 2; i < args.size(); ++i) {
+      if (!args[i]->is<Transducer*>()) {
+        std::cout << "Union: Expected FST for argument " << i + 1
                   << std::endl;
         return nullptr;
       }
-      if (!::fst::CompatSymbols(left.OutputSymbols(),
-                                    right.OutputSymbols())) {
-        std::cout << "Union: output symbol table of 1st argument "
-                  << "does not match output symbol table of 2nd argument"
-                  << std::endl;
-        return nullptr;
+    }
+    if (FST_FLAGS_save_symbols) {
+      for (int i = 1; i < args.size(); ++i) {
+        const Transducer& fst = **args[i]->get<Transducer*>();
+        if (!::fst::CompatSymbols(left.InputSymbols(), fst.InputSymbols())) {
+          std::cout << "Union: input symbol table of 1st argument "
+                    << "does not match input symbol table of argument "
+                    << i + 1 << std::endl;
+          return nullptr;
+        }
+        if (!::fst::CompatSymbols(left.OutputSymbols(),
+                                  fst.OutputSymbols())) {
+          std::cout << "Union: output symbol table of 1st argument "
+                    << "does not match output symbol table of argument "
+                    << i + 1 << std::endl;
+          return nullptr;
+        }
       }
     }
+    // Unioning into the one expanded copy keeps this linear in the total size
+    // of the arguments: the start state is split at most once.
     auto mutable_left = std::make_unique<MutableTransducer>(left);
-    ::fst::Union(mutable_left.get(), right);
+    for (int i = 1; i < args.size(); ++i)
+      ::fst::Union(mutable_left.get(), **args[i]->get<Transducer*>());
     return mutable_left;
   }
 
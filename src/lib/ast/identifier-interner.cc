@@ -0,0 +1,54 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/identifier-interner.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace thrax {
+namespace {
+
+thread_local std::shared_ptr<IdentifierInterner> current_interner;
+
+}  // namespace
+
+const std::shared_ptr<IdentifierInterner>& IdentifierInterner::Current() {
+  return current_interner;
+}
+
+IdentifierInterner::Scope::Scope(std::shared_ptr<IdentifierInterner> interner)
+    : previous_(std::move(current_interner)) {
+  current_interner = std::move(interner);
+}
+
+IdentifierInterner::Scope::~Scope() { current_interner = std::move(previous_); }
+
+IdentifierInterner::Id IdentifierInterner::Intern(std::string_view name) {
+  const auto it = ids_.find(name);
+  if (it != ids_.end()) return it->second;
+  const Id id = names_.size();
+  names_.emplace_back(name);
+  ids_.emplace(names_.back(), id);
+  return id;
+}
+
+const std::string& IdentifierInterner::Name(Id id) const {
+  CHECK_LT(id, names_.size());
+  return names_[id];
+}
+
+}  // namespace thrax
@@ -19,6 +19,7 @@
 #include <string>
 #include <vector>
 
+#include <thrax/identifier-interner.h>
 #include <thrax/node.h>
 #include <thrax/walker.h>
 
@@ -47,26 +48,41 @@ IdentifierNode::IdentifierNode(const std::string& name)
     : IdentifierNode(name, -1) {}
 
 IdentifierNode::IdentifierNode(const std::string& name, int begin_pos)
-    : Node(), full_name_(name), begin_pos_(begin_pos) {
-  namespaces_ = ::fst::StringSplit(full_name_, '.');
-  identifier_ = namespaces_.back();
-  namespaces_.pop_back();
-  valid_ = CalculateValidity();
+    : Node(), interner_(IdentifierInterner::Current().get()),
+      begin_pos_(begin_pos) {
+  CHECK(interner_);
+  std::vector<std::string> components = ::fst::StringSplit(name, '.');
+  if (components.empty()) components.emplace_back();
+  valid_ = CalculateValidity(components);
+  namespace_ids_.reserve(components.size() - 1);
+  for (size_t i = 0; i + 1 < components.size(); ++i)
+    namespace_ids_.push_back(interner_->Intern(components[i]));
+  identifier_id_ = interner_->Intern(components.back());
 }
 
-IdentifierNode::const_iterator IdentifierNode::begin() const {
-  return namespaces_.begin();
-}
+bool IdentifierNode::HasNamespaces() const { return !namespace_ids_.empty(); }
 
-IdentifierNode::const_iterator IdentifierNode::end() const {
-  return namespaces_.end();
+const std::string& IdentifierNode::GetIdentifier() const {
+  return interner_->Name(identifier_id_);
 }
 
-bool IdentifierNode::HasNamespaces() const { return !namespaces_.empty(); }
+IdentifierInterner::Id IdentifierNode::GetIdentifierId() const {
+  return identifier_id_;
+}
 
-const std::string& IdentifierNode::GetIdentifier() const { return identifier_; }
+const std::vector<IdentifierInterner::Id>& IdentifierNode::GetNamespaceIds()
+    const {
+  return namespace_ids_;
+}
 
-const std::string& IdentifierNode::Get() const { return full_name_; }
+std::string IdentifierNode::Get() const {
+  std::string name;
+  for (const auto id : namespace_ids_) {
+    name += interner_->Name(id);
+    name += '.';
+  }
+  return name + GetIdentifier();
+}
 
 int IdentifierNode::GetBeginPos() const { return begin_pos_; }
 
@@ -74,11 +90,12 @@ bool IdentifierNode::IsValid() const { return valid_; }
 
 void IdentifierNode::Accept(AstWalker* walker) { walker->Visit(this); }
 
-bool IdentifierNode::CalculateValidity() {
-  for (const auto& ns : namespaces_) {
-    if (!ComponentIsValid(ns)) return false;
+bool IdentifierNode::CalculateValidity(
+    const std::vector<std::string>& components) {
+  for (const auto& component : components) {
+    if (!ComponentIsValid(component)) return false;
   }
-  return ComponentIsValid(identifier_);
+  return true;
 }
 
 }  // namespace thrax
@@ -0,0 +1,67 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/node-arena.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace thrax {
+namespace {
+
+thread_local NodeArena* current_arena = nullptr;
+
+constexpr size_t kAlignment = alignof(std::max_align_t);
+
+size_t RoundUp(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+}  // namespace
+
+NodeArena::NodeArena(size_t block_size)
+    : block_size_(RoundUp(block_size)),
+      next_(nullptr),
+      remaining_(0),
+      bytes_allocated_(0) {}
+
+void* NodeArena::Allocate(size_t size) {
+  size = RoundUp(size);
+  bytes_allocated_ += size;
+  // Unusually large requests get a block of their own, so that they do not
+  // waste the rest of the current one.
+  if (size > block_size_ / 4) {
+    blocks_.emplace_back(new char[size]);
+    return blocks_.back().get();
+  }
+  if (size > remaining_) {
+    blocks_.emplace_back(new char[block_size_]);
+    next_ = blocks_.back().get();
+    remaining_ = block_size_;
+  }
+  void* result = next_;
+  next_ += size;
+  remaining_ -= size;
+  return result;
+}
+
+NodeArena* NodeArena::Current() { return current_arena; }
+
+NodeArena::Scope::Scope(NodeArena* arena) : previous_(current_arena) {
+  current_arena = arena;
+}
+
+NodeArena::Scope::~Scope() { current_arena = previous_; }
+
+}  // namespace thrax
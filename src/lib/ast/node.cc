@@ -14,7 +14,21 @@
 //
 #include <thrax/node.h>
 
+#include <cstddef>
+#include <new>
+
+#include <thrax/node-arena.h>
+
 namespace thrax {
+namespace {
+
+// Each node is preceded by a header recording the arena it came from (nullptr
+// for the heap), so that operator delete knows whether to free it. The header
+// is padded to keep the node itself maximally aligned.
+constexpr size_t kHeaderSize = alignof(std::max_align_t);
+static_assert(kHeaderSize >= sizeof(NodeArena*), "Node header is too small");
+
+}  // namespace
 
 Node::Node() : line_number_(-1) {}
 
@@ -22,4 +36,20 @@ void Node::SetLine(int line) { line_number_ = line; }
 
 int Node::getline() const { return line_number_; }
 
+void* Node::operator new(size_t size) {
+  NodeArena* arena = NodeArena::Current();
+  char* header =
+      static_cast<char*>(arena ? arena->Allocate(kHeaderSize + size)
+                               : ::operator new(kHeaderSize + size));
+  *reinterpret_cast<NodeArena**>(header) = arena;
+  return header + kHeaderSize;
+}
+
+void Node::operator delete(void* ptr) {
+  if (!ptr) return;
+  char* header = static_cast<char*>(ptr) - kHeaderSize;
+  // Memory from an arena is released with the arena.
+  if (!*reinterpret_cast<NodeArena**>(header)) ::operator delete(header);
+}
+
 }  // namespace thrax
@@ -22,3 +22,30 @@ DEFINE_bool(save_symbols, false,
 
 DEFINE_string(indir, "", "The directory with the source files.");
 DEFINE_string(outdir, "", "The directory in which we'll write the output.");
+
+DEFINE_int64(optimize_state_budget, 0,
+             "If positive, Optimize[] gives up determinizing an FST once the "
+             "result has this many states, and only minimizes it instead.");
+
+DEFINE_string(optimize_strategy, "encode",
+              "How Optimize[] determinizes an FST which may have weighted "
+              "cycles: 'encode' encodes its labels and weights; 'push' pushes "
+              "its weights and encodes only its labels (tropical semiring, "
+              "no negative weights); 'auto' pushes where that applies.");
+
+DEFINE_int32(stringfile_threads, 1,
+             "Number of threads with which StringFile[] parses a file, in "
+             "chunks; 1 reads it line by line.");
+
+DEFINE_bool(stringfile_cache, false,
+            "Keep the FST that StringFile[] compiles from a file next to it "
+            "(as FILE.ARCTYPE.fstcache), and reuse it while the file, the "
+            "parse modes and the symbol tables stay the same.");
+
+DEFINE_bool(cdrewrite_cache, true,
+            "Share the filters and marker transducers that CDRewrite[] builds "
+            "from sigma and the contexts between the rules of a compilation.");
+
+DEFINE_int32(cdrewrite_threads, 1,
+             "Number of threads on which CDRewrite[] builds the filters of "
+             "a rule, and CDRewriteCascade[] compiles its rules.");
@@ -0,0 +1,90 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/compilation-context.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace thrax {
+namespace {
+
+thread_local CompilationContext* current_context = nullptr;
+
+std::atomic<int64_t> next_serial(0);
+
+}  // namespace
+
+PersistentState::PersistentState(int64_t evaluation_cache_bytes) {
+  if (evaluation_cache_bytes > 0) {
+    evaluation_cache_ =
+        std::make_unique<EvaluationCache>(evaluation_cache_bytes);
+  }
+}
+
+PersistentState::~PersistentState() {}
+
+CompilationContext::CompilationContext() : CompilationContext(nullptr) {}
+
+CompilationContext::CompilationContext(PersistentState* persistent)
+    : serial_(next_serial++),
+      string_compiler_(::fst::internal::StringCompiler::New()),
+      persistent_(persistent),
+      evaluation_cache_(nullptr),
+      live_fst_bytes_(0),
+      peak_live_fst_bytes_(0),
+      optimize_fallbacks_(0) {
+  if (CompileProfiler::Enabled())
+    profiler_ = std::make_unique<CompileProfiler>();
+  if (persistent_) {
+    evaluation_cache_ = persistent_->evaluation_cache();
+  } else if (FST_FLAGS_evaluation_cache_mb > 0) {
+    owned_evaluation_cache_ = std::make_unique<EvaluationCache>(
+        FST_FLAGS_evaluation_cache_mb * 1024 * 1024);
+    evaluation_cache_ = owned_evaluation_cache_.get();
+  }
+  if (FST_FLAGS_max_memory_mb > 0) {
+    spill_store_ =
+        std::make_unique<SpillStore>(FST_FLAGS_max_memory_mb * 1024 * 1024);
+  }
+}
+
+CompilationContext::~CompilationContext() {}
+
+CompilationContext* CompilationContext::Current() { return current_context; }
+
+CompilationContext::Scope::Scope(CompilationContext* context)
+    : prev_(current_context) {
+  current_context = context;
+  ::fst::internal::StringCompiler::SetThreadCompiler(
+      context->string_compiler_.get());
+}
+
+CompilationContext::Scope::~Scope() {
+  current_context = prev_;
+  ::fst::internal::StringCompiler::SetThreadCompiler(
+      prev_ ? prev_->string_compiler_.get() : nullptr);
+}
+
+void CompilationContext::Report() const {
+  VLOG(1) << "Peak live FST bytes (estimated): " << peak_live_fst_bytes_
+          << " (" << peak_live_fst_bytes_ / (1024 * 1024) << " MB)";
+  if (evaluation_cache_)
+    LOG(INFO) << "Evaluation cache: " << evaluation_cache_->Stats();
+  if (spill_store_) LOG(INFO) << "Spilling: " << spill_store_->Stats();
+  if (profiler_) profiler_->WriteRequestedOutputs();
+}
+
+}  // namespace thrax
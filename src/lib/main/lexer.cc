@@ -15,10 +15,22 @@
 #include <thrax/lexer.h>
 
 #include <ctype.h>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <set>
+#include <string>
+#include <string_view>
+
+#include <fst/mapped-file.h>
 
 namespace thrax {
+namespace {
+
+// The length of the longest keyword.
+constexpr size_t kMaxKeywordSize = 6;
+
+}  // namespace
 
 static std::set<std::string> InitStaticKeywords() {
   std::set<std::string> keywords;
@@ -34,12 +46,34 @@ static std::set<std::string> InitStaticKeywords() {
 
 const std::set<std::string> Lexer::kKeywords = InitStaticKeywords();
 
+bool Lexer::ScanFile(const std::string &filename) {
+  std::ifstream strm(filename, std::ios_base::in | std::ios_base::binary);
+  if (!strm) return false;
+  strm.seekg(0, std::ios_base::end);
+  const std::streamoff size = strm.tellg();
+  strm.seekg(0, std::ios_base::beg);
+  if (size <= 0) return false;
+  auto mapped = ::fst::WrapUnique(
+      ::fst::MappedFile::Map(strm, /*memorymap=*/true, filename, size));
+  if (!mapped) return false;
+  const std::string_view contents(static_cast<const char *>(mapped->data()),
+                                  size);
+  if (contents.back() != '\n') return false;
+  mapped_files_.push_back(std::move(mapped));
+  ScanBuffer(contents, filename);
+  return true;
+}
+
 Lexer::TokenClass Lexer::YYLex() {
   int begin_pos = GetPos();
   int c = GetChar();
 
   bool found_token = false;
   curr_token_.Reset();
+  // Except for string literals with escape sequences, the token is a span of
+  // the grammar, which we track rather than copy.
+  const char *token_begin = nullptr;
+  size_t token_size = 0;
 
   while (!grammar_.empty() && !found_token && c != 0) {
     if (isspace(c)) {  // skip space
@@ -59,33 +93,51 @@ Lexer::TokenClass Lexer::YYLex() {
     } else if (c == '"' || c == '\'') {  // quoted string
       char terminator = c;
       curr_token_.token_class = c == '"' ? DOUBLE_QUOTED_STRING : QUOTED_STRING;
+      token_begin = CurrentData();
+      // Whether we have switched to copying into curr_token_.unescaped.
+      bool copying = false;
 
       while (true) {
         char curr_c = GetChar();
         if (curr_c == '\0') {
           LOG(FATAL) << "Found EOF without terminating string: "
-                     << curr_token_.token_string;
+                     << (copying ? curr_token_.unescaped
+                                 : std::string(token_begin, token_size));
         }
         if (curr_c == '\\') {
+          if (!copying) {
+            curr_token_.unescaped.assign(token_begin, token_size);
+            copying = true;
+          }
           curr_c = GetChar();
           CHECK_NE(curr_c, '\0');
           if (curr_c != terminator)
-            curr_token_.token_string += '\\';
+            curr_token_.unescaped += '\\';
         } else if (curr_c == terminator) {
           break;
         }
 
-        curr_token_.token_string += curr_c;
+        if (copying) {
+          curr_token_.unescaped += curr_c;
+        } else {
+          ++token_size;
+        }
+      }
+      if (copying) {
+        token_begin = curr_token_.unescaped.data();
+        token_size = curr_token_.unescaped.size();
       }
 
       found_token = true;
     } else if (is_connector(c)) {  // connector
-      curr_token_.token_string += c;
+      token_begin = CurrentData() - 1;
+      token_size = 1;
       curr_token_.token_class = CONNECTOR;
       found_token = true;
     } else if (isdigit(c) || c == '.' || c == '-') {  // integer
+      token_begin = CurrentData() - 1;
       if (c == '-') {
-        curr_token_.token_string += '-';
+        ++token_size;
         c = GetChar();
         if (!isdigit(c) && c != '.') {
           curr_token_.token_class = CONNECTOR;
@@ -98,16 +150,16 @@ Lexer::TokenClass Lexer::YYLex() {
       found_token = true;
       curr_token_.token_class = INTEGER;
       while (isdigit(c)) {
-        curr_token_.token_string += c;
+        ++token_size;
         c = GetChar();
       }
       if (c == '.') {  // float
-        curr_token_.token_string += c;
+        ++token_size;
         curr_token_.token_class = FLOAT;
         c = GetChar();
         int num_frac_digits = 0;
         while (isdigit(c)) {
-          curr_token_.token_string += c;
+          ++token_size;
           c = GetChar();
           ++num_frac_digits;
         }
@@ -115,22 +167,27 @@ Lexer::TokenClass Lexer::YYLex() {
       }
       if (c != 0) UnGetChar();
     } else if (isalpha(c) || c == '_') {
+      token_begin = CurrentData() - 1;
       found_token = true;
       curr_token_.token_class = CONNECTOR;
       while (isalpha(c) || isdigit(c) || c == '_' || c == '.') {
         if (c != '_' && c != '.')
           curr_token_.token_class = DESCRIPTOR;
-        curr_token_.token_string += c;
+        ++token_size;
         c = GetChar();
       }
       if (c != 0) UnGetChar();
 
-      if (kKeywords.find(curr_token_.token_string) != kKeywords.end())
+      // All keywords are short, so this copy does not allocate.
+      if (token_size <= kMaxKeywordSize &&
+          kKeywords.find(std::string(token_begin, token_size)) !=
+              kKeywords.end())
         curr_token_.token_class = KEYWORD;
     } else if (c == '<') {
       curr_token_.token_class = ANGLE_STRING;
+      token_begin = CurrentData();
       while ((c = GetChar()) != '>') {  // multichar label ([LABEL])
-        curr_token_.token_string += c;
+        ++token_size;
       }
       found_token = true;
     } else {
@@ -144,12 +201,13 @@ Lexer::TokenClass Lexer::YYLex() {
                  << GetCurrentContext() << "'";
     }
   }
+  if (token_begin) curr_token_.token_string = {token_begin, token_size};
   curr_token_.begin_pos = begin_pos;
   curr_token_.end_pos = GetPos();
   return curr_token_.token_class;
 }
 
-const std::string &Lexer::YYString() const { return curr_token_.token_string; }
+std::string_view Lexer::YYString() const { return curr_token_.token_string; }
 
 int Lexer::YYBeginPos() const { return curr_token_.begin_pos; }
 
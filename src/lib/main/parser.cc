@@ -1531,7 +1531,7 @@ yyreduce:
 
   case 19: /* descriptor: tDESCR  */
 #line 197 "main/parser.yy"
-    { const std::string& name = parm->GetLexer()->YYString();
+    { const std::string name(parm->GetLexer()->YYString());
       int begin_pos = parm->GetLexer()->YYBeginPos();
       IdentifierNode* node = new IdentifierNode(name, begin_pos);
       node->SetLine(parm->GetLexer()->line_number());
@@ -1862,13 +1862,13 @@ yyreduce:
 
   case 60: /* number: tINTEGER  */
 #line 418 "main/parser.yy"
-    { (yyval.int_type) = atoi(parm->GetLexer()->YYString().c_str()); }
+    { (yyval.int_type) = atoi(std::string(parm->GetLexer()->YYString()).c_str()); }
 #line 1867 "main/parser.cc"
     break;
 
   case 61: /* quoted_fst_string: tDQSTRING  */
 #line 423 "main/parser.yy"
-    { StringNode* node = new StringNode(parm->GetLexer()->YYString());
+    { StringNode* node = new StringNode(std::string(parm->GetLexer()->YYString()));
       node->SetLine(parm->GetLexer()->line_number());
       (yyval.string_node_type) = node; }
 #line 1875 "main/parser.cc"
@@ -1876,7 +1876,7 @@ yyreduce:
 
   case 62: /* quoted_string: tQSTRING  */
 #line 430 "main/parser.yy"
-    { StringNode* node = new StringNode(parm->GetLexer()->YYString());
+    { StringNode* node = new StringNode(std::string(parm->GetLexer()->YYString()));
       node->SetLine(parm->GetLexer()->line_number());
       (yyval.string_node_type) = node; }
 #line 1883 "main/parser.cc"
@@ -1884,7 +1884,7 @@ yyreduce:
 
   case 63: /* weight: tANGLE_STRING  */
 #line 437 "main/parser.yy"
-    { StringNode* node = new StringNode(parm->GetLexer()->YYString());
+    { StringNode* node = new StringNode(std::string(parm->GetLexer()->YYString()));
       node->SetLine(parm->GetLexer()->line_number());
       (yyval.string_node_type) = node; }
 #line 1891 "main/parser.cc"
@@ -2172,9 +2172,9 @@ int yylex(void *, GrmCompilerParserInterface *parm) {
     case Lexer::ANGLE_STRING:
       return tANGLE_STRING;
     case Lexer::CONNECTOR: {
-      std::string connector = parm->GetLexer()->YYString();
+      const std::string_view connector = parm->GetLexer()->YYString();
       if (connector.length() != 1) {
-        parm->Error(StringPrintf("Parse error - unknown connector: %s", connector.c_str()));
+        parm->Error(StringPrintf("Parse error - unknown connector: %s", std::string(connector).c_str()));
         return 0;
       }
       switch (parm->GetLexer()->YYString()[0]) {
@@ -2198,12 +2198,12 @@ int yylex(void *, GrmCompilerParserInterface *parm) {
         case '{': return tLBRACE;
         case '}': return tRBRACE;
         case '|': return tPIPE;
-        default:  parm->Error(StringPrintf("Parse error - unknown connector: %s", connector.c_str()));
+        default:  parm->Error(StringPrintf("Parse error - unknown connector: %s", std::string(connector).c_str()));
                   return 0;
       }
     }
     case Lexer::KEYWORD: {
-      std::string keyword = parm->GetLexer()->YYString();
+      const std::string_view keyword = parm->GetLexer()->YYString();
       if (keyword == "export") {
         return tKEYWORD_EXPORT;
       } else if (keyword == "as") {
@@ -2219,7 +2219,7 @@ int yylex(void *, GrmCompilerParserInterface *parm) {
       } else if (keyword == "utf8") {
         return tKEYWORD_UTF8;
       } else {
-        parm->Error(StringPrintf("Parse error - unknown keyword: %s", keyword.c_str()));
+        parm->Error(StringPrintf("Parse error - unknown keyword: %s", std::string(keyword).c_str()));
         return 0;
       }
     }
@@ -194,7 +194,7 @@ rule_body:
 
 descriptor:
   tDESCR
-    { const std::string& name = parm->GetLexer()->YYString();
+    { const std::string name(parm->GetLexer()->YYString());
       int begin_pos = parm->GetLexer()->YYBeginPos();
       IdentifierNode* node = new IdentifierNode(name, begin_pos);
       node->SetLine(parm->GetLexer()->line_number());
@@ -415,26 +415,26 @@ fst_with_weight:
 // number.  Compare this to how we handle quoted strings and weights...
 number:
   tINTEGER
-    { $$ = atoi(parm->GetLexer()->YYString().c_str()); }
+    { $$ = atoi(std::string(parm->GetLexer()->YYString()).c_str()); }
 ;
 
 quoted_fst_string:
   tDQSTRING
-    { StringNode* node = new StringNode(parm->GetLexer()->YYString());
+    { StringNode* node = new StringNode(std::string(parm->GetLexer()->YYString()));
       node->SetLine(parm->GetLexer()->line_number());
       $$ = node; }
 ;
 
 quoted_string:
   tQSTRING
-    { StringNode* node = new StringNode(parm->GetLexer()->YYString());
+    { StringNode* node = new StringNode(std::string(parm->GetLexer()->YYString()));
       node->SetLine(parm->GetLexer()->line_number());
       $$ = node; }
 ;
 
 weight:
   tANGLE_STRING
-    { StringNode* node = new StringNode(parm->GetLexer()->YYString());
+    { StringNode* node = new StringNode(std::string(parm->GetLexer()->YYString()));
       node->SetLine(parm->GetLexer()->line_number());
       $$ = node; }
 ;
@@ -504,9 +504,9 @@ int yylex(void *, GrmCompilerParserInterface *parm) {
     case Lexer::ANGLE_STRING:
       return tANGLE_STRING;
     case Lexer::CONNECTOR: {
-      std::string connector = parm->GetLexer()->YYString();
+      const std::string_view connector = parm->GetLexer()->YYString();
       if (connector.length() != 1) {
-        parm->Error(StringPrintf("Parse error - unknown connector: %s", connector.c_str()));
+        parm->Error(StringPrintf("Parse error - unknown connector: %s", std::string(connector).c_str()));
         return 0;
       }
       switch (parm->GetLexer()->YYString()[0]) {
@@ -530,12 +530,12 @@ int yylex(void *, GrmCompilerParserInterface *parm) {
         case '{': return tLBRACE;
         case '}': return tRBRACE;
         case '|': return tPIPE;
-        default:  parm->Error(StringPrintf("Parse error - unknown connector: %s", connector.c_str()));
+        default:  parm->Error(StringPrintf("Parse error - unknown connector: %s", std::string(connector).c_str()));
                   return 0;
       }
     }
     case Lexer::KEYWORD: {
-      std::string keyword = parm->GetLexer()->YYString();
+      const std::string_view keyword = parm->GetLexer()->YYString();
       if (keyword == "export") {
         return tKEYWORD_EXPORT;
       } else if (keyword == "as") {
@@ -551,7 +551,7 @@ int yylex(void *, GrmCompilerParserInterface *parm) {
       } else if (keyword == "utf8") {
         return tKEYWORD_UTF8;
       } else {
-        parm->Error(StringPrintf("Parse error - unknown keyword: %s", keyword.c_str()));
+        parm->Error(StringPrintf("Parse error - unknown keyword: %s", std::string(keyword).c_str()));
         return 0;
       }
     }
@@ -14,14 +14,33 @@
 //
 #include <thrax/algo/stringcompile.h>
 
+#include <memory>
+
+#include <fst/compat.h>
+
 namespace fst {
 namespace internal {
 
+namespace {
+
+thread_local StringCompiler *thread_compiler = nullptr;
+
+}  // namespace
+
 StringCompiler *StringCompiler::Get() {
+  if (thread_compiler) return thread_compiler;
   static auto *kInstance = new StringCompiler();
   return kInstance;
 }
 
+std::unique_ptr<StringCompiler> StringCompiler::New() {
+  return fst::WrapUnique(new StringCompiler());
+}
+
+void StringCompiler::SetThreadCompiler(StringCompiler *compiler) {
+  thread_compiler = compiler;
+}
+
 // Returns kNoLabel on failure.
 int64 StringCompiler::NumericalSymbolToLabel(const std::string &token) const {
   const auto *ctoken = token.c_str();
@@ -139,7 +158,7 @@ bool StringCompiler::MergeIntoGeneratedSymbols(const SymbolTable &symtab,
 // Convenience methods, to eliminate the need to call Get on the singleton.
 
 const SymbolTable &GeneratedSymbols() {
-  static auto *compiler = internal::StringCompiler::Get();
+  auto *compiler = internal::StringCompiler::Get();
   return compiler->GeneratedSymbols();
 }
 
@@ -147,12 +166,12 @@ namespace thrax_internal {
 
 bool MergeIntoGeneratedSymbols(const SymbolTable &symtab,
                                std::map<int64, int64> *remap) {
-  static auto *compiler = internal::StringCompiler::Get();
+  auto *compiler = internal::StringCompiler::Get();
   return compiler->MergeIntoGeneratedSymbols(symtab, remap);
 }
 
 void ResetGeneratedSymbols() {
-  static auto *compiler = internal::StringCompiler::Get();
+  auto *compiler = internal::StringCompiler::Get();
   compiler->Reset();
 }
 
@@ -14,6 +14,8 @@
 //
 #include <thrax/algo/stringfile.h>
 
+#include <algorithm>
+
 #include <thrax/algo/stringutil.h>
 
 namespace fst {
@@ -22,6 +24,7 @@ namespace internal {
 void StringFile::Reset() {
   istrm_.clear();
   istrm_.seekg(0, istrm_.beg);
+  linenum_ = 0;
   Next();
 }
 
@@ -30,10 +33,21 @@ void StringFile::Next() {
   do {
     ++linenum_;
     if (!std::getline(istrm_, line_)) return;
-    line_ = StripCommentAndRemoveEscape(line_);
+    StripCommentAndRemoveEscape(&line_);
   } while (line_.empty());
 }
 
+void SplitColumns(std::string_view line,
+                  std::vector<std::string_view> *columns) {
+  columns->clear();
+  for (size_t begin = 0; begin < line.size();) {
+    auto end = line.find('\t', begin);
+    if (end == std::string_view::npos) end = line.size();
+    if (end > begin) columns->push_back(line.substr(begin, end - begin));
+    begin = end + 1;
+  }
+}
+
 void ColumnStringFile::Reset() {
   sf_.Reset();
   Parse();
@@ -44,5 +58,28 @@ void ColumnStringFile::Next() {
   Parse();
 }
 
+bool ReadStringFileChunks(const std::string &source, int num_chunks,
+                          std::string *contents,
+                          std::vector<std::string_view> *chunks) {
+  std::ifstream istrm(source, std::ios::binary | std::ios::ate);
+  if (!istrm) return false;
+  const std::streamoff size = istrm.tellg();
+  if (size < 0) return false;
+  contents->resize(size);
+  istrm.seekg(0);
+  if (!istrm.read(contents->data(), size)) return false;
+  chunks->clear();
+  const std::string_view text(*contents);
+  const size_t chunk_size = text.size() / std::max(num_chunks, 1) + 1;
+  for (size_t begin = 0; begin < text.size();) {
+    // Extends the chunk to the end of the line it stops in.
+    size_t end = text.find('\n', std::min(begin + chunk_size, text.size()) - 1);
+    end = end == std::string_view::npos ? text.size() : end + 1;
+    chunks->push_back(text.substr(begin, end - begin));
+    begin = end;
+  }
+  return true;
+}
+
 }  // namespace internal
 }  // namespace fst
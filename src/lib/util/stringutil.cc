@@ -14,33 +14,41 @@
 //
 #include <thrax/algo/stringutil.h>
 
-#include <thrax/compat/utils.h>
+#include <cctype>
 
 
 namespace fst {
-namespace {
 
-std::string StripComment(const std::string &line) {
-  char prev_char = '\0';
-  for (size_t i = 0; i < line.size(); ++i) {
-    const char this_char = line[i];
-    if (this_char == '#' && prev_char != '\\') {
+void StripCommentAndRemoveEscape(std::string *line) {
+  // Most lines have no '#' at all, and are left as they are.
+  auto pos = line->find('#');
+  if (pos == std::string::npos) return;
+  for (; pos != std::string::npos; pos = line->find('#', pos + 1)) {
+    if (pos == 0 || (*line)[pos - 1] != '\\') {
       // Strips comment and any trailing whitespace.
-      return std::string(::fst::StripTrailingAsciiWhitespace(line.substr(0, i)));
+      while (pos > 0 &&
+             std::isspace(static_cast<unsigned char>((*line)[pos - 1]))) {
+        --pos;
+      }
+      line->resize(pos);
+      break;
     }
-    prev_char = this_char;
   }
-  return line;
-}
-
-std::string RemoveEscape(const std::string &line) {
-  return thrax::StringReplace(line, "\\#", "#", true);
+  // Removes the escapes, shifting the rest of the line left.
+  size_t size = 0;
+  for (size_t i = 0; i < line->size(); ++i) {
+    if ((*line)[i] == '\\' && i + 1 < line->size() && (*line)[i + 1] == '#') {
+      continue;
+    }
+    (*line)[size++] = (*line)[i];
+  }
+  line->resize(size);
 }
 
-}  // namespace
-
 std::string StripCommentAndRemoveEscape(const std::string &line) {
-  return RemoveEscape(StripComment(line));
+  std::string result(line);
+  StripCommentAndRemoveEscape(&result);
+  return result;
 }
 
 std::string Escape(const std::string &str) {
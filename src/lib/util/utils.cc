@@ -18,7 +18,9 @@
 #include <unistd.h>
 
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 
 #include <fstream>
 #include <numeric>
@@ -140,6 +142,33 @@ bool RecursivelyCreateDir(const std::string &path) {
   return true;
 }
 
+std::string MakeTempFileFor(const std::string &path) {
+  std::string tmp_path = path + ".tmp.XXXXXX";
+  const int fd = mkstemp(&tmp_path[0]);
+  if (fd == -1) return "";
+  // mkstemp() makes the file private to its owner; the file it replaces gets
+  // the usual permissions instead.
+  fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  close(fd);
+  return tmp_path;
+}
+
+FileStamp StatFile(const std::string &path) {
+  FileStamp stamp;
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return stamp;
+  stamp.exists = true;
+#ifdef __APPLE__
+  stamp.mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 +
+                   st.st_mtimespec.tv_nsec;
+#else
+  stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                   st.st_mtim.tv_nsec;
+#endif  // __APPLE__
+  stamp.size = st.st_size;
+  return stamp;
+}
+
 File *Open(const std::string &filename, const std::string &mode) {
   auto m = static_cast<std::ios_base::openmode>(0);
   if (mode.find('r') != std::string::npos) m |= std::ios::in;
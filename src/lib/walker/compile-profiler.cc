@@ -0,0 +1,252 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/compile-profiler.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+DEFINE_string(profile_trace, "",
+              "If non-empty, write a Chrome trace (JSON) of the grammar "
+              "evaluation to this path");
+DEFINE_string(profile_summary, "",
+              "If non-empty, write a table of evaluation time per grammar "
+              "line, most expensive first, to this path (\"-\" for stdout)");
+
+namespace thrax {
+namespace {
+
+// Returns the peak resident set size of the process so far, in kilobytes.
+int64_t PeakRssKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // Bytes on macOS.
+#else
+  return usage.ru_maxrss;
+#endif  // __APPLE__
+}
+
+std::string JsonEscape(const std::string& str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (const char c : str) {
+    switch (c) {
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      case '\t':
+        escaped += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buffer[8];
+          snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+          escaped += buffer;
+        } else {
+          escaped += c;
+        }
+    }
+  }
+  return escaped;
+}
+
+}  // namespace
+
+CompileProfiler::CompileProfiler()
+    : start_(std::chrono::steady_clock::now()) {}
+
+double CompileProfiler::Now() const {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start_)
+      .count();
+}
+
+void CompileProfiler::Begin(const std::string& file, int line,
+                            const std::string& name) {
+  Record record;
+  record.file = file;
+  record.line = line;
+  record.name = name;
+  record.begin_us = Now();
+  record.duration_us = 0;
+  record.self_us = 0;
+  record.input_states = -1;
+  record.input_arcs = -1;
+  record.output_states = -1;
+  record.output_arcs = -1;
+  record.peak_rss_kb = -1;
+  record.saved_us = 0;
+  open_.push_back(records_.size());
+  records_.push_back(std::move(record));
+}
+
+void CompileProfiler::AddInput(const FstSize& size) {
+  if (open_.empty()) return;
+  auto& record = records_[open_.back()];
+  // The totals are only meaningful if every input could be counted.
+  if (size.states < 0) {
+    record.input_states = -2;
+    return;
+  }
+  if (record.input_states == -2) return;
+  record.input_states = std::max<int64_t>(record.input_states, 0) + size.states;
+  record.input_arcs = std::max<int64_t>(record.input_arcs, 0) + size.arcs;
+}
+
+void CompileProfiler::NoteCacheHit(double saved_seconds) {
+  if (open_.empty()) return;
+  records_[open_.back()].saved_us += saved_seconds * 1e6;
+}
+
+void CompileProfiler::End(const FstSize& output) {
+  CHECK(!open_.empty());
+  auto& record = records_[open_.back()];
+  open_.pop_back();
+  record.duration_us = Now() - record.begin_us;
+  record.self_us += record.duration_us;
+  if (record.input_states == -2) record.input_states = record.input_arcs = -1;
+  record.output_states = output.states;
+  record.output_arcs = output.arcs;
+  record.peak_rss_kb = PeakRssKb();
+  // Time spent here is not the parent's own time.
+  if (!open_.empty()) records_[open_.back()].self_us -= record.duration_us;
+}
+
+bool CompileProfiler::WriteTrace(const std::string& path) const {
+  std::ofstream strm(path);
+  if (!strm) {
+    LOG(ERROR) << "Unable to open trace file: " << path;
+    return false;
+  }
+  strm << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first = true;
+  for (const auto& record : records_) {
+    if (!first) strm << ",\n";
+    first = false;
+    strm << std::fixed << std::setprecision(3) << "{\"name\": \""
+         << JsonEscape(record.name) << "\", \"cat\": \"thrax\", \"ph\": \"X\", "
+         << "\"pid\": 1, \"tid\": 1, \"ts\": " << record.begin_us
+         << ", \"dur\": " << record.duration_us << ", \"args\": {\"file\": \""
+         << JsonEscape(record.file) << "\", \"line\": " << record.line
+         << ", \"input_states\": " << record.input_states
+         << ", \"input_arcs\": " << record.input_arcs
+         << ", \"output_states\": " << record.output_states
+         << ", \"output_arcs\": " << record.output_arcs
+         << ", \"cache_saved_us\": " << record.saved_us << "}}";
+    // Samples the peak RSS as a counter track at the end of each record.
+    if (record.peak_rss_kb >= 0) {
+      strm << ",\n{\"name\": \"peak_rss\", \"ph\": \"C\", \"pid\": 1, "
+           << "\"ts\": " << record.begin_us + record.duration_us
+           << ", \"args\": {\"MB\": " << record.peak_rss_kb / 1024.0 << "}}";
+    }
+  }
+  strm << "\n]}\n";
+  return strm.good();
+}
+
+void CompileProfiler::WriteSummary(std::ostream& strm) const {
+  // Aggregates the records by grammar location and operation.
+  struct Total {
+    int64_t count = 0;
+    double self_us = 0;
+    double total_us = 0;
+    int64_t max_output_states = -1;
+    int64_t peak_rss_kb = -1;
+    double saved_us = 0;
+  };
+  using Key = std::tuple<std::string, int, std::string>;
+  std::map<Key, Total> totals;
+  double all_us = 0;
+  for (const auto& record : records_) {
+    auto& total = totals[Key(record.file, record.line, record.name)];
+    ++total.count;
+    total.self_us += record.self_us;
+    total.total_us += record.duration_us;
+    total.max_output_states =
+        std::max(total.max_output_states, record.output_states);
+    total.peak_rss_kb = std::max(total.peak_rss_kb, record.peak_rss_kb);
+    total.saved_us += record.saved_us;
+    all_us += record.self_us;
+  }
+  std::vector<std::pair<Key, Total>> sorted(totals.begin(), totals.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<Key, Total>& a, const std::pair<Key, Total>& b) {
+              return a.second.self_us > b.second.self_us;
+            });
+  strm << std::fixed << std::setprecision(3) << std::setw(10) << "self(s)"
+       << std::setw(8) << "self%" << std::setw(8) << "cum%" << std::setw(10)
+       << "total(s)" << std::setw(8) << "calls" << std::setw(12)
+       << "max states" << std::setw(10) << "peak MB" << std::setw(10)
+       << "saved(s)"
+       << "  location / operation\n";
+  double cumulative_us = 0;
+  for (const auto& item : sorted) {
+    const auto& total = item.second;
+    cumulative_us += total.self_us;
+    const double percent = all_us > 0 ? 100.0 * total.self_us / all_us : 0;
+    const double cumulative =
+        all_us > 0 ? 100.0 * cumulative_us / all_us : 0;
+    strm << std::setw(10) << total.self_us / 1e6 << std::setw(8)
+         << std::setprecision(1) << percent << std::setw(8) << cumulative
+         << std::setprecision(3) << std::setw(10) << total.total_us / 1e6
+         << std::setw(8) << total.count << std::setw(12)
+         << total.max_output_states << std::setw(10) << std::setprecision(1)
+         << total.peak_rss_kb / 1024.0 << std::setprecision(3)
+         << std::setw(10) << total.saved_us / 1e6 << "  "
+         << std::get<0>(item.first) << ":" << std::get<1>(item.first) << " "
+         << std::get<2>(item.first) << "\n";
+  }
+}
+
+bool CompileProfiler::WriteSummary(const std::string& path) const {
+  if (path == "-") {
+    WriteSummary(std::cout);
+    return true;
+  }
+  std::ofstream strm(path);
+  if (!strm) {
+    LOG(ERROR) << "Unable to open profile summary file: " << path;
+    return false;
+  }
+  WriteSummary(strm);
+  return strm.good();
+}
+
+bool CompileProfiler::WriteRequestedOutputs() const {
+  bool success = true;
+  if (!FST_FLAGS_profile_trace.empty())
+    success &= WriteTrace(FST_FLAGS_profile_trace);
+  if (!FST_FLAGS_profile_summary.empty())
+    success &= WriteSummary(FST_FLAGS_profile_summary);
+  return success;
+}
+
+}  // namespace thrax
@@ -0,0 +1,281 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/evaluation-cache.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fst/arc.h>
+#include <fst/expanded-fst.h>
+#include <fst/fst.h>
+#include <fst/properties.h>
+#include <fst/symbol-table.h>
+#include <thrax/algo/fingerprint.h>
+
+DEFINE_int64(evaluation_cache_mb, 0,
+             "Memory budget (in MB) for reusing the results of identical "
+             "function calls within a compilation; 0 disables the cache");
+DEFINE_bool(memoize_functions, true,
+            "With --evaluation_cache_mb, also reuse the results of grammar "
+            "functions called again with identical arguments, unless they "
+            "contain assertions");
+
+namespace thrax {
+namespace {
+
+// Distinguishes values of different types with the same contents (and content
+// fingerprints from derived ones).
+enum FingerprintTag : uint64_t {
+  kFstTag = 1,
+  kSymbolTableTag,
+  kStringTag,
+  kIntTag,
+  kDerivedTag,
+};
+
+template <class Arc>
+bool IsDelayed(const ::fst::Fst<Arc>& fst) {
+  return !fst.Properties(::fst::kExpanded, false);
+}
+
+// Returns true if the value is a delayed FST.
+bool IsDelayed(const DataType& value) {
+  if (value.is<::fst::Fst<::fst::StdArc>*>()) {
+    return IsDelayed(**value.get<::fst::Fst<::fst::StdArc>*>());
+  } else if (value.is<::fst::Fst<::fst::LogArc>*>()) {
+    return IsDelayed(**value.get<::fst::Fst<::fst::LogArc>*>());
+  } else if (value.is<::fst::Fst<::fst::Log64Arc>*>()) {
+    return IsDelayed(**value.get<::fst::Fst<::fst::Log64Arc>*>());
+  }
+  return false;
+}
+
+template <class Arc>
+int64_t EstimateFstBytes(const ::fst::Fst<Arc>& fst) {
+  if (IsDelayed(fst)) return 0;
+  const auto& efst = static_cast<const ::fst::ExpandedFst<Arc>&>(fst);
+  // Roughly what a VectorFst needs per state (including the arc vector) and
+  // per arc.
+  static constexpr int64_t kStateBytes = 48;
+  int64_t bytes = 0;
+  for (typename Arc::StateId s = 0; s < efst.NumStates(); ++s)
+    bytes += kStateBytes + efst.NumArcs(s) * sizeof(Arc);
+  return bytes;
+}
+
+// The seed of the second, independent fingerprint of a leaf FST.
+constexpr uint64_t kCheckSeed = 0x636865636bULL;
+
+template <class Arc>
+void SetFstLeaf(const ::fst::Fst<Arc>& fst, uint64_t* fingerprint,
+                uint64_t* check) {
+  *fingerprint =
+      ::fst::FingerprintCombine(kFstTag, ::fst::FstFingerprint(fst));
+  *check = ::fst::FstFingerprint(fst, kCheckSeed);
+}
+
+}  // namespace
+
+std::shared_ptr<const EvaluationKey> EvaluationKey::Leaf(
+    const DataType& value) {
+  std::shared_ptr<EvaluationKey> key(new EvaluationKey());
+  uint64_t fingerprint = 0;
+  if (value.is<::fst::Fst<::fst::StdArc>*>()) {
+    SetFstLeaf(**value.get<::fst::Fst<::fst::StdArc>*>(), &fingerprint,
+               &key->check_);
+  } else if (value.is<::fst::Fst<::fst::LogArc>*>()) {
+    SetFstLeaf(**value.get<::fst::Fst<::fst::LogArc>*>(), &fingerprint,
+               &key->check_);
+  } else if (value.is<::fst::Fst<::fst::Log64Arc>*>()) {
+    SetFstLeaf(**value.get<::fst::Fst<::fst::Log64Arc>*>(), &fingerprint,
+               &key->check_);
+  } else if (value.is<::fst::SymbolTable>()) {
+    const auto* symbols = value.get<::fst::SymbolTable>();
+    // The checksum is an MD5 digest of the labels and symbols.
+    key->contents_ =
+        ::fst::StrCat(symbols->Name(), "\n", symbols->LabeledCheckSum());
+    fingerprint = ::fst::FingerprintCombine(
+        kSymbolTableTag, ::fst::FingerprintBytes(key->contents_));
+    key->check_ = kSymbolTableTag;
+  } else if (value.is<std::string>()) {
+    key->contents_ = *value.get<std::string>();
+    fingerprint = ::fst::FingerprintCombine(
+        kStringTag, ::fst::FingerprintBytes(key->contents_));
+    key->check_ = kStringTag;
+  } else if (value.is<int>()) {
+    key->contents_ = std::to_string(*value.get<int>());
+    fingerprint = ::fst::FingerprintCombine(
+        kIntTag, ::fst::FingerprintBytes(key->contents_));
+    key->check_ = kIntTag;
+  }
+  // Zero means "not computed" elsewhere, so we avoid it.
+  key->fingerprint_ = fingerprint ? fingerprint : 1;
+  key->leaf_ = true;
+  return key;
+}
+
+std::shared_ptr<const EvaluationKey> EvaluationKey::Derived(
+    const std::string& operation,
+    std::vector<std::shared_ptr<const EvaluationKey>> arguments) {
+  std::shared_ptr<EvaluationKey> key(new EvaluationKey());
+  uint64_t fingerprint = ::fst::FingerprintCombine(
+      kDerivedTag, ::fst::FingerprintBytes(operation));
+  for (const auto& argument : arguments) {
+    fingerprint =
+        ::fst::FingerprintCombine(fingerprint, argument->fingerprint());
+  }
+  key->fingerprint_ = fingerprint ? fingerprint : 1;
+  key->operation_ = operation;
+  key->arguments_ = std::move(arguments);
+  return key;
+}
+
+bool EvaluationKey::Equals(const EvaluationKey& other) const {
+  if (this == &other) return true;
+  if (fingerprint_ != other.fingerprint_) return false;
+  if (leaf_ || other.leaf_) {
+    return leaf_ && other.leaf_ && check_ == other.check_ &&
+           contents_ == other.contents_;
+  }
+  if (operation_ != other.operation_ ||
+      arguments_.size() != other.arguments_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < arguments_.size(); ++i) {
+    if (!arguments_[i]->Equals(*other.arguments_[i])) return false;
+  }
+  return true;
+}
+
+int64_t EvaluationKey::Bytes() const {
+  int64_t bytes = 0;
+  std::unordered_set<const EvaluationKey*> visited;
+  std::vector<const EvaluationKey*> stack = {this};
+  while (!stack.empty()) {
+    const auto* key = stack.back();
+    stack.pop_back();
+    if (!visited.insert(key).second) continue;
+    bytes += sizeof(*key) + key->contents_.size() + key->operation_.size();
+    for (const auto& argument : key->arguments_) {
+      stack.push_back(argument.get());
+    }
+  }
+  return bytes;
+}
+
+std::shared_ptr<const EvaluationKey> GetEvaluationKey(DataType* value) {
+  if (!value->key()) {
+    if (IsDelayed(*value)) return nullptr;
+    value->set_key(EvaluationKey::Leaf(*value));
+  }
+  return value->key();
+}
+
+int64_t EstimateDataTypeBytes(const DataType& value) {
+  if (value.is<::fst::Fst<::fst::StdArc>*>()) {
+    return EstimateFstBytes(**value.get<::fst::Fst<::fst::StdArc>*>());
+  } else if (value.is<::fst::Fst<::fst::LogArc>*>()) {
+    return EstimateFstBytes(**value.get<::fst::Fst<::fst::LogArc>*>());
+  } else if (value.is<::fst::Fst<::fst::Log64Arc>*>()) {
+    return EstimateFstBytes(**value.get<::fst::Fst<::fst::Log64Arc>*>());
+  } else if (value.is<::fst::SymbolTable>()) {
+    // An approximation of the symbol, its key and the hash table entry.
+    return value.get<::fst::SymbolTable>()->NumSymbols() * 48;
+  } else if (value.is<std::string>()) {
+    return value.get<std::string>()->size();
+  }
+  return sizeof(int);
+}
+
+EvaluationCache::EvaluationCache(int64_t max_bytes)
+    : max_bytes_(max_bytes),
+      bytes_(0),
+      lookups_(0),
+      hits_(0),
+      collisions_(0),
+      saved_seconds_(0) {}
+
+bool EvaluationCache::IsPureFunction(const std::string& function_name) {
+  static const auto* const kImpureFunctions = new std::unordered_set<
+      std::string>({"AssertEmpty", "AssertEqual", "AssertNull", "Category",
+                    "Feature", "FeatureVector", "LoadFst", "LoadFstFromFar",
+                    "StringFile", "StringFst", "StringUnion", "SymbolTable"});
+  return !kImpureFunctions->count(function_name);
+}
+
+bool EvaluationCache::IsPureCall(
+    const std::string& function_name,
+    const std::vector<std::unique_ptr<DataType>>* arguments) {
+  if (IsPureFunction(function_name)) return true;
+  // The arguments of StringFst are the parse mode, the text and possibly a
+  // symbol table. Only bracketed spans generate labels (conservatively
+  // including escaped brackets).
+  return function_name == "StringFst" && arguments &&
+         arguments->size() >= 2 && (*arguments)[1] &&
+         (*arguments)[1]->is<std::string>() &&
+         (*arguments)[1]->get<std::string>()->find('[') == std::string::npos;
+}
+
+std::unique_ptr<DataType> EvaluationCache::Find(const EvaluationKey& key,
+                                                double* seconds) {
+  ++lookups_;
+  const auto it = index_.find(key.fingerprint());
+  if (it == index_.end()) return nullptr;
+  if (!it->second->key->Equals(key)) {
+    ++collisions_;
+    return nullptr;
+  }
+  ++hits_;
+  // Moves the entry to the front.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  const auto& entry = *it->second;
+  saved_seconds_ += entry.seconds;
+  *seconds = entry.seconds;
+  return entry.value->Copy();
+}
+
+void EvaluationCache::Insert(std::shared_ptr<const EvaluationKey> key,
+                             const DataType& value, double seconds) {
+  // On a collision, the entry already there is kept.
+  if (index_.count(key->fingerprint()) || IsDelayed(value)) return;
+  const int64_t bytes = EstimateDataTypeBytes(value) + key->Bytes();
+  if (bytes > max_bytes_) return;
+  const uint64_t fingerprint = key->fingerprint();
+  entries_.push_front(Entry{std::move(key), value.Copy(), bytes, seconds});
+  index_[fingerprint] = entries_.begin();
+  bytes_ += bytes;
+  // Evicts the least recently used entries until we are within budget.
+  while (bytes_ > max_bytes_) {
+    const auto& victim = entries_.back();
+    bytes_ -= victim.bytes;
+    index_.erase(victim.key->fingerprint());
+    entries_.pop_back();
+  }
+}
+
+std::string EvaluationCache::Stats() const {
+  const double rate = lookups_ ? 100.0 * hits_ / lookups_ : 0;
+  return ::fst::StrCat(hits_, " of ", lookups_, " lookups hit (",
+                       static_cast<int>(rate), "%), ", entries_.size(),
+                       " entries, ", bytes_ / (1024 * 1024), " MB, saving ",
+                       static_cast<int64_t>(saved_seconds_ * 1000), " ms, ",
+                       collisions_, " fingerprint collisions");
+}
+
+}  // namespace thrax
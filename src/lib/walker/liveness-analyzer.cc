@@ -0,0 +1,137 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/liveness-analyzer.h>
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <thrax/collection-node.h>
+#include <thrax/fst-node.h>
+#include <thrax/function-node.h>
+#include <thrax/grammar-node.h>
+#include <thrax/identifier-node.h>
+#include <thrax/return-node.h>
+#include <thrax/rule-node.h>
+#include <thrax/statement-node.h>
+
+namespace thrax {
+
+AstLivenessAnalyzer::AstLivenessAnalyzer() : statement_(nullptr) {}
+
+AstLivenessAnalyzer::~AstLivenessAnalyzer() {}
+
+void AstLivenessAnalyzer::AnalyzeGrammar(GrammarNode* node) {
+  AnalyzeScope(nullptr, node->GetStatements());
+}
+
+void AstLivenessAnalyzer::AnalyzeFunction(FunctionNode* node) {
+  if (!analyzed_functions_.insert(node).second) return;
+  AnalyzeScope(node->GetArguments(), node->GetBody());
+}
+
+const std::vector<AstLivenessAnalyzer::Id>* AstLivenessAnalyzer::ReleasesAfter(
+    const StatementNode* node) const {
+  const auto it = releases_after_.find(node);
+  return it == releases_after_.end() ? nullptr : &it->second;
+}
+
+void AstLivenessAnalyzer::AnalyzeScope(CollectionNode* arguments,
+                                       CollectionNode* statements) {
+  variables_.clear();
+  if (arguments) {
+    for (int i = 0; i < arguments->Size(); ++i) {
+      const auto* argument = fst::down_cast<IdentifierNode*>((*arguments)[i]);
+      ++variables_[argument->GetIdentifierId()].definitions;
+    }
+  }
+  statements->Accept(this);
+  for (const auto& [id, variable] : variables_) {
+    if (variable.definitions != 1 || variable.exported) continue;
+    const Use& use = variable.last_use;
+    if (!use.node) {
+      if (variable.rule) dead_rules_.insert(variable.rule);
+    } else if (use.count == 1) {
+      last_uses_.insert(use.node);
+    } else {
+      releases_after_[use.statement].push_back(id);
+    }
+  }
+  variables_.clear();
+}
+
+void AstLivenessAnalyzer::Visit(CollectionNode* node) {
+  for (int i = 0; i < node->Size(); ++i) (*node)[i]->Accept(this);
+}
+
+void AstLivenessAnalyzer::Visit(FstNode* node) {
+  switch (node->GetType()) {
+    case FstNode::IDENTIFIER_FSTNODE: {
+      const auto* identifier =
+          fst::down_cast<IdentifierNode*>(node->GetArgument(0));
+      if (identifier->HasNamespaces()) return;
+      // Only variables defined so far are local; any other name is either an
+      // error or resolved elsewhere.
+      const auto it = variables_.find(identifier->GetIdentifierId());
+      if (it == variables_.end()) return;
+      Use& use = it->second.last_use;
+      if (use.statement == statement_) {
+        ++use.count;
+      } else {
+        use.statement = statement_;
+        use.count = 1;
+      }
+      use.node = identifier;
+      return;
+    }
+    case FstNode::FUNCTION_FSTNODE:
+      // The first argument names the function.
+      node->GetArgument(1)->Accept(this);
+      return;
+    default:
+      for (int i = 0; i < node->NumArguments(); ++i)
+        node->GetArgument(i)->Accept(this);
+  }
+}
+
+void AstLivenessAnalyzer::Visit(RepetitionFstNode* node) {
+  Visit(fst::implicit_cast<FstNode*>(node));
+}
+
+void AstLivenessAnalyzer::Visit(ReturnNode* node) { node->Get()->Accept(this); }
+
+void AstLivenessAnalyzer::Visit(RuleNode* node) {
+  node->Get()->Accept(this);
+  // The name is only bound once the right-hand side has been evaluated.
+  const IdentifierNode* name = node->GetName();
+  if (name->HasNamespaces()) return;
+  Variable& variable = variables_[name->GetIdentifierId()];
+  ++variable.definitions;
+  variable.rule = node;
+  if (node->ShouldExport()) variable.exported = true;
+}
+
+void AstLivenessAnalyzer::Visit(StatementNode* node) {
+  statement_ = node;
+  node->Get()->Accept(this);
+  statement_ = nullptr;
+}
+
+void AstLivenessAnalyzer::Visit(StringFstNode* node) {
+  Visit(fst::implicit_cast<FstNode*>(node));
+}
+
+}  // namespace thrax
@@ -10,6 +10,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <mutex>
+
 #include <thrax/arcsort.h>
 #include <thrax/assert-empty.h>
 #include <thrax/assert-equal.h>
@@ -47,7 +49,9 @@
 namespace thrax {
 namespace function {
 
-void RegisterFunctions() {
+namespace {
+
+void RegisterFunctionsOnce() {
   REGISTER_GRM_FUNCTION(Analyzer);
   REGISTER_GRM_FUNCTION(ArcSort);
   REGISTER_GRM_FUNCTION(AssertEmpty);
@@ -59,6 +63,7 @@ void RegisterFunctions() {
   REGISTER_GRM_FUNCTION(AssertNull);
   REGISTER_GRM_FUNCTION(Category);
   REGISTER_GRM_FUNCTION(CDRewrite);
+  REGISTER_GRM_FUNCTION(CDRewriteCascade);
   REGISTER_GRM_FUNCTION(Closure);
   REGISTER_GRM_FUNCTION(Compose);
   REGISTER_GRM_FUNCTION(Concat);
@@ -91,5 +96,13 @@ void RegisterFunctions() {
   REGISTER_GRM_FUNCTION(UnionDelayed);
 }
 
+}  // namespace
+
+// Registration happens once, however many compilers (or threads) ask for it.
+void RegisterFunctions() {
+  static std::once_flag once;
+  std::call_once(once, RegisterFunctionsOnce);
+}
+
 }  // namespace function
 }  // namespace thrax
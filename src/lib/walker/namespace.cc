@@ -14,21 +14,25 @@
 //
 #include <thrax/namespace.h>
 
-#include <iterator>
 #include <map>
 #include <string>
 
+#include <thrax/identifier-interner.h>
 #include <thrax/identifier-node.h>
 #include <fst/compat.h>
 
 namespace thrax {
 
 Namespace::Namespace()
-    : toplevel_(false), resources_(new ResourceMap()), owns_resources_(true) {}
+    : toplevel_(false),
+      filename_id_(Intern(filename_)),
+      resources_(new Resources()),
+      owns_resources_(true) {}
 
-Namespace::Namespace(const std::string& filename, ResourceMap* resource_map)
+Namespace::Namespace(const std::string& filename, Resources* resource_map)
     : toplevel_(false),
       filename_(filename),
+      filename_id_(Intern(filename)),
       resources_(resource_map),
       owns_resources_(false) {}
 
@@ -42,7 +46,7 @@ Namespace* Namespace::AddSubNamespace(const std::string& filename,
   // NB: Using `new` rather than `std::make_unique` due to private constructor.
   auto new_namespace = fst::WrapUnique(new Namespace(filename, resources_));
   auto it_success =
-      alias_namespace_map_.emplace(alias, std::move(new_namespace));
+      alias_namespace_map_.emplace(Intern(alias), std::move(new_namespace));
   if (!it_success.second) {
     LOG(FATAL) << "Cannot reuse the same alias for two files: " << alias
                << " in  " << filename;
@@ -54,41 +58,30 @@ Namespace* Namespace::AddSubNamespace(const std::string& filename,
 }
 
 void Namespace::PushLocalEnvironment() {
-  local_env_.push(std::make_unique<ResourceMap>());
+  local_env_.push(std::make_unique<Resources>());
 }
 
 void Namespace::PopLocalEnvironment() { local_env_.pop(); }
 
 int Namespace::LocalEnvironmentDepth() const { return local_env_.size(); }
 
-bool Namespace::EraseLocal(const std::string& identifier) {
-  return local_env_.top()->Erase(identifier);
+bool Namespace::EraseLocal(Id identifier_id) {
+  return local_env_.top()->Erase(identifier_id);
 }
 
-Namespace* Namespace::ResolveNamespace(const IdentifierNode& identifier) {
-  IdentifierNode::const_iterator where = identifier.begin();
-  return ResolveNamespaceInternal(identifier, &where);
+bool Namespace::EraseLocal(const std::string& identifier) {
+  return EraseLocal(Intern(identifier));
 }
 
-Namespace* Namespace::ResolveNamespaceInternal(
-    const IdentifierNode& identifier,
-    IdentifierNode::const_iterator* identifier_nspos) {
-  if (*identifier_nspos == identifier.end()) {
-    // Here, we're at the end and can just look this up.
-    return this;
-  } else {
-    // Here, we need to look up the next namespace and return that, maybe
-    // creating it if requested.
-    const std::string& namespace_name = **identifier_nspos;
-    auto it = alias_namespace_map_.find(namespace_name);
-    if (it != alias_namespace_map_.end()) {
-      ++(*identifier_nspos);
-      auto& next = it->second;
-      return next->ResolveNamespaceInternal(identifier, identifier_nspos);
-    } else {
-      return nullptr;
-    }
+Namespace* Namespace::ResolveNamespace(const IdentifierNode& identifier) {
+  // Follows the aliases one namespace component at a time.
+  Namespace* current = this;
+  for (const Id alias_id : identifier.GetNamespaceIds()) {
+    const auto it = current->alias_namespace_map_.find(alias_id);
+    if (it == current->alias_namespace_map_.end()) return nullptr;
+    current = it->second.get();
   }
+  return current;
 }
 
 std::string Namespace::GetFilename() const {
@@ -99,9 +92,4 @@ void Namespace::SetTopLevel() { toplevel_ = true; }
 
 bool Namespace::IsTopLevel() const { return toplevel_; }
 
-std::string Namespace::ConstructMapName(
-    const std::string& identifier_name) const {
-  return ::fst::StrCat(filename_, "/", identifier_name);
-}
-
 }  // namespace thrax
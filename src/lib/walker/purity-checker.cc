@@ -0,0 +1,92 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/purity-checker.h>
+
+#include <map>
+
+#include <thrax/collection-node.h>
+#include <thrax/fst-node.h>
+#include <thrax/function-node.h>
+#include <thrax/identifier-node.h>
+#include <thrax/return-node.h>
+#include <thrax/rule-node.h>
+#include <thrax/statement-node.h>
+#include <thrax/evaluation-cache.h>
+#include <thrax/namespace.h>
+
+namespace thrax {
+
+AstPurityChecker::AstPurityChecker() : env_(nullptr), pure_so_far_(true) {}
+
+AstPurityChecker::~AstPurityChecker() {}
+
+bool AstPurityChecker::IsPure(FunctionNode* node, Namespace* env) {
+  const auto it = pure_.find(node);
+  if (it != pure_.end()) return it->second;
+  // Functions can only call functions defined before them, but in case of a
+  // cycle we err on the side of impurity.
+  pure_[node] = false;
+  Namespace* prev_env = env_;
+  const bool prev_pure_so_far = pure_so_far_;
+  env_ = env;
+  pure_so_far_ = true;
+  node->GetBody()->Accept(this);
+  const bool pure = pure_so_far_;
+  env_ = prev_env;
+  pure_so_far_ = prev_pure_so_far;
+  pure_[node] = pure;
+  return pure;
+}
+
+void AstPurityChecker::Visit(CollectionNode* node) {
+  for (int i = 0; pure_so_far_ && i < node->Size(); ++i)
+    (*node)[i]->Accept(this);
+}
+
+void AstPurityChecker::Visit(FstNode* node) {
+  if (node->GetType() == FstNode::FUNCTION_FSTNODE) {
+    IdentifierNode* identifier =
+        fst::down_cast<IdentifierNode*>(node->GetArgument(0));
+    Namespace* where;
+    FunctionNode* callee = env_->Get<FunctionNode>(*identifier, &where);
+    if (callee) {
+      if (!IsPure(callee, where)) pure_so_far_ = false;
+    } else if (identifier->HasNamespaces() ||
+               !EvaluationCache::IsPureFunction(
+                   identifier->GetIdentifier())) {
+      pure_so_far_ = false;
+    }
+  }
+  for (int i = 0; pure_so_far_ && i < node->NumArguments(); ++i)
+    node->GetArgument(i)->Accept(this);
+}
+
+void AstPurityChecker::Visit(RepetitionFstNode* node) {
+  Visit(fst::implicit_cast<FstNode*>(node));
+}
+
+void AstPurityChecker::Visit(ReturnNode* node) { node->Get()->Accept(this); }
+
+void AstPurityChecker::Visit(RuleNode* node) { node->Get()->Accept(this); }
+
+void AstPurityChecker::Visit(StatementNode* node) {
+  node->Get()->Accept(this);
+}
+
+void AstPurityChecker::Visit(StringFstNode* node) {
+  Visit(fst::implicit_cast<FstNode*>(node));
+}
+
+}  // namespace thrax
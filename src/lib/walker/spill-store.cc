@@ -0,0 +1,86 @@
+// Copyright 2005-2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <thrax/spill-store.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <thrax/compat/utils.h>
+
+DEFINE_int64(max_memory_mb, 0,
+             "Memory budget (in MB) for the FSTs bound to grammar variables; "
+             "beyond it, the least recently used ones are written to disk "
+             "until needed again. 0 means no limit");
+DEFINE_string(spill_dir, "",
+              "Directory in which to write FSTs under --max_memory_mb "
+              "(defaults to $TMPDIR, or /tmp)");
+
+namespace thrax {
+
+SpillStore::SpillStore(int64_t max_bytes)
+    : max_bytes_(max_bytes),
+      failed_(false),
+      next_file_(0),
+      spills_(0),
+      spilled_bytes_(0),
+      reloads_(0) {}
+
+SpillStore::~SpillStore() {
+  if (directory_.empty()) return;
+  for (int64_t i = 0; i < next_file_; ++i) {
+    // Most have been removed already, once read back.
+    std::remove(JoinPath(directory_, ::fst::StrCat(i, ".fst")).c_str());
+  }
+  rmdir(directory_.c_str());
+}
+
+std::string SpillStore::NewPath() {
+  if (directory_.empty()) {
+    if (failed_) return "";
+    std::string parent = FST_FLAGS_spill_dir;
+    if (parent.empty()) {
+      const char* tmpdir = std::getenv("TMPDIR");
+      parent = tmpdir && *tmpdir ? tmpdir : "/tmp";
+    }
+    std::string pattern = JoinPath(parent, "thrax-spill-XXXXXX");
+    std::vector<char> buffer(pattern.begin(), pattern.end());
+    buffer.push_back('\0');
+    if (!mkdtemp(buffer.data())) {
+      LOG(WARNING) << "Cannot create a spill directory in " << parent
+                   << "; keeping all FSTs in memory";
+      failed_ = true;
+      return "";
+    }
+    directory_ = buffer.data();
+    VLOG(1) << "Spilling FSTs to " << directory_;
+  }
+  return JoinPath(directory_, ::fst::StrCat(next_file_++, ".fst"));
+}
+
+void SpillStore::Remove(const std::string& path) {
+  std::remove(path.c_str());
+}
+
+std::string SpillStore::Stats() const {
+  return ::fst::StrCat(spills_, " FSTs written to disk (",
+                       spilled_bytes_ / (1024 * 1024), " MB), ", reloads_,
+                       " read back");
+}
+
+}  // namespace thrax